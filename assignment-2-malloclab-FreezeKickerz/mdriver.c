@@ -120,6 +120,8 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;       /* space utilization for this trace (always 0 for libc) */
+    size_t searches;   /* free-list searches during the utilization run */
+    size_t budget_hits;/* ... and how many ran out of search budget */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -132,6 +134,16 @@ typedef struct {
     double tput;  /* average throughput expressed in Kops/s */
 } sum_stats_t;
 
+/* Summarizes one replay of a trace through the handle API (-H) */
+typedef struct {
+    size_t peak_heap;   /* high-water mark of the heap */
+    size_t peak_data;   /* high-water mark of live payload bytes */
+    long steps;         /* compaction steps that moved something */
+    size_t moved;       /* total bytes moved by the compactor */
+    double total_usecs; /* time spent in the steps that moved something */
+    double max_usecs;   /* longest single mm_compact_step call */
+} handle_stats_t;
+
 /********************
  * For debugging.  If debug-mode is on, then we have each block start
  * at a "random" place (a hash of the index), and copy random data
@@ -164,6 +176,10 @@ static size_t maxfill = MAXFILL;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* Handle mode (-H): replay traces through mm_halloc and friends */
+static bool handle_mode = false;
+static size_t compact_budget = 4096; /* bytes of work per mm_compact_step (-B) */
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -218,9 +234,13 @@ static void eval_libc_speed(void *ptr);
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static bool eval_mm_handles(trace_t *trace, size_t budget, handle_stats_t *hs);
+static void run_handle_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void print_search_stats(int n, stats_t *stats);
 static void usage(char *prog);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -286,6 +306,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            mm_search_stats(&mm_stats[i].searches, &mm_stats[i].budget_hits);
             speed_params->trace = trace;
             if (verbose > 1)
                 printf("and performance.\n");
@@ -359,7 +380,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDT")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDTHB:")) != EOF) {
         switch (c) {
 
             case 'f': /* Use one specific trace file only (relative to curr dir) */
@@ -409,6 +430,14 @@ int main(int argc, char **argv)
                 tab_mode = true;
                 break;
 
+            case 'H': /* Replay traces through the handle API */
+                handle_mode = true;
+                break;
+
+            case 'B': /* Compaction budget for handle mode */
+                compact_budget = strtoul(optarg, NULL, 0);
+                break;
+
             case 'h': /* Print this message */
                 usage(argv[0]);
                 exit(0);
@@ -435,6 +464,13 @@ int main(int argc, char **argv)
         signal(SIGALRM, timeout_handler);
     }
 
+#if !REF_ONLY
+    if (handle_mode) {
+        run_handle_tests(num_global_tracefiles, tracedir, global_tracefiles);
+        exit(0);
+    }
+#endif /* !REF_ONLY */
+
     /*
      * Optionally run and evaluate the libc malloc package
      */
@@ -520,6 +556,7 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_global_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            print_search_stats(num_global_tracefiles, mm_stats);
         }
     }
 
@@ -1351,6 +1388,153 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_handles - Replay a trace through the relocatable handle API,
+ *    calling mm_compact_step(budget) after every free and realloc
+ *    (budget 0 disables compaction). The first word of each block
+ *    holds its index and is checked whenever the block is touched,
+ *    so a compactor that loses data is caught. Returns false on error.
+ */
+static bool eval_mm_handles(trace_t *trace, size_t budget, handle_stats_t *hs)
+{
+    int i, index;
+    size_t size, total_size = 0;
+    mm_handle_t *handles;
+    size_t *sizes;
+    struct timespec start, end;
+
+    memset(hs, 0, sizeof(*hs));
+    handles = calloc(trace->num_ids, sizeof(mm_handle_t));
+    sizes = calloc(trace->num_ids, sizeof(size_t));
+    if (handles == NULL || sizes == NULL)
+        unix_error("calloc in eval_mm_handles failed");
+
+    mem_reset_brk();
+    if (!mm_init())
+        app_error("mm_init failed in eval_mm_handles");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        /* Every block we are about to touch must still hold its index */
+        if (trace->ops[i].type != ALLOC && index >= 0 && handles[index] &&
+            sizes[index] >= sizeof(uint64_t) &&
+            mem_read(mm_hderef(handles[index]), sizeof(uint64_t)) != (uint64_t)index) {
+            malloc_error(trace, i, "block %d lost its data after compaction", index);
+            free(handles);
+            free(sizes);
+            return false;
+        }
+
+        switch (trace->ops[i].type) {
+
+            case ALLOC: /* mm_halloc */
+                if ((handles[index] = mm_halloc(size)) == 0) {
+                    malloc_error(trace, i, "mm_halloc failed");
+                    free(handles);
+                    free(sizes);
+                    return false;
+                }
+                if (size >= sizeof(uint64_t))
+                    mem_write(mm_hderef(handles[index]), (uint64_t)index, sizeof(uint64_t));
+                sizes[index] = size;
+                total_size += size;
+                break;
+
+            case REALLOC: /* mm_hrealloc */
+                if (!mm_hrealloc(&handles[index], size)) {
+                    malloc_error(trace, i, "mm_hrealloc failed");
+                    free(handles);
+                    free(sizes);
+                    return false;
+                }
+                if (handles[index] && size >= sizeof(uint64_t) &&
+                    sizes[index] < sizeof(uint64_t))
+                    mem_write(mm_hderef(handles[index]), (uint64_t)index, sizeof(uint64_t));
+                total_size += size - sizes[index];
+                sizes[index] = size;
+                break;
+
+            case FREE: /* mm_hfree */
+                if (index >= 0) {
+                    mm_hfree(handles[index]);
+                    handles[index] = 0;
+                    total_size -= sizes[index];
+                    sizes[index] = 0;
+                }
+                break;
+
+            default:
+                app_error("Nonexistent request type in eval_mm_handles");
+        }
+
+        if (budget > 0 && trace->ops[i].type != ALLOC) {
+            size_t moved;
+            double usecs;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            moved = mm_compact_step(budget);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            usecs = (end.tv_sec - start.tv_sec) * 1e6 +
+                (end.tv_nsec - start.tv_nsec) / 1e3;
+            if (moved > 0) {
+                hs->steps++;
+                hs->moved += moved;
+                hs->total_usecs += usecs;
+            }
+            hs->max_usecs = (usecs > hs->max_usecs) ? usecs : hs->max_usecs;
+        }
+
+        /* update the high-water marks */
+        hs->peak_data = (total_size > hs->peak_data) ? total_size : hs->peak_data;
+        hs->peak_heap = (mem_heapsize() > hs->peak_heap) ? mem_heapsize() : hs->peak_heap;
+    }
+
+    free(handles);
+    free(sizes);
+    return mm_checkheap(__LINE__);
+}
+
+/*
+ * run_handle_tests - For each trace, compare the peak heap of a handle
+ *    replay that only compacts where the allocator does, before growing
+ *    the heap (MM_GROW_COMPACT), against one with a compaction step after
+ *    every free/realloc, and report the pause each of those steps costs.
+ */
+static void run_handle_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles)
+{
+    int i;
+    stats_t stats;
+    handle_stats_t none, comp;
+
+    printf("Handle mode: compaction budget %zu bytes per step\n", compact_budget);
+    printf("%-28s %10s %10s %7s %7s %8s %10s %8s %8s\n", "trace",
+           "heap(KB)", "compact", "util", "util'", "steps", "moved(KB)",
+           "avg(us)", "max(us)");
+    for (i = 0; i < num_tracefiles; i++) {
+        mem_init();
+        trace_t *trace = read_trace(&stats, tracedir, tracefiles[i]);
+        if (!eval_mm_handles(trace, 0, &none) ||
+            !eval_mm_handles(trace, compact_budget, &comp)) {
+            printf("%-28s %10s\n", trace->filename, "FAILED");
+            errors++;
+        } else {
+            double avg_usecs = comp.steps ? comp.total_usecs / comp.steps : 0.0;
+            printf("%-28s %10.1f %10.1f %6.1f%% %6.1f%% %8ld %10.1f %8.3f %8.3f\n",
+                   trace->filename, none.peak_heap / 1024.0,
+                   comp.peak_heap / 1024.0,
+                   100.0 * none.peak_data / none.peak_heap,
+                   100.0 * comp.peak_data / comp.peak_heap, comp.steps,
+                   comp.moved / 1024.0, avg_usecs,
+                   comp.max_usecs);
+        }
+        free_trace(trace);
+        mem_deinit();
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1826,12 +2010,33 @@ static double measure_ref_throughput() {
 }
 
 
+/*
+ * print_search_stats - Report how often mm.c's bounded free-list search
+ *    gave up, to weigh against the utilization in the table above
+ */
+static void print_search_stats(int n, stats_t *stats)
+{
+    size_t searches = 0, hits = 0, ignored;
+    size_t budget = mm_search_stats(&ignored, &ignored);
+    int i;
+
+    if (budget == 0)
+        return;
+    for (i = 0; i < n; i++) {
+        searches += stats[i].searches;
+        hits += stats[i].budget_hits;
+    }
+    printf("Search budget = %zu. %zu of %zu searches (%.2f%%) fell back\n\n",
+           budget, hits, searches,
+           searches ? 100.0 * hits / searches : 0.0);
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(char *prog)
 {
-    fprintf(stderr, "Usage: %s [-hlVdD] [-f <file>]\n", prog);
+    fprintf(stderr, "Usage: %s [-hlVdDH] [-f <file>] [-B <n>]\n", prog);
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1844,4 +2049,6 @@ static void usage(char *prog)
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
+    fprintf(stderr, "\t-H         Replay traces through the handle API and report compaction\n");
+    fprintf(stderr, "\t-B <n>     Compaction budget in bytes per step for -H (default 4096)\n");
 }
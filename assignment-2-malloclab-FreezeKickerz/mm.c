@@ -7,9 +7,28 @@
  * doubly-linked free list. Each memory block includes a header and footer that encode
  * the block's size and allocation status using bit flags. The allocator supports block
  * splitting to efficiently utilize memory and coalescing of adjacent free blocks to
- * minimize fragmentation. All blocks are aligned to 16 bytes, and standard routines
- * (malloc, free, realloc, and calloc) are provided along with heap consistency checking
- * (mm_checkheap) when debugging is enabled.
+ * minimize fragmentation. All payloads are aligned to MM_ALIGNMENT bytes (mm_config.h),
+ * and standard routines (malloc, free, realloc, and calloc) are provided along with heap
+ * consistency checking (mm_checkheap) when debugging is enabled.
+ *
+ * The policy knobs (alignment, minimum block, initial heap, growth chunk, size-class
+ * table, fit policy and coalescing mode) are compile-time constants from mm_config.h.
+ * The defaults give a single free list with first fit and immediate coalescing; with
+ * more than one class the free list is segregated by block size and a search starts
+ * at the request's class and moves up.
+ *
+ * Relocatable allocations (mm_halloc and friends) are ordinary blocks with one extra
+ * word at the end naming their slot in a handle table; the table itself is a pinned
+ * block. A block is handle-owned exactly when its back-reference slot points back at
+ * its payload, so mm_compact_step can walk the heap, slide those blocks down into the
+ * free block before them and coalesce the hole they leave behind.
+ *
+ * In guard mode every MM_GUARD_SAMPLE-th request is padded: the caller's bytes start
+ * ALIGNMENT bytes into the payload, the two words in front of them hold the requested
+ * size and a canary derived from the caller's address, and everything after the
+ * caller's bytes is filled with GUARD_POISON. Guarded addresses are recorded in a
+ * small open-addressing table kept in a pinned block, so free recognizes a guarded
+ * block even when an underflow has overwritten its canary, and reports it.
  *
  */
 #include <assert.h>
@@ -22,6 +41,7 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "mm_config.h"
 
 /*
  * If you want to enable your debugging output and heap checker code,
@@ -51,7 +71,7 @@
 #define memcpy mm_memcpy
 #endif // DRIVER
 
-#define ALIGNMENT 16
+#define ALIGNMENT MM_ALIGNMENT
 // Global pointer
 static void* search(size_t);
 /* Block Structure */
@@ -61,10 +81,52 @@ typedef struct Block{
     struct Block* prev_node;
 } Block;
 
-//Free Block pointer
-Block* free_block_pointer;
+//Free list heads, one per size class
+static Block* free_lists[MM_NUM_CLASSES];
+
+//Exclusive upper bound on the block size of each class
+static const size_t class_limits[MM_NUM_CLASSES] = { MM_CLASS_TABLE };
+
+#if MM_COALESCE == MM_COALESCE_DEFERRED
+//Bytes freed since the last coalescing pass
+static size_t deferred_bytes;
+#endif
+
+//Handle table: live slots hold a payload pointer, free slots hold (next free handle << 1) | 1
+static void** handle_table;
+static size_t handle_capacity;
+static size_t handle_free;                       // First free handle, 0 when the table is full
+
+//Block header where the next compaction step resumes, NULL to start a new pass
+static size_t* compact_cursor;
+
+//Free-list searches since mm_init, and how many of them used up MM_SEARCH_BUDGET
+static size_t search_count;
+static size_t search_budget_hits;
+
+#if MM_GUARD_SAMPLE > 0
+//Requests left until the next guarded one
+static size_t guard_tick;
+
+//Guard table: slots hold a guarded caller pointer, GUARD_EMPTY or GUARD_REMOVED
+static size_t* guard_table;
+static size_t guard_capacity;                    // Power of two, 0 before the first guarded request
+static size_t guard_used;                        // Slots that are not GUARD_EMPTY
+static size_t guard_live;                        // Slots that hold a pointer
+
+#define GUARD_EMPTY 0
+#define GUARD_REMOVED 1                          // Never an aligned pointer
+#define GUARD_SECRET 0xA7C3E1F5D2B4968Bu
+#define GUARD_POISON 0xA5                        // Redzone fill byte
+#define GUARD_PREFIX ALIGNMENT                   // Size and canary words, padded to keep the caller aligned
+#define GUARD_OVERHEAD (GUARD_PREFIX + MM_GUARD_REDZONE)
+#endif
+
+// Footer bit that mm_checkheap sets on every block it finds in a free list
+#define LISTED_MARK 4
 
 void coalesce(Block* pointer);
+static void coalesce_heap(void);
 
 // Flag definitions
 //allocated block flag (bit 0)
@@ -78,18 +140,36 @@ static size_t align(size_t x)
 
 /********** Helper Functions **********/
 
-// Removes a block from the free list.
+// Returns the index of the size class that holds blocks of the given size.
+static inline size_t size_class(size_t size) {
+    size_t index = 0;
+    while (size >= class_limits[index]) index++; // Last limit is SIZE_MAX, so this stops
+    return index;
+}
+
+// Returns the header of the first block (after the alignment padding and prologue).
+static inline size_t* heap_first_block(void) {
+    return (size_t*)((char*)mm_heap_lo() + ALIGNMENT - 8);
+}
+
+// Returns the epilogue header (the last word of the heap).
+static inline size_t* heap_epilogue(void) {
+    return (size_t*)((char*)mm_heap_hi() - 7);
+}
+
+// Removes a block from the free list of its size class.
 static inline void remove_from_free_list(Block* block) {
     if (block->prev_node) block->prev_node->next_node = block->next_node; // Update previous block's next pointer
-    else free_block_pointer = block->next_node;                          // Update free list head if block is first
+    else free_lists[size_class(block->size_node & ~3)] = block->next_node; // Update class head if block is first
     if (block->next_node) block->next_node->prev_node = block->prev_node; // Update next block's previous pointer
 }
-// Inserts a block at the beginning of the free list.
+// Inserts a block at the beginning of the free list of its size class.
 static inline void add_to_free_list(Block* block) {
+    Block** head = &free_lists[size_class(block->size_node & ~3)]; // Class list for this block's size
     block->prev_node = NULL;                     // Set block's previous pointer to NULL
-    block->next_node = free_block_pointer;       // Link block to current head
-    if (free_block_pointer) free_block_pointer->prev_node = block; // Update current head's previous pointer
-    free_block_pointer = block;                  // Update free list head
+    block->next_node = *head;                    // Link block to current head
+    if (*head) (*head)->prev_node = block;       // Update current head's previous pointer
+    *head = block;                               // Update free list head
 }
 
 /*
@@ -99,19 +179,36 @@ static inline void add_to_free_list(Block* block) {
 
  bool mm_init(void)
  {
-    void* heap_start = mm_sbrk(4096 + 16);       // Extend heap: 4096 bytes payload + 16 bytes for prologue/epilogue
+    void* heap_start = mm_sbrk(MM_INIT_HEAP + ALIGNMENT); // Extend heap: initial block + padding/prologue/epilogue
     if (heap_start == (void*)(-1)) return false;   // Check for sbrk failure
     size_t* heap_end = mm_heap_hi() + 1;           // Pointer one past the end of the heap
 
-    *((size_t*)heap_start) = 1;                  // Set prologue header
-    Block* free_block = (Block*)((char*)heap_start + 8); // Create free block after prologue header
-    free_block->size_node = 4096;                // Set free block size
+    for (size_t i = 0; i < MM_NUM_CLASSES; i++) free_lists[i] = NULL; // Empty every size class
+#if MM_COALESCE == MM_COALESCE_DEFERRED
+    deferred_bytes = 0;                          // Nothing freed yet
+#endif
+    handle_table = NULL;                         // No handles yet
+    handle_capacity = 0;
+    handle_free = 0;
+    compact_cursor = NULL;
+    search_count = 0;                            // Reset search statistics
+    search_budget_hits = 0;
+#if MM_GUARD_SAMPLE > 0
+    guard_tick = 0;                              // First request is guarded
+    guard_table = NULL;                          // Nothing guarded yet
+    guard_capacity = 0;
+    guard_used = 0;
+    guard_live = 0;
+#endif
+    Block* free_block = (Block*)heap_first_block(); // Create free block after padding and prologue header
+    *((size_t*)free_block - 1) = 1;              // Set prologue header
+    free_block->size_node = MM_INIT_HEAP;        // Set free block size
     free_block->prev_node = NULL;                // Initialize previous pointer
     free_block->next_node = NULL;                // Initialize next pointer
     free_block->size_node ^= 2;                  // Toggle previous free flag
-    free_block_pointer = free_block;             // Set free list pointer
+    free_lists[size_class(MM_INIT_HEAP)] = free_block; // Set free list pointer
 
-    *(heap_end - 2) = 4096;                      // Set free block footer
+    *(heap_end - 2) = MM_INIT_HEAP;              // Set free block footer
     *(heap_end - 1) = 1;                         // Set epilogue header
 
     return true;
@@ -119,19 +216,32 @@ static inline void add_to_free_list(Block* block) {
 
 
 /*
- * malloc
+ * allocate_block - places a block of at least size payload bytes; with may_compact
+ * it first runs a compaction step when no free block fits, so handle requests
+ * refill holes instead of growing the heap
  */
-void* malloc(size_t size) {
+static void* allocate_block(size_t size, bool may_compact) {
     if (size == 0) return NULL;                  // Return NULL for zero size
     size_t required_block_size = align(size + 8);  // Compute block size (payload + header)
-    if (required_block_size < 32) required_block_size = 32; // Enforce minimum block size
+    if (required_block_size < MM_MIN_BLOCK) required_block_size = MM_MIN_BLOCK; // Enforce minimum block size
 
     Block* block = search(required_block_size);  // Search free list for a fitting block
+#if MM_COALESCE == MM_COALESCE_DEFERRED
+    if (!block && deferred_bytes >= required_block_size &&
+        deferred_bytes >= mm_heapsize() / 8) {   // Amortize the pass: only once an eighth of the heap was freed
+        coalesce_heap();                         // Merge the deferred frees and retry before growing
+        block = search(required_block_size);
+    }
+#endif
+#if MM_GROW_COMPACT > 0
+    if (!block && may_compact && mm_compact_step(MM_GROW_COMPACT) > 0) // Moved blocks may have merged holes
+        block = search(required_block_size);
+#endif
     if (block) {
         size_t current_size = block->size_node & ~3; // Get actual block size
         size_t remaining_size = current_size - required_block_size; // Calculate remaining size
 
-        if (remaining_size <= 32 || current_size == required_block_size) { // Use whole block if split not possible
+        if (remaining_size <= MM_MIN_BLOCK || current_size == required_block_size) { // Use whole block if split not possible
             if (block->size_node & 2) {              // Check previous free flag
                 block->size_node = current_size | 1; // Mark block as allocated
                 block->size_node ^= 2;               // Toggle previous flag
@@ -143,12 +253,15 @@ void* malloc(size_t size) {
             return (size_t*)block + 1;             // Return pointer to payload
         } else {
             size_t extra_size = current_size - required_block_size; // Calculate size for free remainder
+            bool changes_class = size_class(extra_size) != size_class(current_size); // Remainder may shrink into a smaller class
+            if (changes_class) remove_from_free_list(block); // Unlink while the header still has the old size
             if (block->size_node & 2) {
                 block->size_node = extra_size;    // Update free block size
                 block->size_node ^= 2;             // Toggle previous flag
             } else {
                 block->size_node = extra_size;    // Update free block size
             }
+            if (changes_class) add_to_free_list(block); // Relink under the remainder's class
             *((size_t*)block + (extra_size / sizeof(size_t)) - 1) = extra_size; // Set footer for free remainder
             size_t* alloc_header = (size_t*)block + (extra_size / sizeof(size_t)); // Locate header for allocated block
             *alloc_header = required_block_size | 1; // Set allocated block header
@@ -156,34 +269,176 @@ void* malloc(size_t size) {
             return alloc_header + 1;             // Return pointer to allocated payload
         }
     } else {
-        void* new_block_ptr = mm_sbrk(required_block_size); // Extend heap if no free block found
-        if (new_block_ptr == (void*)-1) return NULL; // Check for sbrk failure
+        size_t* epilogue = heap_epilogue();        // Current epilogue header
+        size_t trailing_size = 0;                  // Free block just before the epilogue, grown in place
+        if ((*epilogue & 2) == 0) {                // Previous block is free (e.g. space left by compaction)
+            trailing_size = *(epilogue - 1) & ~3;  // Read its footer
+            remove_from_free_list((Block*)(epilogue - (trailing_size / sizeof(size_t))));
+        }
+        size_t grow_size = required_block_size - trailing_size; // Bytes to request from mm_sbrk
+#if MM_GROW_CHUNK > 0
+        if (grow_size < MM_GROW_CHUNK) grow_size = MM_GROW_CHUNK; // Grow by at least one chunk
+        if (trailing_size + grow_size - required_block_size < MM_MIN_BLOCK) // Spare too small to split
+            required_block_size = trailing_size + grow_size;
+#endif
+        if (mm_sbrk(grow_size) == (void*)-1) {     // Extend heap if no free block found
+            if (trailing_size) add_to_free_list((Block*)(epilogue - (trailing_size / sizeof(size_t)))); // Put it back
+            return NULL;                           // Check for sbrk failure
+        }
         size_t* new_heap_end = mm_heap_hi() + 1;   // Get new heap end pointer
-        Block* new_block_header = (Block*)((char*)new_block_ptr - 8); // Locate new block header
+        Block* new_block_header = (Block*)(epilogue - (trailing_size / sizeof(size_t))); // Locate new block header
+        void* new_block_ptr = (size_t*)new_block_header + 1; // Payload of the new block
+        grow_size += trailing_size;                // Bytes now available to the new block
         if (new_block_header->size_node & 2) {
             new_block_header->size_node = required_block_size | 1; // Set allocated header with toggle
             new_block_header->size_node ^= 2;
         } else {
             new_block_header->size_node = required_block_size | 1; // Set allocated header
         }
+        if (grow_size > required_block_size) {     // Rest of the chunk becomes a free block
+            size_t spare_size = grow_size - required_block_size;
+            Block* spare = (Block*)((size_t*)new_block_header + (required_block_size / sizeof(size_t)));
+            spare->size_node = spare_size | 2;     // Free, previous block allocated
+            *(new_heap_end - 2) = spare_size;      // Set spare block footer
+            add_to_free_list(spare);               // Make the spare available
+            *(new_heap_end - 1) = 1;               // Epilogue follows a free block
+            return new_block_ptr;
+        }
         *(new_heap_end - 1) = 3;                   // Update epilogue header
         return new_block_ptr;                      // Return pointer to new block payload
     }
 }
 
+/*
+ * allocate - places a block of at least size payload bytes (malloc without guard sampling)
+ */
+static void* allocate(size_t size) {
+    return allocate_block(size, false);          // Callers hold raw pointers, so nothing may move
+}
+
+
+/********** Guard Mode **********/
+
+#if MM_GUARD_SAMPLE > 0
+// Canary stored in the word before a guarded caller pointer.
+static inline size_t guard_canary(const void* ptr) {
+    return (size_t)ptr ^ GUARD_SECRET;
+}
+
+// Home slot of a caller pointer in the guard table.
+static inline size_t guard_slot(const void* ptr) {
+    return (((size_t)ptr >> 4) * 0x9E3779B97F4A7C15u >> 32) & (guard_capacity - 1);
+}
+
+// Returns the guard table slot holding ptr, or NULL if guard_malloc did not hand it out.
+static size_t* guard_find(const void* ptr) {
+    if (!guard_capacity) return NULL;
+    for (size_t i = guard_slot(ptr); ; i = (i + 1) & (guard_capacity - 1)) { // Linear probing
+        if (guard_table[i] == (size_t)ptr) return &guard_table[i];
+        if (guard_table[i] == GUARD_EMPTY) return NULL;
+    }
+}
+
+// Makes room for one more guarded pointer, rebuilding the table at most half full.
+static bool guard_reserve(void) {
+    if ((guard_used + 1) * 2 <= guard_capacity) return true;
+    size_t capacity = 64;
+    while (capacity < (guard_live + 1) * 4) capacity *= 2;
+    size_t* table = allocate(capacity * sizeof(size_t)); // Table block is pinned and never guarded
+    if (!table) return false;
+    for (size_t i = 0; i < capacity; i++) table[i] = GUARD_EMPTY;
+    size_t* old_table = guard_table;
+    size_t old_capacity = guard_capacity;
+    guard_table = table;
+    guard_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {  // Reinsert live pointers, dropping removed slots
+        if (old_table[i] <= GUARD_REMOVED) continue;
+        size_t j = guard_slot((void*)old_table[i]);
+        while (table[j] != GUARD_EMPTY) j = (j + 1) & (capacity - 1);
+        table[j] = old_table[i];
+    }
+    guard_used = guard_live;
+    free(old_table);                             // Not in the new table, so freed as a plain block
+    return true;
+}
+
+// Allocates size bytes between a canary and a poisoned redzone.
+static void* guard_malloc(size_t size) {
+    if (!guard_reserve()) return allocate(size); // No room to record it: hand out a plain block
+    char* payload = allocate(size + GUARD_OVERHEAD);
+    if (!payload) return NULL;
+    char* user = payload + GUARD_PREFIX;
+    size_t block_size = *((size_t*)payload - 1) & ~3;
+    *((size_t*)user - 2) = size;                // Requested size locates the redzone
+    *((size_t*)user - 1) = guard_canary(user);
+    memset(user + size, GUARD_POISON, (size_t)(payload - sizeof(size_t) + block_size - (user + size))); // Poison the rest
+
+    size_t i = guard_slot(user);                 // Record it; reuses a removed slot if one comes first
+    while (guard_table[i] > GUARD_REMOVED) i = (i + 1) & (guard_capacity - 1);
+    if (guard_table[i] == GUARD_EMPTY) guard_used++;
+    guard_table[i] = (size_t)user;
+    guard_live++;
+    return user;
+}
+
+// Checks a guarded block's canary and redzone and aborts with a report if either was overwritten.
+static void guard_check(const void* user) {
+    if (*((const size_t*)user - 1) != guard_canary(user)) {
+        fprintf(stderr, "mm: heap corruption: %p canary overwritten\n", user);
+        abort();
+    }
+    size_t size = *((const size_t*)user - 2);   // Requested size
+    const unsigned char* payload = (const unsigned char*)user - GUARD_PREFIX;
+    size_t block_size = *((const size_t*)payload - 1) & ~3;
+    const unsigned char* end = payload - sizeof(size_t) + block_size;
+    for (const unsigned char* p = (const unsigned char*)user + size; p < end; p++) {
+        if (*p != GUARD_POISON) {
+            fprintf(stderr, "mm: heap corruption: %p (%zu bytes) overwritten at +%zu\n",
+                    user, size, (size_t)(p - (const unsigned char*)user));
+            abort();
+        }
+    }
+}
+#endif
+
+/*
+ * malloc
+ */
+void* malloc(size_t size) {
+#if MM_GUARD_SAMPLE > 0
+    if (size && guard_tick-- == 0) {             // Sampled: pad with a canary and redzone
+        guard_tick = MM_GUARD_SAMPLE - 1;
+        return guard_malloc(size);
+    }
+#endif
+    return allocate(size);
+}
 
 /*
  * free
  */ 
 void free(void* ptr) {
     if (!ptr) return;                          // Do nothing for NULL pointer
+#if MM_GUARD_SAMPLE > 0
+    size_t* guard_entry = guard_find(ptr);
+    if (guard_entry) {                         // Check the canary and redzone, then free the whole block
+        guard_check(ptr);
+        *guard_entry = GUARD_REMOVED;
+        guard_live--;
+        ptr = (char*)ptr - GUARD_PREFIX;
+    }
+#endif
     Block* block = (Block*)((char*)ptr - 8);     // Retrieve block header from payload pointer
     block->size_node &= ~1;                      // Mark block as free
     size_t block_size = block->size_node & ~3;     // Get block size
     *((size_t*)block + (block_size / sizeof(size_t)) - 1) = block_size; // Set free block footer
     *((size_t*)block + (block_size / sizeof(size_t))) &= ~2; // Clear next block's previous free flag
     add_to_free_list(block);                     // Add block to free list
+#if MM_COALESCE == MM_COALESCE_IMMEDIATE
     coalesce(block);                           // Coalesce adjacent free blocks
+#else
+    deferred_bytes += block_size;              // Left for the next coalescing pass
+#endif
 }
 
 /*
@@ -197,6 +452,9 @@ void* realloc(void* oldptr, size_t size) {
     if (newMemory) {
         Block* old_block = (Block*)((char*)oldptr - 8); // Get old block header
         size_t old_block_size = old_block->size_node & ~3; // Get old block size
+#if MM_GUARD_SAMPLE > 0
+        if (guard_find(oldptr)) old_block_size = *((size_t*)oldptr - 2); // Only the caller's bytes
+#endif
         size_t bytes_to_copy = (size > old_block_size) ? old_block_size : size; // Determine copy size
         memcpy(newMemory, oldptr, bytes_to_copy); // Copy data to new block
     }
@@ -219,17 +477,193 @@ void* calloc(size_t nmemb, size_t size)
     return ptr;
 }
 
+/********** Relocatable Handles **********/
+
+// Returns the last word of a block, which holds a handle-owned block's table slot.
+static inline size_t* handle_backref(void* payload) {
+    size_t block_size = *((size_t*)payload - 1) & ~3; // Block size from the header
+    return (size_t*)((char*)payload - 8 + block_size) - 1;
+}
+
+/*
+ * mm_halloc - allocates a relocatable block and returns its handle (0 on failure)
+ */
+mm_handle_t mm_halloc(size_t size) {
+    if (size == 0) return 0;                     // Nothing to allocate
+    if (!handle_free) {                          // Table full: double it
+        size_t capacity = handle_capacity ? 2 * handle_capacity : 64;
+        void** table = realloc(handle_table, capacity * sizeof(void*)); // Table block is pinned
+        if (!table) return 0;
+        for (size_t i = handle_capacity; i < capacity; i++) { // Chain the new slots, handle = slot + 1
+            size_t next = (i + 1 < capacity) ? i + 2 : 0;
+            table[i] = (void*)((next << 1) | 1);
+        }
+        handle_free = handle_capacity + 1;
+        handle_table = table;
+        handle_capacity = capacity;
+    }
+    void* payload = allocate_block(size + sizeof(size_t), true); // Room for the back-reference word; never guarded
+    if (!payload) return 0;
+    mm_handle_t handle = handle_free;            // Pop a free slot
+    handle_free = (size_t)handle_table[handle - 1] >> 1;
+    handle_table[handle - 1] = payload;
+    *handle_backref(payload) = handle - 1;       // Let the compactor find the slot
+    return handle;
+}
+
+/*
+ * mm_hfree - frees a relocatable block and recycles its handle
+ */
+void mm_hfree(mm_handle_t handle) {
+    if (!handle) return;                         // Null handle
+    free(handle_table[handle - 1]);              // Release the block
+    handle_table[handle - 1] = (void*)((handle_free << 1) | 1); // Push the slot on the free chain
+    handle_free = handle;
+}
+
+/*
+ * mm_hrealloc - resizes a relocatable block; the handle stays the same, except
+ * that a null handle is allocated like mm_halloc and size 0 frees and clears it
+ */
+bool mm_hrealloc(mm_handle_t* handle_ptr, size_t size) {
+    mm_handle_t handle = *handle_ptr;
+    if (!handle) {                               // Null handle: same as mm_halloc
+        if (size == 0) return true;
+        *handle_ptr = mm_halloc(size);
+        return *handle_ptr != 0;
+    }
+    if (size == 0) { mm_hfree(handle); *handle_ptr = 0; return true; } // Same as freeing
+    void* payload = allocate_block(size + sizeof(size_t), true); // Handle blocks are never guarded
+    if (!payload) return false;                  // Old block is untouched
+    void* old = handle_table[handle - 1];        // Looked up after allocating, which may have moved it
+    size_t old_size = (*((size_t*)old - 1) & ~3) - 2 * sizeof(size_t); // Payload minus back-reference
+    memcpy(payload, old, size < old_size ? size : old_size);
+    free(old);
+    handle_table[handle - 1] = payload;
+    *handle_backref(payload) = handle - 1;       // Back-reference moves to the new end
+    return true;
+}
+
+/*
+ * mm_hderef - returns the current payload address of a handle
+ */
+void* mm_hderef(mm_handle_t handle) {
+    return handle ? handle_table[handle - 1] : NULL;
+}
+
+/*
+ * mm_compact_step - resumes the compaction pass where the last step stopped and
+ * slides handle-owned blocks down into the free block before them. The budget
+ * bounds the work of one step: bytes copied plus one word per block visited.
+ * Pinned (plain malloc) blocks are stepped over, and so are blocks too large
+ * to move within any step's budget. Returns the bytes moved.
+ */
+size_t mm_compact_step(size_t budget) {
+    size_t moved = 0;                            // Bytes copied this step
+    size_t work = 0;                             // Bytes copied plus words visited
+    size_t* epilogue = heap_epilogue();          // Epilogue is allocated, so the walk stops there
+    size_t* header = compact_cursor ? compact_cursor : heap_first_block();
+
+    while (header < epilogue && work < budget) {
+        size_t block_size = *header & ~3;        // Get current block size
+        size_t* next_header = header + (block_size / sizeof(size_t));
+        work += sizeof(size_t);
+        if ((*header & 1) || (*next_header & 1) == 0 || next_header >= epilogue) {
+            header = next_header;                // Only a free block followed by an allocated one can slide
+            continue;
+        }
+        size_t next_size = *next_header & ~3;    // Candidate block size
+        void* payload = next_header + 1;
+        size_t slot = *(next_header + (next_size / sizeof(size_t)) - 1); // Claimed table slot
+        if (slot >= handle_capacity || handle_table[slot] != payload
+            || sizeof(size_t) + next_size > budget) {
+            header = next_header + (next_size / sizeof(size_t)); // Pinned or too large: step over it
+            work += sizeof(size_t);
+            continue;
+        }
+        if (work + next_size > budget) break;    // Leave it for the next step
+
+        remove_from_free_list((Block*)header);   // Hole is about to be overwritten
+        memmove(header + 1, payload, next_size - sizeof(size_t)); // Payload and back-reference
+        *header = next_size | 1 | (*header & 2); // Moved block keeps the hole's prev flag
+        handle_table[slot] = header + 1;         // Redirect the handle
+
+        size_t* hole = header + (next_size / sizeof(size_t)); // Free space now follows the moved block
+        *hole = block_size | 2;                  // Free, previous block allocated
+        *(hole + (block_size / sizeof(size_t)) - 1) = block_size; // Set hole footer
+        *(hole + (block_size / sizeof(size_t))) &= ~2; // Successor now follows a free block
+        add_to_free_list((Block*)hole);
+#if MM_COALESCE == MM_COALESCE_IMMEDIATE
+        coalesce((Block*)hole);                  // Merge with free space after it
+#endif
+        moved += next_size;
+        work += next_size;
+        header = hole;                           // Keep sliding into the same hole
+    }
+    compact_cursor = (header < epilogue) ? header : NULL; // Reached the epilogue: next step starts over
+    return moved;
+}
+
 //Searches for an open location that satisfies size
-static void* search(size_t size){
-    Block* look = free_block_pointer;
+#if MM_SEARCH_BUDGET > 0
+// Returns the head of the first non-empty class above the request's, whose
+// blocks are all large enough, else the free block at the end of the heap if
+// it fits, else NULL so that malloc extends the heap.
+static Block* search_fallback(size_t size){
+    for (size_t index = size_class(size) + 1; index < MM_NUM_CLASSES; index++)
+        if (free_lists[index]) return free_lists[index];
+    size_t* epilogue = heap_epilogue();
+    if ((*epilogue & 2) == 0 && (*(epilogue - 1) & ~3) >= size) // Trailing free block fits
+        return (Block*)(epilogue - ((*(epilogue - 1) & ~3) / sizeof(size_t)));
+    return NULL;
+}
+#endif
 
-    //Keep searching through list until suitable block or end of list
-    while(look){
-        //Masks last 2 bits to get actual block size
-        if (((look->size_node) & (~3)) >= size){
-            return look;
+static void* search(size_t size){
+    search_count++;
+#if MM_SEARCH_BUDGET > 0
+    size_t budget = MM_SEARCH_BUDGET;            // Candidates left to examine
+#endif
+    //Start at the class of the request and move up to larger classes
+    for (size_t index = size_class(size); index < MM_NUM_CLASSES; index++) {
+        Block* look = free_lists[index];
+#if MM_FIT_POLICY == MM_FIT_BEST
+        Block* best = NULL;
+        size_t best_size = SIZE_MAX;
+
+        //Scan the whole class for the tightest fit, stopping early on an exact one
+        while(look){
+#if MM_SEARCH_BUDGET > 0
+            if (budget-- == 0) {                 // Out of budget: settle for the best so far
+                search_budget_hits++;
+                return best ? best : search_fallback(size);
+            }
+#endif
+            size_t look_size = look->size_node & ~3;
+            if (look_size >= size && look_size < best_size){
+                if (look_size == size) return look;
+                best = look;
+                best_size = look_size;
+            }
+            look = look->next_node;
+        }
+        if (best) return best;
+#else
+        //Keep searching through list until suitable block or end of list
+        while(look){
+#if MM_SEARCH_BUDGET > 0
+            if (budget-- == 0) {                 // Out of budget: stop scanning
+                search_budget_hits++;
+                return search_fallback(size);
+            }
+#endif
+            //Masks last 2 bits to get actual block size
+            if (((look->size_node) & (~3)) >= size){
+                return look;
+            }
+            look = look->next_node;
         }
-        look = look->next_node;
+#endif
     }
     return NULL;
 }
@@ -243,8 +677,8 @@ void coalesce(Block* block) {
     size_t* prev_footer = (size_t*)block - 1;      // Locate previous block's footer
     size_t prev_size = *prev_footer & ~3;          // Get previous block size
     size_t* prev_header = (size_t*)block - (prev_size / sizeof(size_t)); // Locate previous block header
-    if (prev_free && (prev_header >= (size_t*)mm_heap_lo() + 1) &&
-        (prev_header < (size_t*)mm_heap_hi() - 7)) { // If previous block is free and in bounds
+    if (prev_free && (prev_header >= heap_first_block()) &&
+        (prev_header < heap_epilogue())) {       // If previous block is free and in bounds
         Block* prev_block = (Block*)prev_header; // Cast to Block pointer
         remove_from_free_list(prev_block);       // Remove previous block from free list
         merged_size += prev_block->size_node & ~3; // Add its size to merged size
@@ -252,8 +686,8 @@ void coalesce(Block* block) {
     }
 
     size_t* next_header = (size_t*)block + (current_size / sizeof(size_t)); // Locate next block header
-    if ((next_header >= (size_t*)mm_heap_lo() + 1) &&
-        (next_header < (size_t*)mm_heap_hi() - 7) &&
+    if ((next_header >= heap_first_block()) &&
+        (next_header < heap_epilogue()) &&
         ((*next_header & 1) == 0)) {             // If next block is free and in bounds
         Block* next_block = (Block*)next_header; // Cast to Block pointer
         remove_from_free_list(next_block);       // Remove next block from free list
@@ -266,9 +700,49 @@ void coalesce(Block* block) {
         merged_block->size_node ^= 2;              // Toggle previous free flag as needed
         *((size_t*)merged_block + (merged_size / sizeof(size_t)) - 1) = merged_size; // Update merged footer
         add_to_free_list(merged_block);            // Add merged block to free list
+        if (compact_cursor == (size_t*)block || compact_cursor == next_header)
+            compact_cursor = (size_t*)merged_block; // Keep the compactor on a block boundary
+    }
+}
+
+// Merges every run of adjacent free blocks in one pass over the heap (deferred coalescing).
+static void coalesce_heap(void) {
+#if MM_COALESCE == MM_COALESCE_DEFERRED
+    deferred_bytes = 0;                           // Everything freed so far gets merged now
+#endif
+    compact_cursor = NULL;                        // Merging may swallow the cursor's block
+    size_t* epilogue = heap_epilogue();           // Epilogue is marked allocated, so runs stop there
+    for (size_t* header = heap_first_block(); header < epilogue; ) {
+        size_t block_size = *header & ~3;          // Get current block size
+        if ((*header & 1) == 0) {                  // Start of a run of free blocks
+            size_t merged_size = block_size;
+            size_t* next_header = header + (block_size / sizeof(size_t));
+            while ((*next_header & 1) == 0) {      // Absorb each free successor
+                remove_from_free_list((Block*)next_header);
+                merged_size += *next_header & ~3;
+                next_header = header + (merged_size / sizeof(size_t));
+            }
+            if (merged_size != block_size) {
+                remove_from_free_list((Block*)header); // Unlink under the old size's class
+                *header = merged_size | (*header & 2); // Keep the previous-allocated flag
+                *(next_header - 1) = merged_size;      // Update merged footer
+                add_to_free_list((Block*)header);      // Relink under the merged size's class
+            }
+            block_size = merged_size;
+        }
+        header += block_size / sizeof(size_t);     // Advance past the (merged) block
     }
 }
 
+/*
+ * mm_search_stats - reports search counters for mdriver
+ */
+size_t mm_search_stats(size_t* searches, size_t* budget_hits) {
+    *searches = search_count;
+    *budget_hits = search_budget_hits;
+    return MM_SEARCH_BUDGET;
+}
+
 /*
  * Returns whether the pointer is in the heap.
  * May be useful for debugging.
@@ -298,11 +772,13 @@ bool mm_checkheap(int line_number)
 {
 #ifdef DEBUG
     // Define valid heap bounds (skip prologue and near epilogue)
-    size_t* heap_low_bound  = (size_t*)mm_heap_lo() + 1;                    
-    size_t* heap_high_bound = (size_t*)((char*)mm_heap_hi() - 7);            
+    size_t* heap_low_bound  = heap_first_block();
+    size_t* heap_high_bound = heap_epilogue();
 
-    // Check header and footer invariants for each free block in the free list
-    for (Block* checker = free_block_pointer; checker != NULL; 
+    // Check header and footer invariants for each free block in every class list,
+    // and mark each footer so the heap scan below tests membership in O(1)
+    for (size_t index = 0; index < MM_NUM_CLASSES; index++)
+    for (Block* checker = free_lists[index]; checker != NULL; 
          checker = checker->next_node) {
         size_t* header_loc = (size_t*)checker;                              // Block header pointer
         size_t header_size = *header_loc & ~3;                                // Extract size from header
@@ -310,28 +786,47 @@ bool mm_checkheap(int line_number)
 
         if (header_loc < heap_low_bound || header_loc >= heap_high_bound)     // Verify header is in bounds
             dbg_printf("header oob");
-        if (footer_loc < heap_low_bound || footer_loc >= heap_high_bound)     // Verify footer is in bounds
+        else if (footer_loc < heap_low_bound || footer_loc >= heap_high_bound) // Verify footer is in bounds
             dbg_printf("footer oob");
+        else
+            *footer_loc |= LISTED_MARK;                                       // Remember it was listed
     }
 
     // Scan the entire heap to ensure all free blocks are in the free list
     for (size_t* begin = heap_low_bound; begin < heap_high_bound; ) {
         Block* blk = (Block*)begin;                                           // Interpret pointer as block
+        size_t block_size = blk->size_node & ~3;                              // Block size, ignoring flag bits
         if ((blk->size_node & 1) == 0) {                                        // If block is free (allocated bit clear)
-            bool in_free_list = false;                                        
-            for (Block* free_iter = free_block_pointer; free_iter != NULL; 
-                 free_iter = free_iter->next_node) {                           // Check each free block in the free list
-                if (begin == (size_t*)free_iter) {                              // Found block in free list
-                    in_free_list = true;
-                    break;
-                }
-            }
-            if (!in_free_list)                                                // Warn if free block is missing from free list
+            size_t* footer_loc = begin + (block_size / sizeof(size_t)) - 1;
+            if ((*footer_loc & LISTED_MARK) == 0)                             // Warn if free block is missing from free list
                 dbg_printf("Free block not in free list at: %p\n", begin);
+            *footer_loc &= ~(size_t)LISTED_MARK;                              // Restore the footer
         }
-        // Advance to next block using the current block's size (ignoring flag bits)
-        size_t block_size = blk->size_node & ~3;                              
-        begin += block_size / sizeof(size_t);
+#if MM_GUARD_SAMPLE > 0
+        else if (guard_find((char*)(begin + 1) + GUARD_PREFIX)) {             // Guarded allocation: check its canary and redzone
+            guard_check((char*)(begin + 1) + GUARD_PREFIX);
+        }
+#endif
+        begin += block_size / sizeof(size_t);                                 // Advance to next block
+    }
+
+    // A mark that survived the scan belongs to a listed block the heap walk never reached
+    for (size_t index = 0; index < MM_NUM_CLASSES; index++)
+    for (Block* checker = free_lists[index]; checker != NULL; 
+         checker = checker->next_node) {
+        size_t* header_loc = (size_t*)checker;
+        size_t* footer_loc = header_loc + ((*header_loc & ~3) / sizeof(size_t)) - 1;
+        if (header_loc < heap_low_bound || footer_loc >= heap_high_bound) continue; // Already reported
+        if (*footer_loc & LISTED_MARK) {
+            dbg_printf("Free-list block not in heap at: %p\n", header_loc);
+            *footer_loc &= ~(size_t)LISTED_MARK;
+        }
+    }
+
+    // Every live handle must point at a block whose back-reference names its slot
+    for (size_t slot = 0; slot < handle_capacity; slot++) {
+        if (((size_t)handle_table[slot] & 1) == 0 && *handle_backref(handle_table[slot]) != slot)
+            dbg_printf("Handle %zu back-reference mismatch at: %p\n", slot + 1, handle_table[slot]);
     }
 #endif // DEBUG
     return true;
@@ -21,5 +21,31 @@ extern void* calloc (size_t nmemb, size_t size);
 
 extern bool mm_init(void);
 
+/*
+ * Relocatable allocations. Callers hold a handle and look up the current
+ * payload address with mm_hderef; the address may change after any call
+ * to mm_compact_step, mm_halloc or mm_hrealloc, which compact before they
+ * grow the heap. Handle 0 is never returned for a live allocation.
+ */
+typedef size_t mm_handle_t;
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t handle);
+/* Resizes *handle's block; a null *handle is allocated like mm_halloc and
+   size 0 frees the block and sets *handle to 0. Returns false on failure,
+   leaving the block and *handle untouched. */
+extern bool mm_hrealloc(mm_handle_t* handle, size_t size);
+extern void* mm_hderef(mm_handle_t handle);
+
+/* Slides handle-owned blocks down into free space, doing at most budget
+   bytes of work per call: bytes copied plus one word per block visited.
+   Blocks larger than the budget are never moved. Returns the number of
+   bytes moved. */
+extern size_t mm_compact_step(size_t budget);
+
+/* Returns MM_SEARCH_BUDGET and, since the last mm_init, how many free-list
+   searches ran and how many of them ran out of budget */
+extern size_t mm_search_stats(size_t* searches, size_t* budget_hits);
+
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int line_number);
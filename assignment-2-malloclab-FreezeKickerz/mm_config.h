@@ -0,0 +1,121 @@
+#ifndef MM_CONFIG_H
+#define MM_CONFIG_H
+
+/*
+ * mm_config.h - compile-time policy knobs for mm.c
+ *
+ * Every knob below has a default that reproduces the stock allocator and
+ * can be overridden on the compiler command line, e.g.
+ *
+ *     -DMM_FIT_POLICY=MM_FIT_BEST -DMM_GROW_CHUNK=4096
+ *
+ * `make variants` builds one specialized mdriver per entry of the
+ * VARIANTS matrix in the Makefile and prints a comparison table.
+ */
+
+#include <stdint.h>
+
+/* Payload alignment in bytes (a multiple of 16 so mdriver's check passes) */
+#ifndef MM_ALIGNMENT
+#define MM_ALIGNMENT 16
+#endif
+
+/* Smallest block (header, free-list links and footer) that may be split off */
+#ifndef MM_MIN_BLOCK
+#define MM_MIN_BLOCK (MM_ALIGNMENT > 32 ? MM_ALIGNMENT : 32)
+#endif
+
+/* Size of the free block created by mm_init */
+#ifndef MM_INIT_HEAP
+#define MM_INIT_HEAP 4096
+#endif
+
+/* Minimum heap extension in bytes; 0 grows the heap by exactly the request */
+#ifndef MM_GROW_CHUNK
+#define MM_GROW_CHUNK 0
+#endif
+
+/* Fit policies */
+#define MM_FIT_FIRST 0 // first block in the free list that fits
+#define MM_FIT_BEST  1 // smallest fitting block of the first class that has one
+
+#ifndef MM_FIT_POLICY
+#define MM_FIT_POLICY MM_FIT_FIRST
+#endif
+
+/*
+ * Most free blocks one search may examine. When the budget runs out the
+ * search takes the head of the next non-empty larger class, where every
+ * block fits, or lets malloc grow the heap; 0 means no limit.
+ */
+#ifndef MM_SEARCH_BUDGET
+#define MM_SEARCH_BUDGET 0
+#endif
+
+/*
+ * Most compaction work (see mm_compact_step) an mm_halloc or mm_hrealloc may
+ * do when no free block fits, before it grows the heap; 0 grows at once.
+ */
+#ifndef MM_GROW_COMPACT
+#define MM_GROW_COMPACT 1048576
+#endif
+
+/*
+ * Guard mode. One in MM_GUARD_SAMPLE malloc/realloc requests gets a canary
+ * word in front of the payload and at least MM_GUARD_REDZONE bytes of
+ * poison after it; both are checked when the block is freed and by
+ * mm_checkheap. 0 turns guard mode off.
+ */
+#ifndef MM_GUARD_SAMPLE
+#define MM_GUARD_SAMPLE 0
+#endif
+
+#ifndef MM_GUARD_REDZONE
+#define MM_GUARD_REDZONE 16
+#endif
+
+/* Coalescing modes */
+#define MM_COALESCE_IMMEDIATE 0 // merge with free neighbours on every free
+#define MM_COALESCE_DEFERRED  1 // merge the whole heap in one pass when a search fails
+
+#ifndef MM_COALESCE
+#define MM_COALESCE MM_COALESCE_IMMEDIATE
+#endif
+
+/*
+ * Segregated size classes. MM_CLASS_TABLE lists the exclusive upper bound
+ * of each class's block size in increasing order and must end in SIZE_MAX;
+ * MM_NUM_CLASSES is its length. Each class costs one 8-byte list head of
+ * global memory, so keep the table short.
+ */
+#ifndef MM_CLASS_TABLE
+#undef MM_NUM_CLASSES
+#define MM_NUM_CLASSES 1
+#define MM_CLASS_TABLE SIZE_MAX
+#endif
+
+#if MM_ALIGNMENT % 16 != 0
+#error "MM_ALIGNMENT must be a multiple of 16"
+#endif
+
+#if MM_MIN_BLOCK < 32 || MM_MIN_BLOCK % MM_ALIGNMENT != 0
+#error "MM_MIN_BLOCK must be at least 32 and a multiple of MM_ALIGNMENT"
+#endif
+
+#if MM_INIT_HEAP < MM_MIN_BLOCK || MM_INIT_HEAP % MM_ALIGNMENT != 0
+#error "MM_INIT_HEAP must hold a minimum block and be a multiple of MM_ALIGNMENT"
+#endif
+
+#if MM_GROW_CHUNK % MM_ALIGNMENT != 0
+#error "MM_GROW_CHUNK must be a multiple of MM_ALIGNMENT"
+#endif
+
+#if MM_GUARD_REDZONE < 1
+#error "MM_GUARD_REDZONE must be at least 1"
+#endif
+
+#if MM_NUM_CLASSES < 1
+#error "MM_NUM_CLASSES must be at least 1"
+#endif
+
+#endif // MM_CONFIG_H
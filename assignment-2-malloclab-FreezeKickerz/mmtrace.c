@@ -0,0 +1,405 @@
+/*
+ * mmtrace.c - LD_PRELOAD shim that records a program's allocation stream
+ * as an mdriver trace.
+ *
+ *     make mmtrace.so
+ *     LD_PRELOAD=./mmtrace.so MMTRACE_FILE=app.rep ./app
+ *     ./mdriver -f app.rep
+ *
+ * Without MMTRACE_FILE the trace goes to mmtrace.<pid>.rep; a "%p" in
+ * MMTRACE_FILE is replaced by the pid, which keeps child processes from
+ * overwriting each other's traces.
+ *
+ * The hooks take no locks. Each thread appends fixed-size records to its
+ * own mmap'd chunk, and a chunk is published once, when it is created, by
+ * a CAS push onto a global list. The only shared write on the hot path is
+ * the fetch-add that hands out the global sequence number. Allocations are
+ * numbered after the real call returns and frees before it runs, so a block
+ * is always born before it dies in the merged order.
+ *
+ * At exit the records are put back in sequence order, addresses are renamed
+ * to block ids and the .rep file is written. Frees of blocks we never saw
+ * (allocated before the shim loaded) are dropped. An address handed out
+ * again before its free was recorded (only possible when realloc races with
+ * another thread) gets an implicit free.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+#define CHUNK_RECORDS  (1 << 16)  /* records per thread chunk */
+#define BOOTSTRAP_SIZE 4096       /* static arena for dlsym's own allocations */
+#define MAXPATH        1024       /* longest output file name */
+
+enum { OP_NONE, OP_ALLOC, OP_REALLOC, OP_FREE };
+
+/* One intercepted call */
+typedef struct {
+    uint64_t seq;     /* position in the global order */
+    uintptr_t ptr;    /* block returned (alloc/realloc) or released (free) */
+    uintptr_t old;    /* realloc's argument */
+    size_t size;      /* requested bytes */
+    int op;           /* OP_*; OP_NONE marks an unused slot */
+} record_t;
+
+/* Per-thread append buffer; only its owner writes records and count */
+typedef struct chunk {
+    struct chunk *next;       /* all chunks, newest first */
+    _Atomic size_t count;     /* records published by the owner */
+    record_t records[CHUNK_RECORDS];
+} chunk_t;
+
+/* Block id assignment at flush time, keyed by address */
+typedef struct {
+    uintptr_t ptr;    /* 0 marks an empty slot */
+    int id;
+    size_t size;
+} live_t;
+
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_calloc)(size_t, size_t);
+
+static _Atomic uint64_t next_seq;
+static _Atomic(chunk_t *) chunks;
+static atomic_bool stopped;       /* set once flushing starts */
+static atomic_bool resolving;     /* set while dlsym runs */
+
+static __thread chunk_t *current_chunk __attribute__((tls_model("initial-exec")));
+
+static char bootstrap_arena[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static atomic_size_t bootstrap_used;
+
+/*
+ * resolve - look up the next malloc family in the link chain
+ */
+static void resolve(void)
+{
+    atomic_store(&resolving, true);
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    atomic_store(&resolving, false);
+    if (!real_malloc || !real_free || !real_realloc || !real_calloc) {
+        fprintf(stderr, "mmtrace: cannot find the real allocator\n");
+        _exit(1);
+    }
+}
+
+/*
+ * bootstrap_alloc - serve dlsym's allocations before the real malloc is known;
+ * other threads that call malloc while it resolves share the arena, so the
+ * bump pointer moves with a fetch-add
+ */
+static void *bootstrap_alloc(size_t size)
+{
+    if (size > BOOTSTRAP_SIZE)
+        return NULL;
+    size = (size + 15) & ~(size_t)15;
+    size_t offset = atomic_fetch_add_explicit(&bootstrap_used, size,
+                                              memory_order_relaxed);
+    if (offset + size > BOOTSTRAP_SIZE)
+        return NULL;
+    return bootstrap_arena + offset;
+}
+
+static bool is_bootstrap(void *ptr)
+{
+    return (char *)ptr >= bootstrap_arena &&
+        (char *)ptr < bootstrap_arena + BOOTSTRAP_SIZE;
+}
+
+/*
+ * new_chunk - give the calling thread a fresh buffer and publish it
+ */
+static chunk_t *new_chunk(void)
+{
+    chunk_t *chunk = mmap(NULL, sizeof(chunk_t), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == MAP_FAILED)
+        return NULL;
+    chunk->next = atomic_load_explicit(&chunks, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&chunks, &chunk->next, chunk,
+                                                  memory_order_release,
+                                                  memory_order_relaxed))
+        ;
+    current_chunk = chunk;
+    return chunk;
+}
+
+/*
+ * record - append one call to the calling thread's chunk
+ */
+static void record(int op, void *ptr, void *old, size_t size)
+{
+    if (atomic_load_explicit(&stopped, memory_order_relaxed))
+        return;
+    chunk_t *chunk = current_chunk;
+    size_t count = chunk ? atomic_load_explicit(&chunk->count, memory_order_relaxed) : 0;
+    if (!chunk || count == CHUNK_RECORDS) {
+        if ((chunk = new_chunk()) == NULL)
+            return;
+        count = 0;
+    }
+    record_t *r = &chunk->records[count];
+    r->seq = atomic_fetch_add_explicit(&next_seq, 1, memory_order_relaxed);
+    r->ptr = (uintptr_t)ptr;
+    r->old = (uintptr_t)old;
+    r->size = size;
+    r->op = op;
+    atomic_store_explicit(&chunk->count, count + 1, memory_order_release);
+}
+
+void *malloc(size_t size)
+{
+    if (!real_malloc) {
+        if (atomic_load(&resolving))
+            return bootstrap_alloc(size);
+        resolve();
+    }
+    void *ptr = real_malloc(size);
+    if (ptr)
+        record(OP_ALLOC, ptr, NULL, size);
+    return ptr;
+}
+
+void free(void *ptr)
+{
+    if (!ptr || is_bootstrap(ptr))
+        return;
+    if (!real_free)
+        resolve();
+    record(OP_FREE, ptr, NULL, 0);
+    real_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (!real_realloc) {
+        if (atomic_load(&resolving))
+            return bootstrap_alloc(size);
+        resolve();
+    }
+    if (is_bootstrap(ptr)) {       /* never hand a bootstrap block to libc */
+        void *copy = real_malloc(size);
+        if (copy) {
+            size_t avail = (size_t)(bootstrap_arena + BOOTSTRAP_SIZE - (char *)ptr);
+            memcpy(copy, ptr, size < avail ? size : avail);
+            record(OP_ALLOC, copy, NULL, size);
+        }
+        return copy;
+    }
+    void *newptr = real_realloc(ptr, size);
+    if (newptr || size == 0)
+        record(OP_REALLOC, newptr, ptr, size);
+    return newptr;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (size && nmemb > SIZE_MAX / size) {  /* nmemb * size would wrap */
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!real_calloc) {
+        if (atomic_load(&resolving)) {
+            void *ptr = bootstrap_alloc(nmemb * size);
+            if (ptr)
+                memset(ptr, 0, nmemb * size);
+            return ptr;
+        }
+        resolve();
+    }
+    void *ptr = real_calloc(nmemb, size);
+    if (ptr)
+        record(OP_ALLOC, ptr, NULL, nmemb * size);
+    return ptr;
+}
+
+/********************
+ * Flushing to .rep
+ ********************/
+
+static void *map_zeroed(size_t bytes)
+{
+    void *p = mmap(NULL, bytes ? bytes : 1, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static size_t live_hash(uintptr_t ptr, size_t mask)
+{
+    return (size_t)((ptr >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+}
+
+static live_t *live_find(live_t *table, size_t mask, uintptr_t ptr)
+{
+    size_t i = live_hash(ptr, mask);
+    while (table[i].ptr && table[i].ptr != ptr)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+/* Linear-probing delete: shift later members of the cluster back into the hole */
+static void live_remove(live_t *table, size_t mask, live_t *slot)
+{
+    size_t hole = (size_t)(slot - table);
+    size_t i = hole;
+    table[hole].ptr = 0;
+    for (;;) {
+        i = (i + 1) & mask;
+        if (!table[i].ptr)
+            return;
+        size_t home = live_hash(table[i].ptr, mask);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table[hole] = table[i];
+            table[i].ptr = 0;
+            hole = i;
+        }
+    }
+}
+
+/* One line of the output trace */
+typedef struct {
+    char type;
+    int id;
+    size_t size;
+} line_t;
+
+__attribute__((destructor))
+static void mmtrace_flush(void)
+{
+    atomic_store(&stopped, true);
+
+    size_t n = (size_t)atomic_load(&next_seq);
+    if (n == 0)
+        return;
+
+    /* Merge the per-thread chunks into sequence order */
+    record_t *ordered = map_zeroed(n * sizeof(record_t));
+    size_t capacity = 16;
+    while (capacity < 2 * n)
+        capacity <<= 1;
+    live_t *live = map_zeroed(capacity * sizeof(live_t));
+    line_t *lines = map_zeroed(2 * n * sizeof(line_t));
+    if (!ordered || !live || !lines) {
+        fprintf(stderr, "mmtrace: out of memory while flushing\n");
+        return;
+    }
+    for (chunk_t *c = atomic_load_explicit(&chunks, memory_order_acquire); c; c = c->next) {
+        size_t count = atomic_load_explicit(&c->count, memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+            if (c->records[i].seq < n)
+                ordered[c->records[i].seq] = c->records[i];
+    }
+
+    /* Rename addresses to ids */
+    size_t mask = capacity - 1;
+    size_t nlines = 0, dropped = 0;
+    size_t live_bytes = 0, peak_bytes = 0;
+    int num_ids = 0;
+    for (size_t s = 0; s < n; s++) {
+        record_t *r = &ordered[s];
+        live_t *slot;
+        int id;
+
+        if (r->op == OP_REALLOC && r->old == 0)
+            r->op = OP_ALLOC;                    /* realloc(NULL, n) */
+        if (r->op == OP_REALLOC && r->ptr == 0) {
+            r->op = OP_FREE;                     /* realloc(p, 0) */
+            r->ptr = r->old;
+        }
+
+        switch (r->op) {
+        case OP_FREE:
+            slot = live_find(live, mask, r->ptr);
+            if (!slot->ptr) {
+                dropped++;
+                break;
+            }
+            lines[nlines++] = (line_t){ 'f', slot->id, 0 };
+            live_bytes -= slot->size;
+            live_remove(live, mask, slot);
+            break;
+
+        case OP_REALLOC:
+            slot = live_find(live, mask, r->old);
+            if (!slot->ptr) {                    /* unknown block: treat as fresh */
+                r->op = OP_ALLOC;
+                goto alloc;
+            }
+            id = slot->id;
+            live_bytes -= slot->size;
+            live_remove(live, mask, slot);
+            slot = live_find(live, mask, r->ptr);
+            if (slot->ptr) {                     /* missed free of the new address */
+                lines[nlines++] = (line_t){ 'f', slot->id, 0 };
+                live_bytes -= slot->size;
+                live_remove(live, mask, slot);
+                slot = live_find(live, mask, r->ptr);
+            }
+            *slot = (live_t){ r->ptr, id, r->size };
+            lines[nlines++] = (line_t){ 'r', id, r->size };
+            live_bytes += r->size;
+            break;
+
+        case OP_ALLOC:
+        alloc:
+            slot = live_find(live, mask, r->ptr);
+            if (slot->ptr) {                     /* missed free of this address */
+                lines[nlines++] = (line_t){ 'f', slot->id, 0 };
+                live_bytes -= slot->size;
+                live_remove(live, mask, slot);
+                slot = live_find(live, mask, r->ptr);
+            }
+            *slot = (live_t){ r->ptr, num_ids, r->size };
+            lines[nlines++] = (line_t){ 'a', num_ids++, r->size };
+            live_bytes += r->size;
+            break;
+
+        default:                                 /* sequence number taken, record never finished */
+            break;
+        }
+        peak_bytes = live_bytes > peak_bytes ? live_bytes : peak_bytes;
+    }
+
+    if (num_ids == 0)
+        return;
+
+    char path[MAXPATH];
+    const char *pattern = getenv("MMTRACE_FILE");
+    const char *pid_mark = pattern ? strstr(pattern, "%p") : NULL;
+    if (!pattern)
+        snprintf(path, sizeof(path), "mmtrace.%d.rep", (int)getpid());
+    else if (pid_mark)                           /* one file per process */
+        snprintf(path, sizeof(path), "%.*s%d%s", (int)(pid_mark - pattern),
+                 pattern, (int)getpid(), pid_mark + 2);
+    else
+        snprintf(path, sizeof(path), "%s", pattern);
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("mmtrace: fopen");
+        return;
+    }
+    fprintf(out, "1\n%d\n%zu\n%zu\n", num_ids, nlines, peak_bytes);
+    for (size_t i = 0; i < nlines; i++) {
+        if (lines[i].type == 'f')
+            fprintf(out, "f %d\n", lines[i].id);
+        else
+            fprintf(out, "%c %d %zu\n", lines[i].type, lines[i].id, lines[i].size);
+    }
+    fclose(out);
+    fprintf(stderr, "mmtrace: wrote %zu ops (%d ids) to %s, dropped %zu unmatched frees\n",
+            nlines, num_ids, path, dropped);
+}
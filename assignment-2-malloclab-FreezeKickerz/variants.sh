@@ -0,0 +1,25 @@
+#!/bin/bash
+#
+# variants.sh - run each specialized mdriver built by `make variants`
+# and print one comparison row per variant.
+#
+# Usage: ./variants.sh NAME...   (runs ./mdriver-NAME for every NAME)
+#        MDRIVER_ARGS="-f traces/ngram-moby1.rep" ./variants.sh base best
+
+printf "%-12s %10s %12s %10s\n" "variant" "util" "Kops/sec" "fallback"
+printf "%-12s %10s %12s %10s\n" "-------" "----" "--------" "--------"
+for name in "$@"
+do
+    output=$(./mdriver-"$name" -v 1 $MDRIVER_ARGS 2> /dev/null)
+    summary=$(echo "$output" | grep "Average utilization" | head -n 1)
+    if [ -z "$summary" ]
+    then
+        printf "%-12s %10s %12s %10s\n" "$name" "FAILED" "-" "-"
+        continue
+    fi
+    util=$(echo "$summary" | sed -e 's/.*utilization = \([0-9.]*%\).*/\1/')
+    tput=$(echo "$summary" | sed -e 's/.*throughput = \([0-9]*\) Kops.*/\1/')
+    # Share of searches that hit MM_SEARCH_BUDGET ("-" when unbounded)
+    fallback=$(echo "$output" | grep "fell back" | sed -e 's/.*(\([0-9.]*%\)).*/\1/')
+    printf "%-12s %10s %12s %10s\n" "$name" "$util" "$tput" "${fallback:--}"
+done
@@ -0,0 +1,979 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "channel.h"
+#include "pool.h"
+#include "broadcast.h"
+#include "stress.h"
+#include "stress_send_recv.h"
+
+// Channel throughput and latency benchmarks
+// Usage: ./channel_bench [duration_ms] [benchmark...]
+// Runs every benchmark unless some are named (send_recv, batch, pc, handoff, select, select_fairness, converge,
+// converge_sweep, typed, pool, broadcast, floyd, ring)
+// and prints one CSV row per configuration; columns that do not apply to a benchmark are left empty.
+// Compare the output of two builds on the same machine to catch regressions.
+
+static const size_t buffer_sizes[] = {1, 16, 256};
+static const size_t thread_counts[] = {1, 2, 4, 8, 16};
+static const size_t batch_sizes[] = {1, 8, 64};
+static const size_t pc_capacities[] = {0, 1, 4, 16, 64, 256, 1024, 4096};
+static const size_t pc_threads[][2] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}, {16, 16}};
+static const size_t handoff_threads[][2] = {{1, 100}, {100, 1}, {100, 100}};
+static const size_t select_channel_counts[] = {2, 4, 16, 64, 256};
+static const size_t broadcast_subscribers[] = {1, 4, 16, 64};
+static const size_t floyd_sizes[] = {256, 1024, 2048, 4096};
+static const size_t ring_members[] = {100, 1000, 10000, 100000};
+static const size_t sweep_capacities[] = {0, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+static const char* const sweep_topologies[] = {"topology.txt", "connected_topology.txt", "random_topology.txt",
+                                               "random_topology_1.txt", "big_graph.txt", "big_graph_edges.txt"};
+
+static const enum select_mode select_modes[] = {SELECT_FIRST, SELECT_ROUND_ROBIN, SELECT_RANDOM, SELECT_WEIGHTED};
+static const char* const select_mode_names[] = {"first", "round_robin", "random", "weighted"};
+
+#define BATCH_MSGS 2000000
+#define FAIR_CHANNELS 8
+#define FAIR_CAPACITY 16
+#define FAIR_MSGS 200000
+#define CONVERGE_GRAPH "big_graph.txt"
+#define CONVERGE_RUNS 3
+#define CONVERGE_SPARSE_NODES 500
+#define SELECT_CAPACITY 16
+#define SELECT_PRODUCERS 4
+#define TYPED_MSGS 1000000
+#define TYPED_CAPACITY 256
+#define POOL_TASKS 1048576 // a multiple of POOL_FUTURE_BATCH
+#define POOL_THREAD_TASKS 20000
+#define POOL_SPAWN_DEPTH 20
+#define POOL_FUTURE_BATCH 1024
+#define BROADCAST_MSGS 100000
+#define BROADCAST_CAPACITY 256
+#define FLOYD_REFERENCE_MAX 1024 // the textbook solver takes minutes beyond this
+#define RING_THREAD_MAX 1000     // a thread per member runs into process limits beyond this
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Latency histogram with 32 linear sub-buckets per power of two, so every
+ * recorded value is kept to within about 3% in a fixed 15 KB per thread.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t count[HIST_BUCKETS];
+    uint64_t total;
+} hist_t;
+
+static size_t hist_bucket(uint64_t ns)
+{
+    if (ns < HIST_SUB) return (size_t)ns;
+    unsigned int exp = 63u - (unsigned int)__builtin_clzll(ns);
+    return ((size_t)(exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + (size_t)((ns >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// Smallest value that falls in the given bucket
+static uint64_t hist_bucket_value(size_t bucket)
+{
+    if (bucket < HIST_SUB) return bucket;
+    unsigned int exp = (unsigned int)(bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    return (uint64_t)(HIST_SUB + (bucket & (HIST_SUB - 1))) << (exp - HIST_SUB_BITS);
+}
+
+static void hist_record(hist_t* hist, uint64_t ns)
+{
+    hist->count[hist_bucket(ns)]++;
+    hist->total++;
+}
+
+static void hist_merge(hist_t* into, const hist_t* from)
+{
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        into->count[i] += from->count[i];
+    }
+    into->total += from->total;
+}
+
+// Returns the value at or below which percent of the samples fall, or NAN without samples
+static double hist_percentile(const hist_t* hist, uint64_t percent)
+{
+    if (hist->total == 0) return NAN;
+    uint64_t rank = (hist->total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->count[i];
+        if (seen >= rank && hist->count[i] > 0) return (double)hist_bucket_value(i);
+    }
+    return NAN;
+}
+
+/*
+ * One CSV row. Numeric fields hold NAN when they do not apply and are
+ * printed empty; msgs_per_sec is derived from msgs and seconds.
+ */
+typedef struct {
+    const char* bench;
+    const char* mode;
+    double capacity;
+    double producers;
+    double consumers;
+    double channels;
+    double msgs;
+    double seconds;
+    double p50_ns;
+    double p99_ns;
+    double fairness;
+    double bytes;
+} row_t;
+
+#define ROW(bench_name, mode_name) \
+    ((row_t){bench_name, mode_name, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN})
+
+static void print_field(double value, int decimals)
+{
+    if (isnan(value)) printf(",");
+    else              printf(",%.*f", decimals, value);
+}
+
+static void print_header(void)
+{
+    printf("bench,mode,capacity,producers,consumers,channels,msgs,msgs_per_sec,p50_ns,p99_ns,seconds,fairness,bytes\n");
+}
+
+static void print_row(const row_t* row)
+{
+    printf("%s,%s", row->bench, row->mode);
+    print_field(row->capacity, 0);
+    print_field(row->producers, 0);
+    print_field(row->consumers, 0);
+    print_field(row->channels, 0);
+    print_field(row->msgs, 0);
+    print_field(row->seconds > 0 ? row->msgs / row->seconds : NAN, 0);
+    print_field(row->p50_ns, 0);
+    print_field(row->p99_ns, 0);
+    print_field(row->seconds, 3);
+    print_field(row->fairness, 3);
+    print_field(row->bytes, 0);
+    printf("\n");
+    fflush(stdout);
+}
+
+static void set_latency(row_t* row, const hist_t* hist)
+{
+    row->p50_ns = hist_percentile(hist, 50);
+    row->p99_ns = hist_percentile(hist, 99);
+}
+
+// Ring of worker threads from run_stress_send_recv: every hop is one send and one receive
+static void bench_send_recv(useconds_t duration_usec)
+{
+    for (size_t spsc = 0; spsc <= 1; spsc++) {
+        for (size_t b = 0; b < ARRAY_SIZE(buffer_sizes); b++) {
+            for (size_t t = 0; t < ARRAY_SIZE(thread_counts); t++) {
+                double start = now_sec();
+                size_t hops = spsc ? run_stress_send_recv_spsc(buffer_sizes[b], thread_counts[t], 0.5, duration_usec)
+                                   : run_stress_send_recv(buffer_sizes[b], thread_counts[t], 0.5, duration_usec);
+                row_t row = ROW("send_recv", spsc ? "spsc" : "mpmc");
+                row.capacity = (double)buffer_sizes[b];
+                row.producers = row.consumers = row.channels = (double)thread_counts[t];
+                row.msgs = (double)hops;
+                row.seconds = now_sec() - start;
+                print_row(&row);
+            }
+        }
+    }
+}
+
+typedef struct {
+    channel_t* channel;
+    size_t batch;
+} batch_args_t;
+
+static void* batch_producer(void* arg)
+{
+    batch_args_t* args = arg;
+    void* items[64];
+    for (size_t i = 0; i < args->batch; i++) {
+        items[i] = (void*)(i + 1);
+    }
+    for (size_t sent = 0; sent < BATCH_MSGS; sent += args->batch) {
+        if (args->batch == 1) {
+            channel_send(args->channel, items[0]);
+        } else {
+            channel_send_batch(args->channel, items, args->batch);
+        }
+    }
+    return NULL;
+}
+
+// One producer and one consumer moving BATCH_MSGS pointers with channel_send_batch/channel_receive_batch
+static void bench_batch(void)
+{
+    for (size_t b = 0; b < ARRAY_SIZE(batch_sizes); b++) {
+        batch_args_t args = {channel_create(256), batch_sizes[b]};
+        double start = now_sec();
+        pthread_t producer;
+        pthread_create(&producer, NULL, batch_producer, &args);
+        void* out[64];
+        size_t received = 0;
+        while (received < BATCH_MSGS) {
+            size_t got = 1;
+            if (args.batch == 1) {
+                channel_receive(args.channel, &out[0]);
+            } else {
+                channel_receive_batch(args.channel, out, args.batch, &got);
+            }
+            received += got;
+        }
+        pthread_join(producer, NULL);
+        char mode[16];
+        snprintf(mode, sizeof(mode), "batch%zu", args.batch);
+        row_t row = ROW("batch", mode);
+        row.capacity = 256;
+        row.producers = row.consumers = row.channels = 1;
+        row.msgs = BATCH_MSGS;
+        row.seconds = now_sec() - start;
+        print_row(&row);
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+    }
+}
+
+/*
+ * Producers send their send time (in ns since the run started, plus one so
+ * it is never NULL) as the message; consumers record the send-to-receive
+ * latency in a histogram of their own. A run lasts duration_usec, then the
+ * producers stop, the channels are closed and the consumers exit.
+ */
+typedef struct {
+    channel_t** channels;   // channels this thread uses, in turn
+    size_t num_channels;
+    atomic_bool* stop;
+    uint64_t epoch;
+    size_t msgs;            // consumer: messages received
+    hist_t hist;            // consumer: latencies
+} load_args_t;
+
+static void* load_producer(void* arg)
+{
+    load_args_t* args = arg;
+    size_t next = 0;
+    while (!atomic_load_explicit(args->stop, memory_order_relaxed)) {
+        void* stamp = (void*)(uintptr_t)(now_ns() - args->epoch + 1);
+        if (channel_send(args->channels[next], stamp) != SUCCESS) break;
+        next = next + 1 < args->num_channels ? next + 1 : 0;
+    }
+    return NULL;
+}
+
+static void* load_consumer(void* arg)
+{
+    load_args_t* args = arg;
+    void* data;
+    while (channel_receive(args->channels[0], &data) == SUCCESS) {
+        hist_record(&args->hist, now_ns() - args->epoch - ((uint64_t)(uintptr_t)data - 1));
+        args->msgs++;
+    }
+    return NULL;
+}
+
+// Consumer that takes every message with channel_select across all of its channels
+static void* select_consumer(void* arg)
+{
+    load_args_t* args = arg;
+    select_t* list = malloc(sizeof(select_t) * args->num_channels);
+    for (size_t i = 0; i < args->num_channels; i++) {
+        list[i] = (select_t){args->channels[i], RECV, NULL};
+    }
+    size_t index;
+    while (channel_select(list, args->num_channels, &index) == SUCCESS) {
+        hist_record(&args->hist, now_ns() - args->epoch - ((uint64_t)(uintptr_t)list[index].data - 1));
+        args->msgs++;
+    }
+    free(list);
+    return NULL;
+}
+
+// Runs producers against consumers for duration_usec and fills in msgs, seconds and latency
+// Producer i sends to channels i, i + producers, ... in turn; consumer i receives from channel i,
+// or from all channels through channel_select when use_select is set (with a single consumer)
+static void run_load(row_t* row, channel_t** channels, size_t num_channels, size_t producers, size_t consumers,
+                     bool use_select, useconds_t duration_usec)
+{
+    atomic_bool stop;
+    atomic_init(&stop, false);
+    uint64_t epoch = now_ns();
+    load_args_t* args = calloc(producers + consumers, sizeof(load_args_t));
+    channel_t** lists = malloc(sizeof(channel_t*) * (num_channels + producers));
+    pthread_t* threads = malloc(sizeof(pthread_t) * (producers + consumers));
+    channel_t** next_list = lists;
+    for (size_t p = 0; p < producers; p++) {
+        load_args_t* a = &args[p];
+        a->channels = next_list;
+        for (size_t c = p % num_channels; c < num_channels; c += producers) {
+            a->channels[a->num_channels++] = channels[c];
+        }
+        if (a->num_channels == 0) {
+            a->channels[a->num_channels++] = channels[p % num_channels];
+        }
+        next_list += a->num_channels;
+        a->stop = &stop;
+        a->epoch = epoch;
+    }
+    for (size_t c = 0; c < consumers; c++) {
+        load_args_t* a = &args[producers + c];
+        a->channels = use_select ? channels : &channels[c % num_channels];
+        a->num_channels = use_select ? num_channels : 1;
+        a->stop = &stop;
+        a->epoch = epoch;
+        pthread_create(&threads[producers + c], NULL, use_select ? select_consumer : load_consumer, a);
+    }
+    double start = now_sec();
+    for (size_t p = 0; p < producers; p++) {
+        pthread_create(&threads[p], NULL, load_producer, &args[p]);
+    }
+    usleep(duration_usec);
+    atomic_store(&stop, true);
+    for (size_t p = 0; p < producers; p++) {
+        pthread_join(threads[p], NULL);
+    }
+    row->seconds = now_sec() - start;
+    for (size_t i = 0; i < num_channels; i++) {
+        channel_close(channels[i]);
+    }
+    hist_t* hist = calloc(1, sizeof(hist_t));
+    size_t msgs = 0;
+    for (size_t c = 0; c < consumers; c++) {
+        pthread_join(threads[producers + c], NULL);
+        msgs += args[producers + c].msgs;
+        hist_merge(hist, &args[producers + c].hist);
+    }
+    row->msgs = (double)msgs;
+    set_latency(row, hist);
+    free(hist);
+    free(threads);
+    free(lists);
+    free(args);
+}
+
+// Producers and consumers sharing one channel, buffered and unbuffered
+static void bench_pc(useconds_t duration_usec)
+{
+    for (size_t c = 0; c < ARRAY_SIZE(pc_capacities); c++) {
+        for (size_t t = 0; t < ARRAY_SIZE(pc_threads); t++) {
+            channel_t* channel = channel_create(pc_capacities[c]);
+            row_t row = ROW("pc", pc_capacities[c] == 0 ? "unbuffered" : "buffered");
+            row.capacity = (double)pc_capacities[c];
+            row.producers = (double)pc_threads[t][0];
+            row.consumers = (double)pc_threads[t][1];
+            row.channels = 1;
+            run_load(&row, &channel, 1, pc_threads[t][0], pc_threads[t][1], false, duration_usec);
+            print_row(&row);
+            channel_destroy(channel);
+        }
+    }
+}
+
+// One unbuffered channel with 100 threads parked on one side (or both), so every message is a handoff to a waiter
+static void bench_handoff(useconds_t duration_usec)
+{
+    for (size_t t = 0; t < ARRAY_SIZE(handoff_threads); t++) {
+        channel_t* channel = channel_create(0);
+        row_t row = ROW("handoff", "unbuffered");
+        row.capacity = 0;
+        row.producers = (double)handoff_threads[t][0];
+        row.consumers = (double)handoff_threads[t][1];
+        row.channels = 1;
+        run_load(&row, &channel, 1, handoff_threads[t][0], handoff_threads[t][1], false, duration_usec);
+        print_row(&row);
+        channel_destroy(channel);
+    }
+}
+
+// SELECT_PRODUCERS producers spread over n channels and one consumer selecting across all of them
+static void bench_select(useconds_t duration_usec)
+{
+    for (size_t s = 0; s < ARRAY_SIZE(select_channel_counts); s++) {
+        size_t n = select_channel_counts[s];
+        channel_t** channels = malloc(sizeof(channel_t*) * n);
+        for (size_t i = 0; i < n; i++) {
+            channels[i] = channel_create(SELECT_CAPACITY);
+        }
+        row_t row = ROW("select", "first");
+        row.capacity = SELECT_CAPACITY;
+        row.producers = SELECT_PRODUCERS;
+        row.consumers = 1;
+        row.channels = (double)n;
+        run_load(&row, channels, n, SELECT_PRODUCERS, 1, true, duration_usec);
+        print_row(&row);
+        for (size_t i = 0; i < n; i++) {
+            channel_destroy(channels[i]);
+        }
+        free(channels);
+    }
+}
+
+static void* fair_producer(void* arg)
+{
+    channel_t* channel = arg;
+    while (channel_send(channel, channel) == SUCCESS) {
+    }
+    return NULL;
+}
+
+// Jain's fairness index of x[0..n): 1 when all are equal, 1/n when one gets everything
+static double jain_index(const double* x, size_t n)
+{
+    double sum = 0, sum_sq = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += x[i];
+        sum_sq += x[i] * x[i];
+    }
+    return sum_sq > 0 ? sum * sum / ((double)n * sum_sq) : 0;
+}
+
+// FAIR_CHANNELS producers keep their own channel full while one consumer selects FAIR_MSGS messages across all
+// of them; the fairness column is Jain's index over each channel's share (divided by its weight in weighted mode,
+// where channel i has weight i + 1)
+static void bench_select_fairness(void)
+{
+    unsigned int weights[FAIR_CHANNELS];
+    for (size_t i = 0; i < FAIR_CHANNELS; i++) {
+        weights[i] = (unsigned int)(i + 1);
+    }
+    for (size_t m = 0; m < ARRAY_SIZE(select_modes); m++) {
+        channel_t* channels[FAIR_CHANNELS];
+        select_t list[FAIR_CHANNELS];
+        pthread_t producers[FAIR_CHANNELS];
+        size_t counts[FAIR_CHANNELS] = {0};
+        for (size_t i = 0; i < FAIR_CHANNELS; i++) {
+            channels[i] = channel_create(FAIR_CAPACITY);
+            list[i] = (select_t){channels[i], RECV, NULL};
+            pthread_create(&producers[i], NULL, fair_producer, channels[i]);
+        }
+        select_policy_t policy;
+        select_policy_init(&policy, select_modes[m], weights);
+        double start = now_sec();
+        for (size_t n = 0; n < FAIR_MSGS; n++) {
+            size_t index;
+            channel_select_policy(list, FAIR_CHANNELS, &index, &policy);
+            counts[index]++;
+        }
+        double elapsed = now_sec() - start;
+        for (size_t i = 0; i < FAIR_CHANNELS; i++) {
+            channel_close(channels[i]);
+        }
+        double shares[FAIR_CHANNELS];
+        for (size_t i = 0; i < FAIR_CHANNELS; i++) {
+            pthread_join(producers[i], NULL);
+            channel_destroy(channels[i]);
+            shares[i] = (double)counts[i] / (select_modes[m] == SELECT_WEIGHTED ? weights[i] : 1);
+        }
+        row_t row = ROW("select_fairness", select_mode_names[m]);
+        row.capacity = FAIR_CAPACITY;
+        row.producers = row.channels = FAIR_CHANNELS;
+        row.consumers = 1;
+        row.msgs = FAIR_MSGS;
+        row.seconds = elapsed;
+        row.fairness = jain_index(shares, FAIR_CHANNELS);
+        print_row(&row);
+    }
+}
+
+// Writes a sparse graph in the edge-list format to a temporary file: a ring of CONVERGE_SPARSE_NODES routers with
+// one random chord each
+// Returns false if the file could not be written
+static bool write_sparse_graph(char* path)
+{
+    strcpy(path, "/tmp/converge_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+    FILE* file = fdopen(fd, "w");
+    if (!file) {
+        close(fd);
+        return false;
+    }
+    unsigned int seed = CONVERGE_SPARSE_NODES;
+    fprintf(file, "edges %d\n", CONVERGE_SPARSE_NODES);
+    for (int i = 0; i < CONVERGE_SPARSE_NODES; i++) {
+        fprintf(file, "%d %d 1\n", i, (i + 1) % CONVERGE_SPARSE_NODES);
+        fprintf(file, "%d %d %d\n", i, rand_r(&seed) % CONVERGE_SPARSE_NODES, rand_r(&seed) % 9 + 1);
+    }
+    return fclose(file) == 0;
+}
+
+// Distance-vector routing from run_stress with every router using the same select mode, averaged over
+// CONVERGE_RUNS runs, on CONVERGE_GRAPH and on a larger sparse graph. converge rows send whole vectors and
+// converge_delta rows only the entries that changed; msgs counts router-to-router updates, bytes the distance data
+// they carried, channels the routers and seconds the time until the last update was applied
+static void bench_converge(void)
+{
+    char sparse_graph[32];
+    if (!write_sparse_graph(sparse_graph)) {
+        fprintf(stderr, "converge: could not write the sparse graph\n");
+        return;
+    }
+    const char* graphs[] = {CONVERGE_GRAPH, sparse_graph};
+    const double nodes[] = {100, CONVERGE_SPARSE_NODES};
+    for (size_t g = 0; g < ARRAY_SIZE(graphs); g++) {
+        for (size_t v = 0; v < 2; v++) {
+            for (size_t m = 0; m < ARRAY_SIZE(select_modes); m++) {
+                row_t row = ROW(v == 0 ? "converge" : "converge_delta", select_mode_names[m]);
+                row.capacity = 1;
+                row.channels = nodes[g];
+                row.msgs = row.seconds = row.bytes = 0;
+                for (size_t run = 0; run < CONVERGE_RUNS; run++) {
+                    stress_stats_t stats;
+                    run_stress_vectors(1, 1, graphs[g], select_modes[m], v == 0 ? VECTOR_FULL : VECTOR_DELTA, &stats);
+                    row.msgs += (double)stats.messages / CONVERGE_RUNS;
+                    row.bytes += (double)stats.bytes / CONVERGE_RUNS;
+                    row.seconds += stats.seconds / CONVERGE_RUNS;
+                }
+                print_row(&row);
+            }
+        }
+    }
+    unlink(sparse_graph);
+}
+
+// Distance-vector routing from run_stress on every topology file with router channels of capacity 0 to 1024,
+// averaged over CONVERGE_RUNS runs; converge_sweep rows send whole vectors and converge_sweep_delta rows only the
+// entries that changed. Plotting seconds against capacity for each file charts how buffering changes convergence
+static void bench_converge_sweep(void)
+{
+    for (size_t f = 0; f < ARRAY_SIZE(sweep_topologies); f++) {
+        distance_t* matrix;
+        size_t n;
+        if (!load_topology(sweep_topologies[f], &matrix, &n)) {
+            fprintf(stderr, "converge_sweep: could not load %s\n", sweep_topologies[f]);
+            continue;
+        }
+        free(matrix);
+        for (size_t v = 0; v < 2; v++) {
+            for (size_t c = 0; c < ARRAY_SIZE(sweep_capacities); c++) {
+                row_t row = ROW(v == 0 ? "converge_sweep" : "converge_sweep_delta", sweep_topologies[f]);
+                row.capacity = (double)sweep_capacities[c];
+                row.channels = (double)n;
+                row.msgs = row.seconds = row.bytes = 0;
+                for (size_t run = 0; run < CONVERGE_RUNS; run++) {
+                    stress_stats_t stats;
+                    run_stress_vectors(sweep_capacities[c], sweep_capacities[c], sweep_topologies[f], SELECT_FIRST,
+                                       v == 0 ? VECTOR_FULL : VECTOR_DELTA, &stats);
+                    row.msgs += (double)stats.messages / CONVERGE_RUNS;
+                    row.bytes += (double)stats.bytes / CONVERGE_RUNS;
+                    row.seconds += stats.seconds / CONVERGE_RUNS;
+                }
+                print_row(&row);
+            }
+        }
+    }
+}
+
+// A 64-byte message, as a producer would otherwise malloc for every send
+typedef struct {
+    size_t seq;
+    char payload[56];
+} typed_msg_t;
+
+enum typed_mode { TYPED_MALLOC, TYPED_COPY, TYPED_IN_PLACE };
+static const char* const typed_mode_names[] = {"malloc", "copy", "in_place"};
+
+typedef struct {
+    channel_t* channel;
+    enum typed_mode mode;
+} typed_args_t;
+
+static void* typed_producer(void* arg)
+{
+    typed_args_t* args = arg;
+    for (size_t i = 0; i < TYPED_MSGS; i++) {
+        if (args->mode == TYPED_MALLOC) {
+            typed_msg_t* msg = malloc(sizeof(typed_msg_t));
+            msg->seq = i;
+            memset(msg->payload, (int)(i & 0x7f), sizeof(msg->payload));
+            channel_send(args->channel, msg);
+        } else if (args->mode == TYPED_COPY) {
+            typed_msg_t msg;
+            msg.seq = i;
+            memset(msg.payload, (int)(i & 0x7f), sizeof(msg.payload));
+            channel_send_value(args->channel, &msg);
+        } else {
+            channel_slot_t slot;
+            channel_reserve(args->channel, &slot);
+            typed_msg_t* msg = slot.data;
+            msg->seq = i;
+            memset(msg->payload, (int)(i & 0x7f), sizeof(msg->payload));
+            channel_commit(args->channel, &slot);
+        }
+    }
+    return NULL;
+}
+
+// One producer and one consumer moving TYPED_MSGS 64-byte messages: malloc'd and passed by pointer,
+// copied through a typed channel, or written and read in place in a typed channel's slots
+static void bench_typed(void)
+{
+    for (size_t m = 0; m < ARRAY_SIZE(typed_mode_names); m++) {
+        typed_args_t args = {m == TYPED_MALLOC ? channel_create(TYPED_CAPACITY)
+                                               : channel_create_typed(TYPED_CAPACITY, sizeof(typed_msg_t)),
+                             (enum typed_mode)m};
+        size_t checksum = 0;
+        double start = now_sec();
+        pthread_t producer;
+        pthread_create(&producer, NULL, typed_producer, &args);
+        for (size_t i = 0; i < TYPED_MSGS; i++) {
+            if (args.mode == TYPED_MALLOC) {
+                void* data;
+                channel_receive(args.channel, &data);
+                typed_msg_t* msg = data;
+                checksum += msg->seq + (size_t)msg->payload[0];
+                free(msg);
+            } else if (args.mode == TYPED_COPY) {
+                typed_msg_t msg;
+                channel_receive_value(args.channel, &msg);
+                checksum += msg.seq + (size_t)msg.payload[0];
+            } else {
+                channel_slot_t slot;
+                channel_acquire(args.channel, &slot);
+                typed_msg_t* msg = slot.data;
+                checksum += msg->seq + (size_t)msg->payload[0];
+                channel_release(args.channel, &slot);
+            }
+        }
+        pthread_join(producer, NULL);
+        row_t row = ROW("typed", typed_mode_names[m]);
+        row.capacity = TYPED_CAPACITY;
+        row.producers = row.consumers = row.channels = 1;
+        row.msgs = TYPED_MSGS;
+        row.seconds = now_sec() - start;
+        print_row(&row);
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+        if (checksum == 0) {
+            fprintf(stderr, "typed: empty checksum\n");
+        }
+    }
+}
+
+// A task that does next to nothing, so the rows measure scheduling cost
+static void* pool_tiny_task(void* arg)
+{
+    return (void*)((uintptr_t)arg * 2654435761u);
+}
+
+static void* pool_thread_task(void* arg)
+{
+    return pool_tiny_task(arg);
+}
+
+// Every level of the spawn tree submits two tasks of the next level from inside the pool
+typedef struct spawn_level {
+    pool_t* pool;
+    struct spawn_level* child;
+} spawn_level_t;
+
+static void* pool_spawn_task(void* arg)
+{
+    spawn_level_t* level = arg;
+    if (level->child) {
+        pool_submit(level->pool, pool_spawn_task, level->child, NULL);
+        pool_submit(level->pool, pool_spawn_task, level->child, NULL);
+    }
+    return NULL;
+}
+
+// Tiny tasks on a pool with one worker per CPU, against a pthread_create and pthread_join per task
+// (thread_per_task, in rounds of one thread per CPU as the stress tests do). submit hands every task to the pool
+// from outside, future also receives each result through a channel, and spawn runs a binary tree of tasks that
+// submit their children from inside the pool, so workers steal from each other's deques
+static void bench_pool(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cpus > 0 ? (size_t)cpus : 1;
+
+    row_t row = ROW("pool", "thread_per_task");
+    row.producers = 1;
+    row.consumers = (double)workers;
+    pthread_t* threads = malloc(sizeof(pthread_t) * workers);
+    size_t tasks = 0;
+    double start = now_sec();
+    while (tasks < POOL_THREAD_TASKS) {
+        for (size_t i = 0; i < workers; i++) {
+            pthread_create(&threads[i], NULL, pool_thread_task, (void*)(tasks + i));
+        }
+        for (size_t i = 0; i < workers; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        tasks += workers;
+    }
+    row.seconds = now_sec() - start;
+    row.msgs = (double)tasks;
+    print_row(&row);
+    free(threads);
+
+    for (size_t mode = 0; mode < 3; mode++) {
+        row = ROW("pool", mode == 0 ? "submit" : mode == 1 ? "future" : "spawn");
+        row.producers = 1;
+        row.consumers = (double)workers;
+        pool_t* pool = pool_create(workers);
+        start = now_sec();
+        if (mode == 0) {
+            for (size_t i = 0; i < POOL_TASKS; i++) {
+                pool_submit(pool, pool_tiny_task, (void*)i, NULL);
+            }
+            row.msgs = POOL_TASKS;
+        } else if (mode == 1) {
+            row.channels = 1;
+            row.capacity = POOL_FUTURE_BATCH;
+            channel_t* results = channel_create(POOL_FUTURE_BATCH);
+            // Submit a batch, then collect its results, so the results channel never fills up
+            for (size_t i = 0; i < POOL_TASKS; i += POOL_FUTURE_BATCH) {
+                for (size_t j = 0; j < POOL_FUTURE_BATCH; j++) {
+                    pool_submit(pool, pool_tiny_task, (void*)(i + j), results);
+                }
+                for (size_t j = 0; j < POOL_FUTURE_BATCH; j++) {
+                    void* data;
+                    channel_receive(results, &data);
+                }
+            }
+            row.msgs = POOL_TASKS;
+            channel_close(results);
+            channel_destroy(results);
+        } else {
+            spawn_level_t levels[POOL_SPAWN_DEPTH + 1];
+            for (size_t d = 0; d <= POOL_SPAWN_DEPTH; d++) {
+                levels[d].pool = pool;
+                levels[d].child = d < POOL_SPAWN_DEPTH ? &levels[d + 1] : NULL;
+            }
+            pool_submit(pool, pool_spawn_task, &levels[0], NULL);
+            row.msgs = (double)(((size_t)2 << POOL_SPAWN_DEPTH) - 1);
+        }
+        // Shutdown returns once every task has run
+        pool_shutdown(pool);
+        row.seconds = now_sec() - start;
+        print_row(&row);
+        pool_destroy(pool);
+    }
+}
+
+// One subscriber's side of the broadcast benchmark: either its own channel of the fan-out or a subscription
+typedef struct {
+    channel_t* channel;
+    broadcast_sub_t* sub;
+    size_t msgs;            // messages received, including the last one
+} fan_args_t;
+
+static void* fan_consumer(void* arg)
+{
+    fan_args_t* args = arg;
+    void* data = NULL;
+    args->msgs = 0;
+    // The messages count up from 1; DROP subscribers may skip some but always end on the last one
+    while (data != (void*)BROADCAST_MSGS) {
+        enum channel_status status = args->sub ? broadcast_receive(args->sub, &data) : channel_receive(args->channel, &data);
+        if (status != SUCCESS) break;
+        args->msgs++;
+    }
+    return NULL;
+}
+
+// One producer delivering BROADCAST_MSGS messages to every subscriber: a channel per subscriber with one send
+// each (fan-out, as the routers of run_stress do), or one publish on a broadcast with backpressure (block) or
+// overwriting the oldest message (drop); msgs counts deliveries
+static void bench_broadcast(void)
+{
+    static const char* const modes[] = {"fanout", "block", "drop"};
+    for (size_t m = 0; m < ARRAY_SIZE(modes); m++) {
+        for (size_t s = 0; s < ARRAY_SIZE(broadcast_subscribers); s++) {
+            size_t subs = broadcast_subscribers[s];
+            fan_args_t* args = calloc(subs, sizeof(fan_args_t));
+            pthread_t* threads = malloc(sizeof(pthread_t) * subs);
+            channel_t** channels = malloc(sizeof(channel_t*) * subs);
+            broadcast_t* broadcast = NULL;
+            if (m == 0) {
+                for (size_t i = 0; i < subs; i++) {
+                    channels[i] = args[i].channel = channel_create(BROADCAST_CAPACITY);
+                }
+            } else {
+                broadcast = broadcast_create(BROADCAST_CAPACITY, m == 1 ? BROADCAST_BLOCK : BROADCAST_DROP);
+                for (size_t i = 0; i < subs; i++) {
+                    args[i].sub = broadcast_subscribe(broadcast);
+                }
+            }
+            double start = now_sec();
+            for (size_t i = 0; i < subs; i++) {
+                pthread_create(&threads[i], NULL, fan_consumer, &args[i]);
+            }
+            for (uintptr_t msg = 1; msg <= BROADCAST_MSGS; msg++) {
+                if (broadcast) {
+                    broadcast_publish(broadcast, (void*)msg);
+                } else {
+                    for (size_t i = 0; i < subs; i++) {
+                        channel_send(channels[i], (void*)msg);
+                    }
+                }
+            }
+            size_t delivered = 0;
+            for (size_t i = 0; i < subs; i++) {
+                pthread_join(threads[i], NULL);
+                delivered += args[i].msgs;
+            }
+            row_t row = ROW("broadcast", modes[m]);
+            row.capacity = BROADCAST_CAPACITY;
+            row.producers = 1;
+            row.consumers = (double)subs;
+            row.channels = broadcast ? 1 : (double)subs;
+            row.msgs = (double)delivered;
+            row.seconds = now_sec() - start;
+            print_row(&row);
+            if (broadcast) {
+                broadcast_close(broadcast);
+                broadcast_destroy(broadcast);
+            } else {
+                for (size_t i = 0; i < subs; i++) {
+                    channel_close(channels[i]);
+                    channel_destroy(channels[i]);
+                }
+            }
+            free(args);
+            free(threads);
+            free(channels);
+        }
+    }
+}
+
+// Random graph with about one link in four, as in the topology files
+static void floyd_random_graph(distance_t* graph, size_t n)
+{
+    unsigned int seed = (unsigned int)n;
+    for (size_t i = 0; i < n * n; i++) {
+        int r = rand_r(&seed);
+        graph[i] = (r % 4 != 0) ? 0x7fffffff : (distance_t)(r % 100 + 1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        graph[i * n + i] = 0;
+    }
+}
+
+// The reference solver that run_stress starts from: the textbook triple loop against the blocked solver on one
+// thread and on one per CPU. msgs counts relaxations (n^3), channels holds the number of nodes and consumers the
+// threads; every blocked solution is checked against the textbook one where that is run
+static void bench_floyd(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cpus > 0 ? (size_t)cpus : 1;
+    for (size_t s = 0; s < ARRAY_SIZE(floyd_sizes); s++) {
+        size_t n = floyd_sizes[s];
+        distance_t* graph = malloc(sizeof(distance_t) * n * n);
+        distance_t* expected = malloc(sizeof(distance_t) * n * n);
+        distance_t* actual = malloc(sizeof(distance_t) * n * n);
+        floyd_random_graph(graph, n);
+        bool checked = n <= FLOYD_REFERENCE_MAX;
+        if (checked) {
+            memcpy(expected, graph, sizeof(distance_t) * n * n);
+            row_t row = ROW("floyd", "reference");
+            row.channels = (double)n;
+            row.consumers = 1;
+            row.msgs = (double)n * (double)n * (double)n;
+            double start = now_sec();
+            floyd_warshall_reference(expected, n);
+            row.seconds = now_sec() - start;
+            print_row(&row);
+        }
+        for (size_t threads = 1; threads <= workers; threads = threads < workers ? workers : threads + 1) {
+            memcpy(actual, graph, sizeof(distance_t) * n * n);
+            row_t row = ROW("floyd", "blocked");
+            row.channels = (double)n;
+            row.consumers = (double)threads;
+            row.msgs = (double)n * (double)n * (double)n;
+            double start = now_sec();
+            floyd_warshall_blocked(actual, n, threads);
+            row.seconds = now_sec() - start;
+            print_row(&row);
+            if (checked && memcmp(actual, expected, sizeof(distance_t) * n * n) != 0) {
+                fprintf(stderr, "floyd: blocked solution differs from the reference for %zu nodes\n", n);
+            }
+        }
+        free(graph);
+        free(expected);
+        free(actual);
+    }
+}
+
+// The ring of run_stress_send_recv with one capacity-1 channel per member, the members run as a thread each
+// against coroutines on one worker thread per CPU; consumers holds the threads and msgs counts hops over the
+// whole run, start and shutdown included
+static void bench_ring(useconds_t duration_usec)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cpus > 0 ? (size_t)cpus : 1;
+    for (size_t coro = 0; coro <= 1; coro++) {
+        for (size_t m = 0; m < ARRAY_SIZE(ring_members); m++) {
+            size_t members = ring_members[m];
+            if (!coro && members > RING_THREAD_MAX) continue;
+            double start = now_sec();
+            size_t hops = coro ? run_stress_send_recv_coro(1, members, workers, 0.5, duration_usec)
+                               : run_stress_send_recv(1, members, 0.5, duration_usec);
+            row_t row = ROW("ring", coro ? "coro" : "threads");
+            row.capacity = 1;
+            row.producers = row.channels = (double)members;
+            row.consumers = coro ? (double)workers : (double)members;
+            row.msgs = (double)hops;
+            row.seconds = now_sec() - start;
+            print_row(&row);
+        }
+    }
+}
+
+// Returns true if the benchmark was named on the command line, or if none were
+static bool selected(int argc, char** argv, const char* name)
+{
+    if (argc <= 2) return true;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    long duration_ms = argc > 1 ? strtol(argv[1], NULL, 10) : 200;
+    if (duration_ms <= 0) {
+        fprintf(stderr, "usage: %s [duration_ms] [send_recv|batch|pc|handoff|select|select_fairness|converge|converge_sweep|typed|pool|broadcast|floyd|ring]...\n", argv[0]);
+        return 1;
+    }
+    useconds_t duration_usec = (useconds_t)duration_ms * 1000;
+    print_header();
+    if (selected(argc, argv, "send_recv"))       bench_send_recv(duration_usec);
+    if (selected(argc, argv, "batch"))           bench_batch();
+    if (selected(argc, argv, "pc"))              bench_pc(duration_usec);
+    if (selected(argc, argv, "handoff"))         bench_handoff(duration_usec);
+    if (selected(argc, argv, "select"))          bench_select(duration_usec);
+    if (selected(argc, argv, "select_fairness")) bench_select_fairness();
+    if (selected(argc, argv, "converge"))        bench_converge();
+    if (selected(argc, argv, "converge_sweep"))  bench_converge_sweep();
+    if (selected(argc, argv, "typed"))           bench_typed();
+    if (selected(argc, argv, "pool"))            bench_pool();
+    if (selected(argc, argv, "broadcast"))       bench_broadcast();
+    if (selected(argc, argv, "floyd"))           bench_floyd();
+    if (selected(argc, argv, "ring"))            bench_ring(duration_usec);
+    return 0;
+}
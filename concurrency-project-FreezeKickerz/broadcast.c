@@ -0,0 +1,299 @@
+#include "broadcast.h"
+
+#include <stdlib.h>
+
+/*
+ * A broadcast is one ring shared by every subscriber. Publishing writes the
+ * message into the slot of position tail once, however many subscribers
+ * there are, and each subscriber walks the ring with a cursor of its own.
+ * Publishers take the lock, so tail only moves under it; subscribers never
+ * lock to read.
+ *
+ * Position pos lives in slot pos & (capacity - 1). While the message at
+ * pos is being written its slot's seq is 2 * pos + 1, and once it is
+ * published it is 2 * pos + 2. A subscriber reads seq, the data and seq
+ * again: the same even value for its cursor means it has the message,
+ * anything newer means the slot was reused under BROADCAST_DROP and the
+ * subscriber skips to the oldest message still in the ring.
+ *
+ * Under BROADCAST_BLOCK the ring never laps a subscriber: a publisher
+ * only writes position pos once every cursor has passed pos - capacity.
+ * It keeps the lowest cursor it has seen and only scans the subscribers
+ * again when the ring looks full, so a publish usually touches no
+ * subscriber's cache line. While publishers wait the tail stands still,
+ * so a subscriber a whole ring behind passes half a ring behind exactly
+ * once; that read is the one that wakes them.
+ *
+ * Stores that publish a message or advance a cursor are sequentially
+ * consistent, so waiters pair them with their wait queue (see futex.h).
+ */
+
+// Creates a broadcast whose ring holds the given (nonzero) number of messages, rounded up to a power of two
+// Returns NULL if capacity is 0 or on allocation failure
+broadcast_t* broadcast_create(size_t capacity, enum broadcast_policy policy)
+{
+    if (capacity == 0) return NULL;
+    size_t slots = 1;
+    while (slots < capacity) {
+        slots <<= 1;
+    }
+    broadcast_t* broadcast = aligned_alloc(_Alignof(broadcast_t), sizeof(broadcast_t));
+    if (!broadcast) return NULL;
+    broadcast->slots = malloc(slots * sizeof(broadcast_slot_t));
+    if (!broadcast->slots) {
+        free(broadcast);
+        return NULL;
+    }
+    for (size_t i = 0; i < slots; i++) {
+        // Nothing published: the slot looks like it is waiting for position i
+        atomic_init(&broadcast->slots[i].seq, 2 * i);
+        atomic_init(&broadcast->slots[i].data, NULL);
+    }
+    atomic_init(&broadcast->tail, 0);
+    futex_mutex_init(&broadcast->lock);
+    broadcast->min_cursor = 0;
+    broadcast->subs = NULL;
+    waitq_init(&broadcast->published);
+    atomic_init(&broadcast->sleepy, false);
+    waitq_init(&broadcast->consumed);
+    atomic_init(&broadcast->closed, false);
+    broadcast->capacity = slots;
+    broadcast->policy = policy;
+    return broadcast;
+}
+
+// Adds a subscriber that reads every message published from now on
+// Returns NULL if the broadcast is closed or on allocation failure
+broadcast_sub_t* broadcast_subscribe(broadcast_t* broadcast)
+{
+    broadcast_sub_t* sub = aligned_alloc(_Alignof(broadcast_sub_t), sizeof(broadcast_sub_t));
+    if (!sub) return NULL;
+    futex_mutex_lock(&broadcast->lock);
+    if (atomic_load(&broadcast->closed)) {
+        futex_mutex_unlock(&broadcast->lock);
+        free(sub);
+        return NULL;
+    }
+    // tail cannot move while the lock is held, so the cursor is not behind min_cursor
+    atomic_init(&sub->cursor, atomic_load_explicit(&broadcast->tail, memory_order_relaxed));
+    atomic_init(&sub->dropped, 0);
+    sub->broadcast = broadcast;
+    sub->prev = NULL;
+    sub->next = broadcast->subs;
+    if (sub->next) sub->next->prev = sub;
+    broadcast->subs = sub;
+    futex_mutex_unlock(&broadcast->lock);
+    return sub;
+}
+
+// Removes a subscriber and frees it; publishers no longer wait for it
+// Returns SUCCESS
+enum channel_status broadcast_unsubscribe(broadcast_sub_t* sub)
+{
+    broadcast_t* broadcast = sub->broadcast;
+    futex_mutex_lock(&broadcast->lock);
+    if (sub->prev) sub->prev->next = sub->next;
+    else           broadcast->subs = sub->next;
+    if (sub->next) sub->next->prev = sub->prev;
+    futex_mutex_unlock(&broadcast->lock);
+    free(sub);
+    // The slowest subscriber may be gone
+    waitq_wake_all(&broadcast->consumed);
+    return SUCCESS;
+}
+
+// True if the slot of position pos can be reused without lapping a subscriber; called with the lock held
+static bool broadcast_has_room(broadcast_t* broadcast, size_t pos)
+{
+    if (broadcast->policy == BROADCAST_DROP || pos - broadcast->min_cursor < broadcast->capacity) return true;
+    size_t min = pos;
+    for (broadcast_sub_t* sub = broadcast->subs; sub; sub = sub->next) {
+        size_t cursor = atomic_load(&sub->cursor);
+        if (cursor < min) min = cursor;
+    }
+    broadcast->min_cursor = min;
+    return pos - min < broadcast->capacity;
+}
+
+// Writes data into the ring, waiting for room if blocking
+static enum channel_status broadcast_put(broadcast_t* broadcast, void* data, bool blocking)
+{
+    enum channel_status status;
+    bool waiting = false;
+    uint32_t word = 0;
+    futex_mutex_lock(&broadcast->lock);
+    while (true) {
+        if (atomic_load(&broadcast->closed)) {
+            status = CLOSED_ERROR;
+            break;
+        }
+        size_t pos = atomic_load_explicit(&broadcast->tail, memory_order_relaxed);
+        if (broadcast_has_room(broadcast, pos)) {
+            broadcast_slot_t* slot = &broadcast->slots[pos & (broadcast->capacity - 1)];
+            atomic_store(&slot->seq, 2 * pos + 1);
+            atomic_store(&slot->data, data);
+            atomic_store(&slot->seq, 2 * pos + 2);
+            atomic_store(&broadcast->tail, pos + 1);
+            status = SUCCESS;
+            break;
+        }
+        if (!blocking) {
+            status = CHANNEL_FULL;
+            break;
+        }
+        if (waiting) {
+            futex_mutex_unlock(&broadcast->lock);
+            word = waitq_wait(&broadcast->consumed, word);
+            futex_mutex_lock(&broadcast->lock);
+        } else {
+            // Entered before the next check, so a subscriber moving on after it wakes this publisher
+            word = waitq_enter(&broadcast->consumed);
+            waiting = true;
+        }
+    }
+    futex_mutex_unlock(&broadcast->lock);
+    if (waiting) {
+        waitq_leave(&broadcast->consumed);
+        // The wake that let this publisher through may have freed room for another one
+        if (status == SUCCESS) {
+            waitq_wake_one(&broadcast->consumed);
+        }
+    }
+    // One publish is news for every waiting subscriber; the publishes after it only wake
+    // subscribers that went back to sleep in between
+    if (status == SUCCESS && atomic_exchange(&broadcast->sleepy, false)) {
+        waitq_wake_all(&broadcast->published);
+    }
+    return status;
+}
+
+// Publishes data to every subscriber with a single write into the ring
+// Returns SUCCESS for successfully publishing data,
+// CLOSED_ERROR if the broadcast is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status broadcast_publish(broadcast_t* broadcast, void* data)
+{
+    return broadcast_put(broadcast, data, true);
+}
+
+// Non-blocking version of broadcast_publish
+// Returns CHANNEL_FULL instead of waiting for the slowest subscriber, otherwise the same statuses as broadcast_publish
+enum channel_status broadcast_non_blocking_publish(broadcast_t* broadcast, void* data)
+{
+    return broadcast_put(broadcast, data, false);
+}
+
+// Reads the message at the subscriber's cursor if it has been published
+// Returns SUCCESS or CHANNEL_EMPTY
+static enum channel_status broadcast_take(broadcast_sub_t* sub, void** data)
+{
+    broadcast_t* broadcast = sub->broadcast;
+    size_t pos = atomic_load_explicit(&sub->cursor, memory_order_relaxed);
+    while (true) {
+        broadcast_slot_t* slot = &broadcast->slots[pos & (broadcast->capacity - 1)];
+        size_t seq = atomic_load(&slot->seq);
+        if (seq == 2 * pos + 2) {
+            void* value = atomic_load(&slot->data);
+            if (atomic_load(&slot->seq) == seq) {
+                *data = value;
+                atomic_store(&sub->cursor, pos + 1);
+                // A blocked publisher waits for a subscriber a whole ring behind; waking it only once that
+                // subscriber is half a ring behind lets it publish a run of messages per wake, not one
+                if (broadcast->policy == BROADCAST_BLOCK
+                    && atomic_load(&broadcast->tail) - (pos + 1) == broadcast->capacity / 2) {
+                    waitq_wake_one(&broadcast->consumed);
+                }
+                return SUCCESS;
+            }
+        } else if ((ptrdiff_t)(seq - (2 * pos + 2)) < 0) {
+            // Not published yet
+            return CHANNEL_EMPTY;
+        }
+        // Overwritten: skip to the oldest message a publisher is not about to overwrite
+        size_t tail = atomic_load(&broadcast->tail);
+        size_t oldest = tail - broadcast->capacity + 1;
+        if ((ptrdiff_t)(oldest - pos) > 0) {
+            atomic_fetch_add_explicit(&sub->dropped, oldest - pos, memory_order_relaxed);
+            pos = oldest;
+            atomic_store(&sub->cursor, pos);
+        }
+    }
+}
+
+// Reads the subscriber's next message and stores it in data
+// This is a blocking call i.e., the function waits till a message is published
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the broadcast is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status broadcast_receive(broadcast_sub_t* sub, void** data)
+{
+    broadcast_t* broadcast = sub->broadcast;
+    enum channel_status status;
+    bool waiting = false;
+    uint32_t word = 0;
+    while (true) {
+        if (waiting) {
+            // Set before the re-check, so either it sees the next message or that publish sees the flag
+            atomic_store(&broadcast->sleepy, true);
+        }
+        if (atomic_load(&broadcast->closed)) {
+            status = CLOSED_ERROR;
+            break;
+        }
+        status = broadcast_take(sub, data);
+        if (status == SUCCESS) break;
+        if (waiting) {
+            word = waitq_wait(&broadcast->published, word);
+        } else {
+            word = waitq_enter(&broadcast->published);
+            waiting = true;
+        }
+    }
+    if (waiting) {
+        waitq_leave(&broadcast->published);
+    }
+    return status;
+}
+
+// Non-blocking version of broadcast_receive
+// Returns CHANNEL_EMPTY instead of waiting, otherwise the same statuses as broadcast_receive
+enum channel_status broadcast_non_blocking_receive(broadcast_sub_t* sub, void** data)
+{
+    if (atomic_load(&sub->broadcast->closed)) return CLOSED_ERROR;
+    return broadcast_take(sub, data);
+}
+
+// Returns how many messages the subscriber lost to BROADCAST_DROP so far
+size_t broadcast_dropped(broadcast_sub_t* sub)
+{
+    return atomic_load_explicit(&sub->dropped, memory_order_relaxed);
+}
+
+// Closes the broadcast and informs all the blocking publish/receive calls to return with CLOSED_ERROR
+// Returns SUCCESS if close is successful and CLOSED_ERROR if the broadcast is already closed
+enum channel_status broadcast_close(broadcast_t* broadcast)
+{
+    futex_mutex_lock(&broadcast->lock);
+    bool was_closed = atomic_exchange(&broadcast->closed, true);
+    futex_mutex_unlock(&broadcast->lock);
+    if (was_closed) return CLOSED_ERROR;
+    waitq_wake_all(&broadcast->published);
+    waitq_wake_all(&broadcast->consumed);
+    return SUCCESS;
+}
+
+// Frees all the memory allocated to the broadcast, including subscribers that did not unsubscribe
+// Returns SUCCESS if destroy is successful and DESTROY_ERROR if broadcast_close has not been called
+enum channel_status broadcast_destroy(broadcast_t* broadcast)
+{
+    if (!atomic_load(&broadcast->closed)) return DESTROY_ERROR;
+    broadcast_sub_t* sub = broadcast->subs;
+    while (sub) {
+        broadcast_sub_t* next = sub->next;
+        free(sub);
+        sub = next;
+    }
+    free(broadcast->slots);
+    free(broadcast);
+    return SUCCESS;
+}
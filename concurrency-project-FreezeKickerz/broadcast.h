@@ -0,0 +1,93 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "channel.h"
+#include "futex.h"
+
+// What a publisher does when the slowest subscriber is a whole ring behind
+enum broadcast_policy {
+    BROADCAST_BLOCK, // wait until that subscriber has read the oldest message (backpressure)
+    BROADCAST_DROP,  // overwrite the oldest message; the subscriber skips what it missed and counts it as dropped
+};
+
+// One ring slot; seq says which message it holds (see broadcast.c)
+typedef struct {
+    atomic_size_t seq;
+    _Atomic(void*) data;
+} broadcast_slot_t;
+
+struct broadcast;
+
+// A subscriber's read position, on a cache line of its own
+typedef struct broadcast_sub {
+    _Alignas(64) atomic_size_t cursor; // position of the next message to read, only written by the subscriber
+    atomic_size_t dropped;             // messages overwritten before the subscriber read them
+    struct broadcast* broadcast;
+    struct broadcast_sub* prev;        // subscriber list, under the broadcast's lock
+    struct broadcast_sub* next;
+} broadcast_sub_t;
+
+// Defines broadcast object: every message published on it is read by every subscriber
+typedef struct broadcast {
+    _Alignas(64) atomic_size_t tail; // position of the next message, only written under lock
+    futex_mutex_t lock;              // serializes publishers, subscribe and unsubscribe
+    size_t min_cursor;               // under lock: no subscriber reads before this position
+    broadcast_sub_t* subs;           // under lock
+    waitq_t published;               // subscribers waiting for a message
+    atomic_bool sleepy;              // a subscriber may sleep on published since the last publish woke it
+    waitq_t consumed;                // publishers waiting for the slowest subscriber (BROADCAST_BLOCK)
+    atomic_bool closed;
+    size_t capacity;                 // slots in the ring, a power of two
+    enum broadcast_policy policy;
+    broadcast_slot_t* slots;
+} broadcast_t;
+
+// Creates a broadcast whose ring holds the given (nonzero) number of messages, rounded up to a power of two
+// Returns NULL if capacity is 0 or on allocation failure
+broadcast_t* broadcast_create(size_t capacity, enum broadcast_policy policy);
+
+// Adds a subscriber that reads every message published from now on
+// Returns NULL if the broadcast is closed or on allocation failure
+broadcast_sub_t* broadcast_subscribe(broadcast_t* broadcast);
+
+// Removes a subscriber and frees it; publishers no longer wait for it
+// Returns SUCCESS
+enum channel_status broadcast_unsubscribe(broadcast_sub_t* sub);
+
+// Publishes data to every subscriber with a single write into the ring
+// This is a blocking call under BROADCAST_BLOCK, i.e., it waits while the slowest subscriber is a whole ring behind
+// Returns SUCCESS for successfully publishing data,
+// CLOSED_ERROR if the broadcast is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status broadcast_publish(broadcast_t* broadcast, void* data);
+
+// Non-blocking version of broadcast_publish
+// Returns CHANNEL_FULL instead of waiting for the slowest subscriber, otherwise the same statuses as broadcast_publish
+enum channel_status broadcast_non_blocking_publish(broadcast_t* broadcast, void* data);
+
+// Reads the subscriber's next message and stores it in data
+// This is a blocking call i.e., the function waits till a message is published
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the broadcast is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status broadcast_receive(broadcast_sub_t* sub, void** data);
+
+// Non-blocking version of broadcast_receive
+// Returns CHANNEL_EMPTY instead of waiting, otherwise the same statuses as broadcast_receive
+enum channel_status broadcast_non_blocking_receive(broadcast_sub_t* sub, void** data);
+
+// Returns how many messages the subscriber lost to BROADCAST_DROP so far
+size_t broadcast_dropped(broadcast_sub_t* sub);
+
+// Closes the broadcast and informs all the blocking publish/receive calls to return with CLOSED_ERROR
+// Returns SUCCESS if close is successful and CLOSED_ERROR if the broadcast is already closed
+enum channel_status broadcast_close(broadcast_t* broadcast);
+
+// Frees all the memory allocated to the broadcast, including subscribers that did not unsubscribe
+// Returns SUCCESS if destroy is successful and DESTROY_ERROR if broadcast_close has not been called
+enum channel_status broadcast_destroy(broadcast_t* broadcast);
+
+#endif // BROADCAST_H
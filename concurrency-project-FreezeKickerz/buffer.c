@@ -1,31 +1,198 @@
+#include <stddef.h>
 #include "buffer.h"
 
-// Creates a buffer with the given capacity
-buffer_t* buffer_create(size_t capacity)
+/*
+ * The ring has a power-of-two number of slots, so position pos maps to
+ * slot pos & mask without a division. MPMC buffers use per-slot sequence
+ * numbers: the slot is free for the producer of pos when its seq equals
+ * 2 * pos and holds a value for the consumer of pos when its seq equals
+ * 2 * pos + 1. Producers and consumers claim a position by advancing tail
+ * or head with a CAS, then hand the slot over by storing the next seq.
+ * (Doubling keeps the two states apart when there is one slot.)
+ *
+ * A capacity that is not a power of two leaves some slots spare. Then a
+ * producer also checks that the value capacity positions back has been
+ * removed, so the buffer never holds more than capacity values.
+ *
+ * The bulk calls claim a run of consecutive ready slots with one CAS.
+ *
+ * Typed buffers keep a value of elem_size bytes per slot in one array
+ * instead of a pointer, and split the protocol in two: reserve/acquire
+ * claim the position and hand out the slot's storage, and commit/release
+ * store the next seq once the caller has written or read the value.
+ *
+ * SPSC buffers skip the CAS and the slot seq: the only producer owns tail
+ * and the only consumer owns head.
+ *
+ * The stores that publish a value or free a slot, and the loads that
+ * look for one, are sequentially consistent so a caller can pair them
+ * with its own waiter count without a fence (see channel.c).
+ */
+
+#define CACHE_LINE 64
+
+static size_t cache_align(size_t bytes)
+{
+    return (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+static buffer_t* buffer_init(size_t capacity, bool spsc, size_t elem_size)
 {
-    buffer_t* buffer = (buffer_t*) malloc(sizeof(buffer_t));
-    void** data  = (void**) malloc(capacity * sizeof(void*));
-    buffer->size = 0;
-    buffer->next = 0;
+    size_t num_slots = 1;
+    while (num_slots < capacity) {
+        num_slots <<= 1;
+    }
+    // Header, slots, then the values of a typed buffer, each starting on a cache line
+    size_t slots_offset = cache_align(sizeof(buffer_t));
+    size_t values_offset = slots_offset + cache_align(num_slots * sizeof(buffer_slot_t));
+    size_t bytes = cache_align(values_offset + num_slots * elem_size);
+    unsigned char* block = aligned_alloc(CACHE_LINE, bytes);
+    if (!block) return NULL;
+
+    buffer_t* buffer = (buffer_t*) block;
+    buffer_slot_t* slots = (buffer_slot_t*) (block + slots_offset);
+    for (size_t i = 0; i < num_slots; i++) {
+        atomic_init(&slots[i].seq, 2 * i);
+        slots[i].data = NULL;
+    }
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
     buffer->capacity = capacity;
-    buffer->data = data;
+    buffer->mask = num_slots - 1;
+    buffer->spsc = spsc;
+    buffer->slots = slots;
+    buffer->elem_size = elem_size;
+    buffer->values = elem_size > 0 ? block + values_offset : NULL;
     return buffer;
 }
 
+// Returns the slot of position pos
+static buffer_slot_t* slot_at(buffer_t* buffer, size_t pos)
+{
+    return &buffer->slots[pos & buffer->mask];
+}
+
+// Returns the seq a slot gets once the value at pos has been removed
+static size_t removed_seq(buffer_t* buffer, size_t pos)
+{
+    return 2 * (pos + buffer->mask + 1);
+}
+
+// True if adding at pos keeps the buffer within its capacity: the value capacity positions back has been removed
+// When capacity is the number of slots, that is the value whose slot pos reuses, which the caller already checked
+static bool within_capacity(buffer_t* buffer, size_t pos)
+{
+    if (buffer->capacity == buffer->mask + 1) return true;
+    size_t prev = pos - buffer->capacity; // wraps around for the first capacity positions, which always fit
+    size_t seq = atomic_load(&slot_at(buffer, prev)->seq);
+    return (ptrdiff_t)(seq - removed_seq(buffer, prev)) >= 0;
+}
+
+// Creates a buffer with the given capacity
+buffer_t* buffer_create(size_t capacity)
+{
+    return buffer_init(capacity, false, 0);
+}
+
+// Creates a buffer with the given capacity for a single producer and a single consumer
+buffer_t* buffer_create_spsc(size_t capacity)
+{
+    return buffer_init(capacity, true, 0);
+}
+
+// Creates a typed buffer holding up to capacity values of elem_size bytes each in its own storage
+// Typed buffers are used through buffer_reserve/buffer_commit and buffer_acquire/buffer_release only
+buffer_t* buffer_create_typed(size_t capacity, size_t elem_size)
+{
+    return buffer_init(capacity, false, elem_size);
+}
+
+// Claims the free slot at tail for an MPMC add, storing its position in pos
+// Returns NULL if the buffer is full
+static buffer_slot_t* claim_tail(buffer_t* buffer, size_t* pos_out)
+{
+    size_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    while (true) {
+        buffer_slot_t* slot = slot_at(buffer, pos);
+        size_t seq = atomic_load(&slot->seq);
+        if (seq == 2 * pos) {
+            if (!within_capacity(buffer, pos)) {
+                return NULL;
+            }
+            if (atomic_compare_exchange_weak_explicit(&buffer->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *pos_out = pos;
+                return slot;
+            }
+        } else if ((ptrdiff_t)(seq - 2 * pos) < 0) {
+            // The consumer of the previous lap has not freed this slot
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Claims the published slot at head for an MPMC remove, storing its position in pos
+// Returns NULL if the buffer is empty
+static buffer_slot_t* claim_head(buffer_t* buffer, size_t* pos_out)
+{
+    size_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    while (true) {
+        buffer_slot_t* slot = slot_at(buffer, pos);
+        size_t seq = atomic_load(&slot->seq);
+        if (seq == 2 * pos + 1) {
+            if (atomic_compare_exchange_weak_explicit(&buffer->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *pos_out = pos;
+                return slot;
+            }
+        } else if ((ptrdiff_t)(seq - (2 * pos + 1)) < 0) {
+            // The producer of this position has not published yet
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+        }
+    }
+}
+
+static enum buffer_status spsc_add(buffer_t* buffer, void* data)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    if (tail - atomic_load(&buffer->head) >= buffer->capacity) {
+        return BUFFER_ERROR;
+    }
+    slot_at(buffer, tail)->data = data;
+    atomic_store(&buffer->tail, tail + 1);
+    return BUFFER_SUCCESS;
+}
+
+static enum buffer_status spsc_remove(buffer_t* buffer, void** data)
+{
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    if (head == atomic_load(&buffer->tail)) {
+        return BUFFER_ERROR;
+    }
+    *data = slot_at(buffer, head)->data;
+    atomic_store(&buffer->head, head + 1);
+    return BUFFER_SUCCESS;
+}
+
 // Adds the value into the buffer
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_add(buffer_t* buffer, void* data)
 {
-    if (buffer->size >= buffer->capacity) {
-        return BUFFER_ERROR;
+    if (buffer->spsc) {
+        return spsc_add(buffer, data);
     }
-    size_t pos = buffer->next + buffer->size;
-    if (pos >= buffer->capacity) {
-        pos -= buffer->capacity;
+    size_t pos;
+    buffer_slot_t* slot = claim_tail(buffer, &pos);
+    if (!slot) {
+        return BUFFER_ERROR;
     }
-    buffer->data[pos] = data;
-    buffer->size++;
+    slot->data = data;
+    atomic_store(&slot->seq, 2 * pos + 1);
     return BUFFER_SUCCESS;
 }
 
@@ -34,22 +201,170 @@ enum buffer_status buffer_add(buffer_t* buffer, void* data)
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_remove(buffer_t* buffer, void **data)
 {
-    if (buffer->size > 0) {
-        *data = buffer->data[buffer->next];
-        buffer->size--;
-        buffer->next++;
-        if (buffer->next >= buffer->capacity) {
-            buffer->next -= buffer->capacity;
+    if (buffer->spsc) {
+        return spsc_remove(buffer, data);
+    }
+    size_t pos;
+    buffer_slot_t* slot = claim_head(buffer, &pos);
+    if (!slot) {
+        return BUFFER_ERROR;
+    }
+    *data = slot->data;
+    atomic_store(&slot->seq, removed_seq(buffer, pos));
+    return BUFFER_SUCCESS;
+}
+
+// Claims the next free slot of a typed buffer, stores its position in pos and returns where to write its value
+// Removers see the value once buffer_commit is called with pos
+// Returns NULL if the buffer is full
+void* buffer_reserve(buffer_t* buffer, size_t* pos)
+{
+    if (!claim_tail(buffer, pos)) {
+        return NULL;
+    }
+    return buffer->values + (*pos & buffer->mask) * buffer->elem_size;
+}
+
+// Publishes the value written into the slot claimed by buffer_reserve
+void buffer_commit(buffer_t* buffer, size_t pos)
+{
+    atomic_store(&slot_at(buffer, pos)->seq, 2 * pos + 1);
+}
+
+// Claims the oldest value of a typed buffer, stores its position in pos and returns where the value is stored
+// The slot is not reused until buffer_release is called with pos
+// Returns NULL if the buffer is empty
+void* buffer_acquire(buffer_t* buffer, size_t* pos)
+{
+    if (!claim_head(buffer, pos)) {
+        return NULL;
+    }
+    return buffer->values + (*pos & buffer->mask) * buffer->elem_size;
+}
+
+// Frees the slot claimed by buffer_acquire for adders
+void buffer_release(buffer_t* buffer, size_t pos)
+{
+    atomic_store(&slot_at(buffer, pos)->seq, removed_seq(buffer, pos));
+}
+
+static size_t spsc_add_n(buffer_t* buffer, void** data, size_t n)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    size_t room = buffer->capacity - (tail - atomic_load(&buffer->head));
+    size_t count = n < room ? n : room;
+    for (size_t i = 0; i < count; i++) {
+        slot_at(buffer, tail + i)->data = data[i];
+    }
+    if (count > 0) {
+        atomic_store(&buffer->tail, tail + count);
+    }
+    return count;
+}
+
+static size_t spsc_remove_n(buffer_t* buffer, void** data, size_t n)
+{
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    size_t size = atomic_load(&buffer->tail) - head;
+    size_t count = n < size ? n : size;
+    for (size_t i = 0; i < count; i++) {
+        data[i] = slot_at(buffer, head + i)->data;
+    }
+    if (count > 0) {
+        atomic_store(&buffer->head, head + count);
+    }
+    return count;
+}
+
+// Adds up to n values from data into the buffer in order
+// Returns how many were added, 0 if the buffer is full
+size_t buffer_add_n(buffer_t* buffer, void** data, size_t n)
+{
+    if (buffer->spsc) {
+        return spsc_add_n(buffer, data, n);
+    }
+    size_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    while (n > 0) {
+        // Count the free slots from pos on; none of them can be taken while tail stays at pos
+        size_t count = 0;
+        size_t seq = 0;
+        bool full = false;
+        while (count < n) {
+            seq = atomic_load(&slot_at(buffer, pos + count)->seq);
+            if (seq != 2 * (pos + count)) {
+                break;
+            }
+            if (!within_capacity(buffer, pos + count)) {
+                full = true;
+                break;
+            }
+            count++;
+        }
+        if (count == 0) {
+            if (full || (ptrdiff_t)(seq - 2 * pos) < 0) {
+                // The consumer of the previous lap has not freed this slot
+                return 0;
+            }
+            pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&buffer->tail, &pos, pos + count,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            for (size_t i = 0; i < count; i++) {
+                buffer_slot_t* slot = slot_at(buffer, pos + i);
+                slot->data = data[i];
+                atomic_store(&slot->seq, 2 * (pos + i) + 1);
+            }
+            return count;
+        }
+    }
+    return 0;
+}
+
+// Removes up to n values from the buffer in FIFO order and stores them in data
+// Returns how many were removed, 0 if the buffer is empty
+size_t buffer_remove_n(buffer_t* buffer, void** data, size_t n)
+{
+    if (buffer->spsc) {
+        return spsc_remove_n(buffer, data, n);
+    }
+    size_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    while (n > 0) {
+        // Count the published slots from pos on; none of them can be taken while head stays at pos
+        size_t count = 0;
+        size_t seq = 0;
+        while (count < n) {
+            seq = atomic_load(&slot_at(buffer, pos + count)->seq);
+            if (seq != 2 * (pos + count) + 1) {
+                break;
+            }
+            count++;
+        }
+        if (count == 0) {
+            if ((ptrdiff_t)(seq - (2 * pos + 1)) < 0) {
+                // The producer of this position has not published yet
+                return 0;
+            }
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&buffer->head, &pos, pos + count,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            for (size_t i = 0; i < count; i++) {
+                buffer_slot_t* slot = slot_at(buffer, pos + i);
+                data[i] = slot->data;
+                atomic_store(&slot->seq, removed_seq(buffer, pos + i));
+            }
+            return count;
         }
-        return BUFFER_SUCCESS;
     }
-    return BUFFER_ERROR;
+    return 0;
 }
 
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t *buffer)
 {
-    free(buffer->data);
+    // The slots and values live in the buffer's own allocation
     free(buffer);
 }
 
@@ -60,14 +375,17 @@ size_t buffer_capacity(buffer_t* buffer)
 }
 
 // Returns the current number of elements in the buffer
+// Only exact while no add or remove is in progress
 size_t buffer_current_size(buffer_t* buffer)
 {
-    return buffer->size;
+    size_t head = atomic_load(&buffer->head);
+    size_t size = atomic_load(&buffer->tail) - head;
+    return size > buffer->capacity ? buffer->capacity : size;
 }
 
 // Peeks at a value in the buffer
 // Only used for testing code; you should NOT use this
 void* peek_buffer(buffer_t* buffer, size_t index)
 {
-    return buffer->data[index];
+    return buffer->slots[index].data;
 }
@@ -2,12 +2,28 @@
 #define BUFFER_H
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
+// One ring slot; seq says whose turn the slot is (see buffer.c)
 typedef struct {
-    size_t size;
-    size_t next;
-    size_t capacity;
-    void** data;
+    atomic_size_t seq;
+    void* data;
+} buffer_slot_t;
+
+// Bounded lock-free ring over a power-of-two number of slots
+// Any number of threads may add and remove concurrently, except on an SPSC buffer,
+// which allows one adding thread and one removing thread at a time
+// The header, the slots and the values of a typed buffer share one cache-aligned allocation
+typedef struct {
+    _Alignas(64) atomic_size_t head; // position of the next value to remove, on a cache line of its own
+    _Alignas(64) atomic_size_t tail; // position of the next value to add, on a cache line of its own
+    _Alignas(64) size_t capacity;    // most values the buffer holds, at most the number of slots
+    size_t mask;                     // number of slots - 1; position pos lives in slot pos & mask
+    bool spsc;
+    buffer_slot_t* slots;
+    size_t elem_size;       // typed buffers: bytes per value, 0 for buffers of pointers
+    unsigned char* values;  // typed buffers: one value of elem_size bytes per slot
 } buffer_t;
 
 enum buffer_status {
@@ -18,6 +34,9 @@ enum buffer_status {
 // Creates a buffer with the given capacity
 buffer_t* buffer_create(size_t capacity);
 
+// Creates a buffer with the given capacity for a single producer and a single consumer
+buffer_t* buffer_create_spsc(size_t capacity);
+
 // Adds the value into the buffer
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
@@ -28,6 +47,34 @@ enum buffer_status buffer_add(buffer_t* buffer, void* data);
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_remove(buffer_t* buffer, void** data);
 
+// Adds up to n values from data into the buffer in order
+// Returns how many were added, 0 if the buffer is full
+size_t buffer_add_n(buffer_t* buffer, void** data, size_t n);
+
+// Removes up to n values from the buffer in FIFO order and stores them in data
+// Returns how many were removed, 0 if the buffer is empty
+size_t buffer_remove_n(buffer_t* buffer, void** data, size_t n);
+
+// Creates a typed buffer holding up to capacity values of elem_size bytes each in its own storage
+// Typed buffers are used through buffer_reserve/buffer_commit and buffer_acquire/buffer_release only
+buffer_t* buffer_create_typed(size_t capacity, size_t elem_size);
+
+// Claims the next free slot of a typed buffer, stores its position in pos and returns where to write its value
+// Removers see the value once buffer_commit is called with pos
+// Returns NULL if the buffer is full
+void* buffer_reserve(buffer_t* buffer, size_t* pos);
+
+// Publishes the value written into the slot claimed by buffer_reserve
+void buffer_commit(buffer_t* buffer, size_t pos);
+
+// Claims the oldest value of a typed buffer, stores its position in pos and returns where the value is stored
+// The slot is not reused until buffer_release is called with pos
+// Returns NULL if the buffer is empty
+void* buffer_acquire(buffer_t* buffer, size_t* pos);
+
+// Frees the slot claimed by buffer_acquire for adders
+void buffer_release(buffer_t* buffer, size_t pos);
+
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t* buffer);
 
@@ -35,6 +82,7 @@ void buffer_free(buffer_t* buffer);
 size_t buffer_capacity(buffer_t* buffer);
 
 // Returns the current number of elements in the buffer
+// Only exact while no add or remove is in progress
 size_t buffer_current_size(buffer_t* buffer);
 
 // Peeks at a value in the buffer
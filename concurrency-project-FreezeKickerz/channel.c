@@ -1,162 +1,584 @@
 #include "channel.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #define unbuf_op_send            0
 #define unbuf_op_receive         1
-#define unbuf_op_none           -1
 
-// Creates a new channel with the provided size and returns it to the caller
-channel_t* channel_create(size_t size)
+static channel_t* channel_init(size_t size, bool spsc, size_t elem_size)
 {
     channel_t* channel = malloc(sizeof(channel_t));
     if (!channel) return NULL;
 
     /* mutexes */
-    pthread_mutex_init(&channel->chan_mutex,         NULL);
-    pthread_mutex_init(&channel->select_list_mutex,  NULL);
-
-    /* buffered-operation condition variables */
-    pthread_cond_init(&channel->cond_not_full,   NULL);
-    pthread_cond_init(&channel->cond_not_empty,  NULL);
+    futex_mutex_init(&channel->chan_mutex);
+    futex_mutex_init(&channel->select_list_mutex);
 
-    /* unbuffered rendezvous condition variables */
-    pthread_cond_init(&channel->rendezvous_wait_cv,     NULL);
-    pthread_cond_init(&channel->rendezvous_complete_cv, NULL);
+    /* buffered-operation wait queues */
+    waitq_init(&channel->not_full);
+    waitq_init(&channel->not_empty);
 
     /* state */
     channel->buffer            = NULL;       
-    channel->closed_flag       = false;
+    atomic_init(&channel->closed_flag, false);
     channel->send_selectors    = list_create();
     channel->recv_selectors    = list_create();
-    channel->active_unbuf_op   = unbuf_op_none ;
-    channel->unbuf_stage       = 0;
+    atomic_init(&channel->send_select_count, 0);
+    atomic_init(&channel->recv_select_count, 0);
     channel->is_unbuffered     = (size == 0);
     if (!channel->is_unbuffered) {
-        channel->buffer = buffer_create(size);
+        if (elem_size > 0)  channel->buffer = buffer_create_typed(size, elem_size);
+        else if (spsc)      channel->buffer = buffer_create_spsc(size);
+        else                channel->buffer = buffer_create(size);
     }
-    channel->unbuf_data        = NULL;
-    channel->waiting_senders   = 0;
-    channel->waiting_receivers = 0;
+    channel->send_waiters      = (unbuf_queue_t){NULL, NULL};
+    channel->recv_waiters      = (unbuf_queue_t){NULL, NULL};
+    channel->stats             = NULL;
+    channel->events            = NULL;
 
     return channel;
 }
 
-void notify_select_senders(channel_t* channel)
+// Creates a new channel with the provided size and returns it to the caller
+channel_t* channel_create(size_t size)
+{
+    return channel_init(size, false, 0);
+}
+
+// Creates a new buffered channel for exactly one sending thread and one receiving thread at a time
+// (a select that sends or receives on the channel counts as that thread)
+// Its buffer skips the atomic read-modify-writes of the shared ring; a size of 0 creates an ordinary unbuffered channel
+channel_t* channel_create_spsc(size_t size)
+{
+    return channel_init(size, true, 0);
+}
+
+// Creates a new typed channel of the given (nonzero) size whose messages are values of elem_size bytes
+// The channel allocates a slot for every message up front and messages are copied into them or written in place,
+// so sending and receiving never allocate; typed channels are only used with the value and slot calls below,
+// never with the void* calls or channel_select
+// Returns NULL if size or elem_size is 0
+channel_t* channel_create_typed(size_t size, size_t elem_size)
+{
+    if (size == 0 || elem_size == 0) return NULL;
+    return channel_init(size, false, elem_size);
+}
+
+// True for channels created with channel_create_typed
+static bool is_typed(channel_t* channel)
+{
+    return channel->buffer && channel->buffer->elem_size > 0;
+}
+
+/*
+ * A channel that enables stats keeps its counters in an allocation of its
+ * own, with the sending side, the receiving side and the selects on
+ * separate cache lines, so producers and consumers do not pass one line
+ * back and forth. Every update is a relaxed read-modify-write, and the wait
+ * clock is only read by calls that are about to block anyway.
+ */
+struct channel_counters {
+    _Alignas(64) atomic_size_t sends;
+    atomic_size_t blocked_sends;
+    atomic_uint_least64_t send_wait_ns;
+    atomic_size_t peak_occupancy;
+    _Alignas(64) atomic_size_t receives;
+    atomic_size_t blocked_receives;
+    atomic_uint_least64_t receive_wait_ns;
+    _Alignas(64) atomic_size_t select_wakeups;
+    atomic_size_t select_successes;
+};
+
+static void stats_add(atomic_size_t* counter, size_t n)
+{
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+// Counts n messages written to the channel and updates the peak occupancy
+static void stats_sent(channel_t* channel, size_t n)
+{
+    channel_counters_t* stats = channel->stats;
+    if (!stats) return;
+    stats_add(&stats->sends, n);
+    if (channel->is_unbuffered) return;
+    size_t size = buffer_current_size(channel->buffer);
+    size_t peak = atomic_load_explicit(&stats->peak_occupancy, memory_order_relaxed);
+    while (size > peak && !atomic_compare_exchange_weak_explicit(&stats->peak_occupancy, &peak, size,
+                                                                 memory_order_relaxed, memory_order_relaxed)) {
+        // peak now holds the value another sender stored
+    }
+}
+
+// Counts n messages read from the channel
+static void stats_received(channel_t* channel, size_t n)
+{
+    if (channel->stats) stats_add(&channel->stats->receives, n);
+}
+
+// Returns the time a call starts waiting, or 0 if the channel keeps no stats
+static uint64_t stats_wait_start(channel_t* channel)
+{
+    if (!channel->stats) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Counts a call that waited since start (from stats_wait_start)
+static void stats_blocked(channel_t* channel, bool send, uint64_t start)
+{
+    channel_counters_t* stats = channel->stats;
+    if (!stats) return;
+    uint64_t waited = stats_wait_start(channel) - start;
+    if (send) {
+        stats_add(&stats->blocked_sends, 1);
+        atomic_fetch_add_explicit(&stats->send_wait_ns, waited, memory_order_relaxed);
+    } else {
+        stats_add(&stats->blocked_receives, 1);
+        atomic_fetch_add_explicit(&stats->receive_wait_ns, waited, memory_order_relaxed);
+    }
+}
+
+static void stats_select_woken(channel_t* channel)
+{
+    if (channel->stats) stats_add(&channel->stats->select_wakeups, 1);
+}
+
+/*
+ * A channel that enables eventfds mirrors its readiness into two of them.
+ * The receive fd's counter is 1 (readable) while a receive would not block
+ * and 0 otherwise. The send fd's counter is 0 (writable) while a send would
+ * not block and EVENTS_UNWRITABLE otherwise, the one value that leaves an
+ * eventfd unwritable. Every operation that can change the readiness calls
+ * events_update afterwards, which reads the channel's state under the
+ * events lock and only touches an fd when what it shows is out of date:
+ * the last update reads the state after every change before it, so the fds
+ * always end up current, and a stream of operations that keeps the buffer
+ * neither empty nor full makes no system calls. Unbuffered channels call
+ * it with chan_mutex held, as their readiness lives in the parking queues.
+ */
+#define EVENTS_UNWRITABLE 0xfffffffffffffffeull
+
+struct channel_events {
+    futex_mutex_t lock;
+    int receive_fd;
+    int send_fd;
+    bool receive_raised; // under lock: the receive fd's counter is 1
+    bool send_raised;    // under lock: the send fd's counter is EVENTS_UNWRITABLE
+};
+
+// Moves an eventfd's counter from 0 to value (raise) or back to 0, unless it is there already
+static void events_set(int fd, bool* raised, bool raise, uint64_t value)
+{
+    if (*raised == raise) return;
+    uint64_t counter = value;
+    // Neither call can fail or block: the counter only moves between 0 and value
+    ssize_t done = raise ? write(fd, &counter, sizeof(counter)) : read(fd, &counter, sizeof(counter));
+    if (done == (ssize_t)sizeof(counter)) *raised = raise;
+}
+
+// Brings the channel's eventfds up to date after an operation that may have changed its readiness
+static void events_update(channel_t* channel)
+{
+    channel_events_t* events = channel->events;
+    if (!events) return;
+    futex_mutex_lock(&events->lock);
+    bool closed = channel->closed_flag;
+    bool can_receive, can_send;
+    if (channel->is_unbuffered) {
+        // A stale select record counts too; the hint is cleared once its select withdraws it
+        can_receive = channel->send_waiters.head != NULL;
+        can_send = channel->recv_waiters.head != NULL;
+    } else {
+        size_t size = buffer_current_size(channel->buffer);
+        can_receive = size > 0;
+        can_send = size < buffer_capacity(channel->buffer);
+    }
+    events_set(events->receive_fd, &events->receive_raised, closed || can_receive, 1);
+    events_set(events->send_fd, &events->send_raised, !(closed || can_send), EVENTS_UNWRITABLE);
+    futex_mutex_unlock(&events->lock);
+}
+
+/*
+ * A blocked select sleeps on a futex word of its own. It links one node per
+ * entry, taken from its own stack frame, into the selector list of each
+ * channel, so registering and unregistering never allocate or search.
+ * Notifying sets the word to 1 and wakes that one thread, so a select that
+ * has not gone to sleep yet sees the 1 and rescans instead of sleeping.
+ */
+static void wake_selector(futex_word_t* word)
 {
-    pthread_mutex_lock(&channel->select_list_mutex);
-    for (list_node_t* node = list_head(channel->send_selectors);
-         node; node = node->next)
-    {
-        sem_post((sem_t*)node->data);
+    atomic_store(&word->value, 1);
+    futex_wake(word, 1);
+}
+
+// Wakes every select in the list but the one sleeping on self (used for close and parked unbuffered threads)
+static void notify_selectors(channel_t* channel, list_t* selectors, futex_word_t* self)
+{
+    futex_mutex_lock(&channel->select_list_mutex);
+    for (list_node_t* node = list_head(selectors); node; node = node->next) {
+        if (node->data != self) {
+            wake_selector(node->data);
+            stats_select_woken(channel);
+        }
     }
-    pthread_mutex_unlock(&channel->select_list_mutex);
+    futex_mutex_unlock(&channel->select_list_mutex);
+}
+
+void notify_select_senders(channel_t* channel)
+{
+    notify_selectors(channel, channel->send_selectors, NULL);
 }
 
 void notify_select_receivers(channel_t* channel)
 {
-    pthread_mutex_lock(&channel->select_list_mutex);
-    for (list_node_t* node = list_head(channel->recv_selectors);
-         node; node = node->next)
-    {
-        sem_post((sem_t*)node->data);
+    notify_selectors(channel, channel->recv_selectors, NULL);
+}
+
+// Wakes the select at the front of the list and moves it to the back,
+// so consecutive items go to different selects
+static void wake_one_selector(channel_t* channel, list_t* selectors)
+{
+    futex_mutex_lock(&channel->select_list_mutex);
+    list_node_t* node = list_head(selectors);
+    if (node) {
+        list_unlink(selectors, node);
+        list_link(selectors, node, node->data);
+        wake_selector(node->data);
+        stats_select_woken(channel);
     }
-    pthread_mutex_unlock(&channel->select_list_mutex);
+    futex_mutex_unlock(&channel->select_list_mutex);
 }
 
 /* add/remove selector helpers */
-void add_select_sender(channel_t* channel, sem_t* sem)
+void add_select_sender(channel_t* channel, list_node_t* node, futex_word_t* word)
 {
-    pthread_mutex_lock(&channel->select_list_mutex);
-    list_insert(channel->send_selectors, sem);
-    pthread_mutex_unlock(&channel->select_list_mutex);
+    futex_mutex_lock(&channel->select_list_mutex);
+    list_link(channel->send_selectors, node, word);
+    atomic_fetch_add(&channel->send_select_count, 1);
+    futex_mutex_unlock(&channel->select_list_mutex);
 }
 
-void remove_select_sender(channel_t* channel, sem_t* sem)
+void remove_select_sender(channel_t* channel, list_node_t* node)
 {
-    pthread_mutex_lock(&channel->select_list_mutex);
-    list_remove(channel->send_selectors,
-                list_find(channel->send_selectors, sem));
-    pthread_mutex_unlock(&channel->select_list_mutex);
+    futex_mutex_lock(&channel->select_list_mutex);
+    list_unlink(channel->send_selectors, node);
+    atomic_fetch_sub(&channel->send_select_count, 1);
+    futex_mutex_unlock(&channel->select_list_mutex);
 }
 
-void add_select_receiver(channel_t* channel, sem_t* sem)
+void add_select_receiver(channel_t* channel, list_node_t* node, futex_word_t* word)
 {
-    pthread_mutex_lock(&channel->select_list_mutex);
-    list_insert(channel->recv_selectors, sem);
-    pthread_mutex_unlock(&channel->select_list_mutex);
+    futex_mutex_lock(&channel->select_list_mutex);
+    list_link(channel->recv_selectors, node, word);
+    atomic_fetch_add(&channel->recv_select_count, 1);
+    futex_mutex_unlock(&channel->select_list_mutex);
 }
 
-void remove_select_receiver(channel_t* channel, sem_t* sem)
+void remove_select_receiver(channel_t* channel, list_node_t* node)
 {
-    pthread_mutex_lock(&channel->select_list_mutex);
-    list_remove(channel->recv_selectors,
-                list_find(channel->recv_selectors, sem));
-    pthread_mutex_unlock(&channel->select_list_mutex);
+    futex_mutex_lock(&channel->select_list_mutex);
+    list_unlink(channel->recv_selectors, node);
+    atomic_fetch_sub(&channel->recv_select_count, 1);
+    futex_mutex_unlock(&channel->select_list_mutex);
 }
 
-static enum channel_status unbuffered_sync(channel_t* channel, int op, void** data_ptr)
+/*
+ * Buffered channels never take chan_mutex. A thread that finds the buffer
+ * full (or empty) enters the matching wait queue, retries, and only then
+ * sleeps. The other side publishes its value or free slot with a seq_cst
+ * store (see buffer.c) before waking the queue, so either the retry
+ * succeeds or the wake reaches the waiter. Selectors are found the same
+ * way through the select counts, so the select list is only locked while
+ * some select is registered.
+ */
+
+// Wakes a blocked receiver and one receiving select after n values were added
+static void buffered_added(channel_t* channel, size_t n)
 {
-stage0:
-    if (channel->unbuf_stage == 0) {
-        channel->unbuf_stage     = 1;
-        channel->active_unbuf_op = op;
-        channel->unbuf_data      = data_ptr;
+    stats_sent(channel, n);
+    events_update(channel);
+    waitq_wake_one(&channel->not_empty);
+    if (atomic_load(&channel->recv_select_count) > 0) {
+        wake_one_selector(channel, channel->recv_selectors);
+    }
+}
+
+// Wakes a blocked sender and one sending select after n values were removed
+static void buffered_removed(channel_t* channel, size_t n)
+{
+    stats_received(channel, n);
+    events_update(channel);
+    waitq_wake_one(&channel->not_full);
+    if (atomic_load(&channel->send_select_count) > 0) {
+        wake_one_selector(channel, channel->send_selectors);
+    }
+}
 
-        if (op == unbuf_op_send) {
-            notify_select_receivers(channel);
-            pthread_cond_broadcast(&channel->cond_not_empty);
+// Adds all n items to a buffered channel in order, blocking while the buffer is full
+// Gives up with TIMEOUT_ERROR once deadline passes (NULL blocks without a deadline)
+static enum channel_status buffered_send(channel_t* channel, void** items, size_t n, const struct timespec* deadline)
+{
+    if (is_typed(channel)) return GENERIC_ERROR;
+    enum channel_status status = SUCCESS;
+    size_t sent = 0;
+    bool waiting = false;
+    bool timed_out = false;
+    uint32_t word = 0;
+    uint64_t wait_start = 0;
+    while (sent < n) {
+        if (channel->closed_flag) {
+            status = CLOSED_ERROR;
+            break;
+        }
+        size_t added = buffer_add_n(channel->buffer, items + sent, n - sent);
+        if (added > 0) {
+            sent += added;
+            buffered_added(channel, added);
+            continue;
+        }
+        // A timed out waiter has retried once after its last wait
+        if (timed_out) {
+            status = TIMEOUT_ERROR;
+            break;
+        }
+        if (waiting) {
+            timed_out = !waitq_wait_until(&channel->not_full, &word, deadline);
         } else {
-            notify_select_senders(channel);
-            pthread_cond_broadcast(&channel->cond_not_full);
+            word = waitq_enter(&channel->not_full);
+            waiting = true;
+            wait_start = stats_wait_start(channel);
         }
+    }
+    if (waiting) {
+        waitq_leave(&channel->not_full);
+        stats_blocked(channel, true, wait_start);
+        // Pass the wake on if other senders can still make progress
+        if (status != CLOSED_ERROR && buffer_current_size(channel->buffer) < buffer_capacity(channel->buffer)) {
+            waitq_wake_one(&channel->not_full);
+        }
+    }
+    return status;
+}
 
-        pthread_cond_wait(&channel->rendezvous_complete_cv,
-                          &channel->chan_mutex);
-
-        channel->unbuf_stage = 0;
-        pthread_cond_broadcast(&channel->rendezvous_wait_cv);
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return SUCCESS;
+// Removes between 1 and max items from a buffered channel, blocking while the buffer is empty
+// Gives up with TIMEOUT_ERROR once deadline passes (NULL blocks without a deadline)
+static enum channel_status buffered_receive(channel_t* channel, void** out, size_t max, size_t* got,
+                                            const struct timespec* deadline)
+{
+    *got = 0;
+    if (is_typed(channel)) return GENERIC_ERROR;
+    enum channel_status status;
+    bool waiting = false;
+    bool timed_out = false;
+    uint32_t word = 0;
+    uint64_t wait_start = 0;
+    while (true) {
+        if (channel->closed_flag) {
+            status = CLOSED_ERROR;
+            break;
+        }
+        *got = buffer_remove_n(channel->buffer, out, max);
+        if (*got > 0) {
+            status = SUCCESS;
+            break;
+        }
+        if (timed_out) {
+            status = TIMEOUT_ERROR;
+            break;
+        }
+        if (waiting) {
+            timed_out = !waitq_wait_until(&channel->not_empty, &word, deadline);
+        } else {
+            word = waitq_enter(&channel->not_empty);
+            waiting = true;
+            wait_start = stats_wait_start(channel);
+        }
     }
-    else if (channel->unbuf_stage == 1) {
-        if (channel->active_unbuf_op == op) {
-            if (op == unbuf_op_send)  channel->waiting_senders++;
-            else                        channel->waiting_receivers++;
+    if (waiting) {
+        waitq_leave(&channel->not_empty);
+        stats_blocked(channel, false, wait_start);
+        // Pass the wake on if other receivers can still make progress
+        if (status != CLOSED_ERROR && buffer_current_size(channel->buffer) > 0) {
+            waitq_wake_one(&channel->not_empty);
+        }
+    }
+    if (status == SUCCESS) {
+        buffered_removed(channel, *got);
+    }
+    return status;
+}
 
-            pthread_cond_wait(&channel->rendezvous_wait_cv,
-                              &channel->chan_mutex);
+/*
+ * Unbuffered channels pair threads through two FIFO queues of parking
+ * records, one for senders and one for receivers. A thread that finds no
+ * partner links a record on its own stack into its queue and sleeps on the
+ * record's state word. The partner that comes later unlinks the oldest
+ * record, copies the value straight through it and wakes exactly that
+ * thread. Both queues are only touched under chan_mutex.
+ *
+ * A select that finds no entry ready parks one record on each of its
+ * unbuffered entries at once. The records share an unbuf_select_t: the
+ * first partner to move its state from UNBUF_WAITING to UNBUF_DONE owns
+ * the select, and the select's other records go stale. Partners drop stale
+ * records when they meet them, and the select withdraws whatever is left
+ * after it wakes up. Scanning never parks, so selects on both ends of a
+ * channel can no longer wait for each other in a cycle.
+ */
+
+// States of a parking record (and of a parked select)
+#define UNBUF_WAITING   0
+#define UNBUF_DONE      1
+#define UNBUF_CLOSED    2
+#define UNBUF_WITHDRAWN 3 // the select woke up before a partner took one of its records
+
+typedef struct {
+    _Atomic uint32_t state;
+    futex_word_t* word;     // the select's wake word
+    size_t index;           // the entry a partner completed, written under that entry's chan_mutex
+} unbuf_select_t;
+
+struct unbuf_waiter {
+    unbuf_waiter_t* prev;
+    unbuf_waiter_t* next;
+    void** data;            // sender: the value to hand over; receiver: where the value goes
+    futex_word_t state;     // the parked thread sleeps on it
+    unbuf_select_t* select; // the select that parked this record, NULL for a send or receive
+    size_t index;           // the select's entry
+    bool queued;            // a select's record is still linked into its queue
+};
+
+// Appends waiter to the back of queue
+static void unbuf_enqueue(unbuf_queue_t* queue, unbuf_waiter_t* waiter)
+{
+    waiter->prev = queue->tail;
+    waiter->next = NULL;
+    if (queue->tail) queue->tail->next = waiter;
+    else             queue->head = waiter;
+    queue->tail = waiter;
+}
 
-            if (op == unbuf_op_send)  channel->waiting_senders--;
-            else                        channel->waiting_receivers--;
+// Removes waiter from queue
+static void unbuf_unlink(unbuf_queue_t* queue, unbuf_waiter_t* waiter)
+{
+    if (waiter->prev) waiter->prev->next = waiter->next;
+    else              queue->head = waiter->next;
+    if (waiter->next) waiter->next->prev = waiter->prev;
+    else              queue->tail = waiter->prev;
+}
 
-            goto stage0;
-        }
-        /* complementary operation */
-        if (op == unbuf_op_receive) {
-            *data_ptr = *channel->unbuf_data;
-        } else { /* SEND */
-            *channel->unbuf_data = *data_ptr;
+// Unlinks the oldest record a partner can still complete, dropping stale select records on the way
+// A select's record is only returned once the caller owns that select
+static unbuf_waiter_t* unbuf_claim(unbuf_queue_t* queue)
+{
+    unbuf_waiter_t* waiter;
+    while ((waiter = queue->head)) {
+        unbuf_unlink(queue, waiter);
+        if (!waiter->select) return waiter;
+        waiter->queued = false;
+        uint32_t expected = UNBUF_WAITING;
+        if (atomic_compare_exchange_strong(&waiter->select->state, &expected, UNBUF_DONE)) {
+            waiter->select->index = waiter->index;
+            return waiter;
         }
+    }
+    return NULL;
+}
 
-        channel->unbuf_stage = 2;
-        pthread_cond_signal(&channel->rendezvous_complete_cv);
+// Fails every thread parked in queue after a close
+// Parked selects are only unlinked; channel_close notifies them and they find the channel closed when they rescan
+static void unbuf_close_queue(unbuf_queue_t* queue)
+{
+    unbuf_waiter_t* waiter = queue->head;
+    while (waiter) {
+        // The record may be gone as soon as its thread sees the new state
+        unbuf_waiter_t* next = waiter->next;
+        if (waiter->select) {
+            waiter->queued = false;
+        } else {
+            futex_hold(&waiter->state);
+            atomic_store(&waiter->state.value, UNBUF_CLOSED);
+            futex_wake_held(&waiter->state, 1);
+        }
+        waiter = next;
+    }
+    queue->head = NULL;
+    queue->tail = NULL;
+}
 
-        pthread_mutex_unlock(&channel->chan_mutex);
+// Completes op on an unbuffered channel; called with chan_mutex held and always unlocks it
+// Without blocking, it returns CHANNEL_FULL (CHANNEL_EMPTY) when no partner is parked
+// Gives up with TIMEOUT_ERROR once deadline passes (NULL blocks without a deadline)
+static enum channel_status unbuffered_sync(channel_t* channel, int op, void** data_ptr, bool blocking,
+                                           const struct timespec* deadline)
+{
+    if (channel->closed_flag) {
+        futex_mutex_unlock(&channel->chan_mutex);
+        return CLOSED_ERROR;
+    }
+    bool send = (op == unbuf_op_send);
+
+    // Hand the value to the partner that has waited longest
+    unbuf_queue_t* partners = send ? &channel->recv_waiters : &channel->send_waiters;
+    unbuf_waiter_t* partner = unbuf_claim(partners);
+    if (partner) {
+        if (send) *partner->data = *data_ptr;
+        else      *data_ptr = *partner->data;
+        // The word lives on the partner's stack, and the partner may return as soon as it sees the
+        // new value, so it is held until the wake is done (see futex_hold)
+        bool partner_select = (partner->select != NULL);
+        futex_word_t* word = partner_select ? partner->select->word : &partner->state;
+        futex_hold(word);
+        atomic_store(&word->value, partner_select ? 1 : UNBUF_DONE);
+        events_update(channel);
+        futex_mutex_unlock(&channel->chan_mutex);
+        futex_wake_held(word, 1);
+        // One handoff completes a send and a receive
+        stats_sent(channel, 1);
+        stats_received(channel, 1);
+        if (partner_select) stats_select_woken(channel);
         return SUCCESS;
     }
-    else { /* stage 2 */
-        if (op == unbuf_op_send)  channel->waiting_senders++;
-        else                        channel->waiting_receivers++;
-
-        pthread_cond_wait(&channel->rendezvous_wait_cv,
-                          &channel->chan_mutex);
 
-        if (op == unbuf_op_send)  channel->waiting_senders--;
-        else                        channel->waiting_receivers--;
+    if (!blocking) {
+        // Claiming may have dropped stale select records
+        events_update(channel);
+        futex_mutex_unlock(&channel->chan_mutex);
+        return send ? CHANNEL_FULL : CHANNEL_EMPTY;
+    }
 
-        goto stage0;
+    atomic_size_t* partner_selects = send ? &channel->recv_select_count : &channel->send_select_count;
+    unbuf_waiter_t self = {.data = data_ptr};
+    futex_word_init(&self.state, UNBUF_WAITING);
+    unbuf_enqueue(send ? &channel->send_waiters : &channel->recv_waiters, &self);
+    // Selects on the other side rescan and find the record
+    if (atomic_load(partner_selects) > 0) {
+        if (send) notify_select_receivers(channel);
+        else      notify_select_senders(channel);
     }
+    events_update(channel);
+    futex_mutex_unlock(&channel->chan_mutex);
 
-    return GENERIC_ERROR;
+    uint64_t wait_start = stats_wait_start(channel);
+    bool timed_out = false;
+    while (atomic_load(&self.state.value) == UNBUF_WAITING && !timed_out) {
+        timed_out = !futex_wait_until(&self.state, UNBUF_WAITING, deadline);
+    }
+    stats_blocked(channel, send, wait_start);
+    if (timed_out) {
+        futex_mutex_lock(&channel->chan_mutex);
+        // A record still waiting is still queued, as partners and close change the state under chan_mutex
+        bool withdrawn = (atomic_load(&self.state.value) == UNBUF_WAITING);
+        if (withdrawn) {
+            unbuf_unlink(send ? &channel->send_waiters : &channel->recv_waiters, &self);
+            events_update(channel);
+        }
+        futex_mutex_unlock(&channel->chan_mutex);
+        if (withdrawn) return TIMEOUT_ERROR;
+    }
+    // The partner or close that set the state may still hold the record's word
+    futex_retire(&self.state);
+    return atomic_load(&self.state.value) == UNBUF_DONE ? SUCCESS : CLOSED_ERROR;
 }
 
 // Writes data to the given channel
@@ -167,30 +589,12 @@ stage0:
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_send(channel_t* channel, void* data)
 {
-    if (pthread_mutex_lock(&channel->chan_mutex) != 0) return GENERIC_ERROR;
-
-    if (channel->closed_flag) {
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CLOSED_ERROR;
-    }
-
-    if (channel->is_unbuffered) {
-        return unbuffered_sync(channel, unbuf_op_send, &data);
-    }
-
-    /* buffered */
-    while (buffer_add(channel->buffer, data) == BUFFER_ERROR) {
-        if (channel->closed_flag) {
-            pthread_mutex_unlock(&channel->chan_mutex);
-            return CLOSED_ERROR;
-        }
-        pthread_cond_wait(&channel->cond_not_full, &channel->chan_mutex);
+    if (!channel->is_unbuffered) {
+        return buffered_send(channel, &data, 1, NULL);
     }
 
-    pthread_mutex_unlock(&channel->chan_mutex);
-    notify_select_receivers(channel);
-    pthread_cond_signal(&channel->cond_not_empty);
-    return SUCCESS;
+    futex_mutex_lock(&channel->chan_mutex);
+    return unbuffered_sync(channel, unbuf_op_send, &data, true, NULL);
 }
 
 // Reads data from the given channel and stores it in the function's input parameter, data (Note that it is a double pointer)
@@ -201,30 +605,13 @@ enum channel_status channel_send(channel_t* channel, void* data)
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_receive(channel_t* channel, void** data)
 {
-    if (pthread_mutex_lock(&channel->chan_mutex) != 0) return GENERIC_ERROR;
-
-    if (channel->closed_flag) {
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CLOSED_ERROR;
-    }
-
-    if (channel->is_unbuffered) {
-        return unbuffered_sync(channel, unbuf_op_receive, data);
-    }
-
-    /* buffered */
-    while (buffer_remove(channel->buffer, data) == BUFFER_ERROR) {
-        if (channel->closed_flag) {
-            pthread_mutex_unlock(&channel->chan_mutex);
-            return CLOSED_ERROR;
-        }
-        pthread_cond_wait(&channel->cond_not_empty, &channel->chan_mutex);
+    if (!channel->is_unbuffered) {
+        size_t got;
+        return buffered_receive(channel, data, 1, &got, NULL);
     }
 
-    pthread_mutex_unlock(&channel->chan_mutex);
-    notify_select_senders(channel);
-    pthread_cond_signal(&channel->cond_not_full);
-    return SUCCESS;
+    futex_mutex_lock(&channel->chan_mutex);
+    return unbuffered_sync(channel, unbuf_op_receive, data, true, NULL);
 }
 
 // Writes data to the given channel
@@ -235,90 +622,325 @@ enum channel_status channel_receive(channel_t* channel, void** data)
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_non_blocking_send(channel_t* channel, void* data)
 {
-    if (pthread_mutex_lock(&channel->chan_mutex) != 0) return GENERIC_ERROR;
+    if (!channel->is_unbuffered) {
+        if (is_typed(channel)) return GENERIC_ERROR;
+        if (channel->closed_flag) return CLOSED_ERROR;
+        if (buffer_add(channel->buffer, data) == BUFFER_ERROR) return CHANNEL_FULL;
+        buffered_added(channel, 1);
+        return SUCCESS;
+    }
 
-    if (channel->closed_flag) {
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CLOSED_ERROR;
+    futex_mutex_lock(&channel->chan_mutex);
+    return unbuffered_sync(channel, unbuf_op_send, &data, false, NULL);
+}
+
+// Reads data from the given channel and stores it in the function's input parameter data (Note that it is a double pointer)
+// This is a non-blocking call i.e., the function simply returns if the channel is empty
+// Returns SUCCESS for successful retrieval of data,
+// CHANNEL_EMPTY if the channel is empty and nothing was stored in data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_receive(channel_t* channel, void** data)
+{
+    if (!channel->is_unbuffered) {
+        if (is_typed(channel)) return GENERIC_ERROR;
+        if (channel->closed_flag) return CLOSED_ERROR;
+        if (buffer_remove(channel->buffer, data) == BUFFER_ERROR) return CHANNEL_EMPTY;
+        buffered_removed(channel, 1);
+        return SUCCESS;
     }
 
-    if (channel->is_unbuffered) {
-        while (channel->waiting_receivers > 0 &&
-               channel->unbuf_stage == 0 &&
-               !list_count(channel->recv_selectors))
-        {
-            pthread_cond_wait(&channel->cond_not_empty, &channel->chan_mutex);
-        }
+    futex_mutex_lock(&channel->chan_mutex);
+    return unbuffered_sync(channel, unbuf_op_receive, data, false, NULL);
+}
 
-        if ((channel->unbuf_stage == 1 &&
-             channel->active_unbuf_op == unbuf_op_receive) ||
-            list_count(channel->recv_selectors))
-        {
-            return unbuffered_sync(channel, unbuf_op_send, &data);
+// Writes the n messages in items to the given channel in order
+// This is a blocking call i.e., the function only returns once all n messages have been written
+// On a buffered channel every run of messages that fits costs one buffer operation and one wakeup
+// Returns SUCCESS for successfully writing all messages,
+// CLOSED_ERROR if the channel is closed (messages written before the close stay in the channel), and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_batch(channel_t* channel, void** items, size_t n)
+{
+    if (!channel->is_unbuffered) {
+        return buffered_send(channel, items, n, NULL);
+    }
+    for (size_t i = 0; i < n; i++) {
+        enum channel_status status = channel_send(channel, items[i]);
+        if (status != SUCCESS) {
+            return status;
         }
-
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CHANNEL_FULL;
     }
+    return SUCCESS;
+}
 
-    /* buffered */
-    if (buffer_add(channel->buffer, data) == BUFFER_ERROR) {
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CHANNEL_FULL;
+// Reads between 1 and max messages from the given channel into out and stores the count in got
+// This is a blocking call i.e., the function waits till the channel has some data to read,
+// then takes as much as is available without waiting again
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_batch(channel_t* channel, void** out, size_t max, size_t* got)
+{
+    *got = 0;
+    if (max == 0) return GENERIC_ERROR;
+    if (!channel->is_unbuffered) {
+        return buffered_receive(channel, out, max, got, NULL);
+    }
+    enum channel_status status = channel_receive(channel, &out[0]);
+    if (status != SUCCESS) {
+        return status;
+    }
+    *got = 1;
+    while (*got < max && channel_non_blocking_receive(channel, &out[*got]) == SUCCESS) {
+        (*got)++;
     }
-
-    pthread_mutex_unlock(&channel->chan_mutex);
-    notify_select_receivers(channel);
-    pthread_cond_signal(&channel->cond_not_empty);
     return SUCCESS;
 }
 
-// Reads data from the given channel and stores it in the function's input parameter data (Note that it is a double pointer)
-// This is a non-blocking call i.e., the function simply returns if the channel is empty
-// Returns SUCCESS for successful retrieval of data,
-// CHANNEL_EMPTY if the channel is empty and nothing was stored in data,
+// Writes as many of the n messages in items as the channel accepts right now, in order, and stores the count in sent
+// This is a non-blocking call i.e., the function simply returns once the channel is full
+// Returns SUCCESS if at least one message was written,
+// CHANNEL_FULL if the channel is full and nothing was written,
 // CLOSED_ERROR if the channel is closed, and
 // GENERIC_ERROR on encountering any other generic error of any sort
-enum channel_status channel_non_blocking_receive(channel_t* channel, void** data)
+enum channel_status channel_non_blocking_send_batch(channel_t* channel, void** items, size_t n, size_t* sent)
 {
-    if (pthread_mutex_lock(&channel->chan_mutex) != 0) return GENERIC_ERROR;
+    *sent = 0;
+    if (n == 0) return GENERIC_ERROR;
+    if (!channel->is_unbuffered) {
+        if (is_typed(channel)) return GENERIC_ERROR;
+        if (channel->closed_flag) return CLOSED_ERROR;
+        *sent = buffer_add_n(channel->buffer, items, n);
+        if (*sent == 0) return CHANNEL_FULL;
+        buffered_added(channel, *sent);
+        return SUCCESS;
+    }
+    enum channel_status status = CHANNEL_FULL;
+    while (*sent < n && (status = channel_non_blocking_send(channel, items[*sent])) == SUCCESS) {
+        (*sent)++;
+    }
+    return *sent > 0 ? SUCCESS : status;
+}
 
-    if (channel->closed_flag) {
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CLOSED_ERROR;
+// Reads as many messages (up to max) as the channel holds right now into out and stores the count in got
+// This is a non-blocking call i.e., the function simply returns once the channel is empty
+// Returns SUCCESS if at least one message was read,
+// CHANNEL_EMPTY if the channel is empty and nothing was read,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_receive_batch(channel_t* channel, void** out, size_t max, size_t* got)
+{
+    *got = 0;
+    if (max == 0) return GENERIC_ERROR;
+    if (!channel->is_unbuffered) {
+        if (is_typed(channel)) return GENERIC_ERROR;
+        if (channel->closed_flag) return CLOSED_ERROR;
+        *got = buffer_remove_n(channel->buffer, out, max);
+        if (*got == 0) return CHANNEL_EMPTY;
+        buffered_removed(channel, *got);
+        return SUCCESS;
+    }
+    enum channel_status status = CHANNEL_EMPTY;
+    while (*got < max && (status = channel_non_blocking_receive(channel, &out[*got])) == SUCCESS) {
+        (*got)++;
     }
+    return *got > 0 ? SUCCESS : status;
+}
 
-    if (channel->is_unbuffered) {
-        while (channel->waiting_senders > 0 &&
-               channel->unbuf_stage == 0 &&
-               !list_count(channel->send_selectors))
-        {
-            pthread_cond_wait(&channel->cond_not_full, &channel->chan_mutex);
-        }
+/*
+ * Typed channels block exactly like the other buffered channels, except
+ * that claiming a slot (reserve/acquire) and handing it over
+ * (commit/release) are separate steps, so the wakeup for the other side
+ * is sent by commit and release.
+ */
 
-        if ((channel->unbuf_stage == 1 &&
-             channel->active_unbuf_op == unbuf_op_send) ||
-            list_count(channel->send_selectors))
-        {
-            return unbuffered_sync(channel, unbuf_op_receive, data);
+// Claims a free slot of a typed channel, waiting for one if blocking
+static enum channel_status typed_reserve(channel_t* channel, channel_slot_t* slot, bool blocking)
+{
+    if (!is_typed(channel)) return GENERIC_ERROR;
+    enum channel_status status;
+    bool waiting = false;
+    uint32_t word = 0;
+    uint64_t wait_start = 0;
+    while (true) {
+        if (channel->closed_flag) {
+            status = CLOSED_ERROR;
+            break;
+        }
+        slot->data = buffer_reserve(channel->buffer, &slot->pos);
+        if (slot->data) {
+            status = SUCCESS;
+            break;
+        }
+        if (!blocking) {
+            status = CHANNEL_FULL;
+            break;
+        }
+        if (waiting) {
+            word = waitq_wait(&channel->not_full, word);
+        } else {
+            word = waitq_enter(&channel->not_full);
+            waiting = true;
+            wait_start = stats_wait_start(channel);
+        }
+    }
+    if (waiting) {
+        waitq_leave(&channel->not_full);
+        stats_blocked(channel, true, wait_start);
+        // Pass the wake on if other senders can still make progress
+        if (status == SUCCESS && buffer_current_size(channel->buffer) < buffer_capacity(channel->buffer)) {
+            waitq_wake_one(&channel->not_full);
         }
-
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CHANNEL_EMPTY;
     }
+    return status;
+}
 
-    /* buffered */
-    if (buffer_remove(channel->buffer, data) == BUFFER_ERROR) {
-        pthread_mutex_unlock(&channel->chan_mutex);
-        return CHANNEL_EMPTY;
+// Claims the oldest message of a typed channel, waiting for one if blocking
+static enum channel_status typed_acquire(channel_t* channel, channel_slot_t* slot, bool blocking)
+{
+    if (!is_typed(channel)) return GENERIC_ERROR;
+    enum channel_status status;
+    bool waiting = false;
+    uint32_t word = 0;
+    uint64_t wait_start = 0;
+    while (true) {
+        if (channel->closed_flag) {
+            status = CLOSED_ERROR;
+            break;
+        }
+        slot->data = buffer_acquire(channel->buffer, &slot->pos);
+        if (slot->data) {
+            status = SUCCESS;
+            break;
+        }
+        if (!blocking) {
+            status = CHANNEL_EMPTY;
+            break;
+        }
+        if (waiting) {
+            word = waitq_wait(&channel->not_empty, word);
+        } else {
+            word = waitq_enter(&channel->not_empty);
+            waiting = true;
+            wait_start = stats_wait_start(channel);
+        }
     }
+    if (waiting) {
+        waitq_leave(&channel->not_empty);
+        stats_blocked(channel, false, wait_start);
+        // Pass the wake on if other receivers can still make progress
+        if (status == SUCCESS && buffer_current_size(channel->buffer) > 0) {
+            waitq_wake_one(&channel->not_empty);
+        }
+    }
+    return status;
+}
 
-    pthread_mutex_unlock(&channel->chan_mutex);
-    notify_select_senders(channel);
-    pthread_cond_signal(&channel->cond_not_full);
+// Copies value into a typed channel slot and publishes it
+static enum channel_status typed_send(channel_t* channel, const void* value, bool blocking)
+{
+    channel_slot_t slot;
+    enum channel_status status = typed_reserve(channel, &slot, blocking);
+    if (status != SUCCESS) return status;
+    memcpy(slot.data, value, channel->buffer->elem_size);
+    return channel_commit(channel, &slot);
+}
+
+// Copies the oldest message of a typed channel into value and frees its slot
+static enum channel_status typed_receive(channel_t* channel, void* value, bool blocking)
+{
+    channel_slot_t slot;
+    enum channel_status status = typed_acquire(channel, &slot, blocking);
+    if (status != SUCCESS) return status;
+    memcpy(value, slot.data, channel->buffer->elem_size);
+    return channel_release(channel, &slot);
+}
+
+// Copies the elem_size-byte message at value into a typed channel
+// This is a blocking call i.e., the function only returns once the message is in the channel
+// Returns SUCCESS for successfully writing the message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_send_value(channel_t* channel, const void* value)
+{
+    return typed_send(channel, value, true);
+}
+
+// Copies the oldest message of a typed channel into the elem_size bytes at value
+// This is a blocking call i.e., the function waits till the channel has some data to read
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_receive_value(channel_t* channel, void* value)
+{
+    return typed_receive(channel, value, true);
+}
+
+// Non-blocking versions of channel_send_value and channel_receive_value
+// They return CHANNEL_FULL or CHANNEL_EMPTY instead of waiting
+enum channel_status channel_non_blocking_send_value(channel_t* channel, const void* value)
+{
+    return typed_send(channel, value, false);
+}
+
+enum channel_status channel_non_blocking_receive_value(channel_t* channel, void* value)
+{
+    return typed_receive(channel, value, false);
+}
+
+// Reserves the next free slot of a typed channel so the message can be written in place at slot->data
+// Receivers see the message once channel_commit is called; every reserved slot must be committed
+// This is a blocking call i.e., the function waits till the channel has a free slot
+// Returns SUCCESS for successfully reserving a slot,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_reserve(channel_t* channel, channel_slot_t* slot)
+{
+    return typed_reserve(channel, slot, true);
+}
+
+// Publishes the message written into a slot reserved with channel_reserve
+// Returns SUCCESS (a slot is published even if the channel was closed in between)
+enum channel_status channel_commit(channel_t* channel, channel_slot_t* slot)
+{
+    buffer_commit(channel->buffer, slot->pos);
+    buffered_added(channel, 1);
     return SUCCESS;
 }
 
+// Acquires the oldest message of a typed channel so it can be read in place at slot->data
+// The slot is only reused after channel_release is called; every acquired slot must be released
+// This is a blocking call i.e., the function waits till the channel has some data to read
+// Returns SUCCESS for successfully acquiring a message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_acquire(channel_t* channel, channel_slot_t* slot)
+{
+    return typed_acquire(channel, slot, true);
+}
+
+// Returns a slot acquired with channel_acquire to the senders
+// Returns SUCCESS
+enum channel_status channel_release(channel_t* channel, channel_slot_t* slot)
+{
+    buffer_release(channel->buffer, slot->pos);
+    buffered_removed(channel, 1);
+    return SUCCESS;
+}
+
+// Non-blocking versions of channel_reserve and channel_acquire
+// They return CHANNEL_FULL or CHANNEL_EMPTY instead of waiting
+enum channel_status channel_non_blocking_reserve(channel_t* channel, channel_slot_t* slot)
+{
+    return typed_reserve(channel, slot, false);
+}
+
+enum channel_status channel_non_blocking_acquire(channel_t* channel, channel_slot_t* slot)
+{
+    return typed_acquire(channel, slot, false);
+}
+
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
 // Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
 // Returns SUCCESS if close is successful,
@@ -326,23 +948,24 @@ enum channel_status channel_non_blocking_receive(channel_t* channel, void** data
 // GENERIC_ERROR in any other error case
 enum channel_status channel_close(channel_t* channel)
 {
-    if (pthread_mutex_lock(&channel->chan_mutex) != 0) return GENERIC_ERROR;
+    futex_mutex_lock(&channel->chan_mutex);
 
     if (channel->closed_flag) {
-        pthread_mutex_unlock(&channel->chan_mutex);
+        futex_mutex_unlock(&channel->chan_mutex);
         return CLOSED_ERROR;
     }
 
     channel->closed_flag = true;
-    pthread_mutex_unlock(&channel->chan_mutex);
+    unbuf_close_queue(&channel->send_waiters);
+    unbuf_close_queue(&channel->recv_waiters);
+    events_update(channel);
+    futex_mutex_unlock(&channel->chan_mutex);
 
     /* wake everything up */
     notify_select_receivers(channel);
     notify_select_senders(channel);
-    pthread_cond_broadcast(&channel->cond_not_empty);
-    pthread_cond_broadcast(&channel->cond_not_full);
-    pthread_cond_broadcast(&channel->rendezvous_wait_cv);
-    pthread_cond_broadcast(&channel->rendezvous_complete_cv);
+    waitq_wake_all(&channel->not_full);
+    waitq_wake_all(&channel->not_empty);
 
     return SUCCESS;
 }
@@ -356,152 +979,426 @@ enum channel_status channel_destroy(channel_t* channel)
 {
     if (!channel->closed_flag) return DESTROY_ERROR;
 
-    /* condition variables */
-    pthread_cond_destroy(&channel->cond_not_empty);
-    pthread_cond_destroy(&channel->cond_not_full);
-    pthread_cond_destroy(&channel->rendezvous_wait_cv);
-    pthread_cond_destroy(&channel->rendezvous_complete_cv);
-
-    /* mutexes */
-    pthread_mutex_destroy(&channel->chan_mutex);
-    pthread_mutex_destroy(&channel->select_list_mutex);
-
     /* buffer & selector lists */
     if (!channel->is_unbuffered) buffer_free(channel->buffer);
     list_destroy(channel->send_selectors);
     list_destroy(channel->recv_selectors);
 
+    free(channel->stats);
+    if (channel->events) {
+        close(channel->events->receive_fd);
+        close(channel->events->send_fd);
+        free(channel->events);
+    }
     free(channel);
     return SUCCESS;
 }
 
-static void init_select(select_t* entries, size_t count, sem_t* sem)
+// Selects with at most this many entries keep their list nodes on the stack
+#define SELECT_STACK_NODES 128
+
+static void init_select(select_t* entries, size_t count, list_node_t* nodes, futex_word_t* word)
 {
     for (size_t i = 0; i < count; ++i) {
-        if (entries[i].dir == SEND) add_select_sender(entries[i].channel, sem);
-        else                        add_select_receiver(entries[i].channel, sem);
+        if (entries[i].dir == SEND) add_select_sender(entries[i].channel, &nodes[i], word);
+        else                        add_select_receiver(entries[i].channel, &nodes[i], word);
     }
 }
 
-static void cleanup_select(select_t* entries, size_t count, sem_t* sem)
+// Unregisters the select and passes on any wake it may have absorbed:
+// a buffered channel that is still ready wakes the next select waiting on it
+static void cleanup_select(select_t* entries, size_t count, list_node_t* nodes)
 {
     for (size_t i = 0; i < count; ++i) {
-        if (entries[i].dir == SEND)
-            remove_select_sender(entries[i].channel, sem);
-        else
-            remove_select_receiver(entries[i].channel, sem);
+        channel_t* channel = entries[i].channel;
+        if (entries[i].dir == SEND) {
+            remove_select_sender(channel, &nodes[i]);
+            if (!channel->is_unbuffered && atomic_load(&channel->send_select_count) > 0 &&
+                buffer_current_size(channel->buffer) < buffer_capacity(channel->buffer))
+            {
+                wake_one_selector(channel, channel->send_selectors);
+            }
+        } else {
+            remove_select_receiver(channel, &nodes[i]);
+            if (!channel->is_unbuffered && atomic_load(&channel->recv_select_count) > 0 &&
+                buffer_current_size(channel->buffer) > 0)
+            {
+                wake_one_selector(channel, channel->recv_selectors);
+            }
+        }
     }
 }
 
-// Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
-// This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
-// If multiple options are available, it selects the first option and performs its corresponding action
-// If no channel is available, the call is blocked and waits till it finds a channel which supports its required operation
-// Once an operation has been successfully performed, select should set selected_index to the index of the channel that performed the operation and then return SUCCESS
-// In the event that a channel is closed or encounters any error, the error should be propagated and returned through select
-// Additionally, selected_index is set to the index of the channel that generated the error
-enum channel_status channel_select(select_t* entries, size_t count, size_t* sel_idx)
+// Advances the policy's xorshift64 generator
+static uint64_t select_rand(select_policy_t* policy)
 {
-    if (count == 0 || !entries || !sel_idx) return GENERIC_ERROR;
+    uint64_t x = policy->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    policy->rng = x;
+    return x;
+}
 
-    pthread_mutex_t local_mutex;
-    sem_t           local_sem;
+// Returns the entry a scan starts at
+static size_t select_start(select_policy_t* policy, size_t count)
+{
+    if (!policy) return 0;
+    switch (policy->mode) {
+    case SELECT_ROUND_ROBIN:
+        return policy->next < count ? policy->next : 0;
+    case SELECT_RANDOM:
+        return (size_t)(select_rand(policy) % count);
+    case SELECT_WEIGHTED: {
+        uint64_t total = 0;
+        for (size_t i = 0; i < count; ++i) total += policy->weights[i];
+        if (total == 0) return 0;
+        uint64_t pick = select_rand(policy) % total;
+        for (size_t i = 0; i < count; ++i) {
+            if (pick < policy->weights[i]) return i;
+            pick -= policy->weights[i];
+        }
+        return 0;
+    }
+    default:
+        return 0;
+    }
+}
 
-    pthread_mutex_init(&local_mutex, NULL);
-    sem_init(&local_sem, 0, 0);
+// Parks a record for every unbuffered entry and tells the selects on the other side to rescan
+// Returns false if the select has no unbuffered entries
+static bool select_park(select_t* entries, size_t count, unbuf_waiter_t* records, unbuf_select_t* parked)
+{
+    bool any = false;
+    atomic_store(&parked->state, UNBUF_WAITING);
+    for (size_t i = 0; i < count; ++i) {
+        channel_t* channel = entries[i].channel;
+        if (!channel->is_unbuffered) continue;
+        bool send = (entries[i].dir == SEND);
+        unbuf_waiter_t* record = &records[i];
+        record->data   = &entries[i].data;
+        record->select = parked;
+        record->index  = i;
+        futex_mutex_lock(&channel->chan_mutex);
+        // A closed channel completes the entry on the next scan
+        record->queued = !channel->closed_flag;
+        if (record->queued) {
+            unbuf_enqueue(send ? &channel->send_waiters : &channel->recv_waiters, record);
+            if (send) notify_selectors(channel, channel->recv_selectors, parked->word);
+            else      notify_selectors(channel, channel->send_selectors, parked->word);
+            events_update(channel);
+        }
+        futex_mutex_unlock(&channel->chan_mutex);
+        any = true;
+    }
+    return any;
+}
 
-    pthread_mutex_lock(&local_mutex);
-    init_select(entries, count, &local_sem);
+// Withdraws the records select_park left queued
+// Taking every chan_mutex also makes the value and index written by the partner that won the select visible
+static void select_unpark(select_t* entries, size_t count, unbuf_waiter_t* records)
+{
+    for (size_t i = 0; i < count; ++i) {
+        channel_t* channel = entries[i].channel;
+        if (!channel->is_unbuffered) continue;
+        futex_mutex_lock(&channel->chan_mutex);
+        if (records[i].queued) {
+            unbuf_unlink(entries[i].dir == SEND ? &channel->send_waiters : &channel->recv_waiters, &records[i]);
+            records[i].queued = false;
+            events_update(channel);
+        }
+        futex_mutex_unlock(&channel->chan_mutex);
+    }
+}
 
+// Scans the entries until one completes, sleeping on word while none is ready
+// While it sleeps, the select's unbuffered entries are parked in records (one per entry)
+// Gives up with TIMEOUT_ERROR once deadline passes (NULL blocks without a deadline)
+static enum channel_status select_wait(select_t* entries, size_t count, size_t* sel_idx,
+                                       select_policy_t* policy, futex_word_t* word,
+                                       unbuf_waiter_t* records, const struct timespec* deadline)
+{
+    unbuf_select_t parked = {.word = word};
+    bool timed_out = false;
     while (1) {
-        for (size_t i = 0; i < count; ++i) {
+        // Cleared before the scan so a notify that lands during it is not lost
+        atomic_store(&word->value, 0);
+        size_t start = select_start(policy, count);
+        for (size_t n = 0; n < count; ++n) {
+            size_t i = start + n < count ? start + n : start + n - count;
             select_t* e = &entries[i];
 
             if (e->dir == SEND) {
                 if (e->channel->is_unbuffered) {
-                    pthread_mutex_lock(&e->channel->chan_mutex);
+                    futex_mutex_lock(&e->channel->chan_mutex);
+                    enum channel_status st = unbuffered_sync(e->channel, unbuf_op_send, &e->data, false, NULL);
 
-                    if (e->channel->closed_flag) {
-                        pthread_mutex_unlock(&e->channel->chan_mutex);
-                        cleanup_select(entries, count, &local_sem);
-                        return CLOSED_ERROR;
-                    }
-
-                    if ((e->channel->unbuf_stage == 1 &&
-                         e->channel->active_unbuf_op == unbuf_op_receive) ||
-                        list_count(e->channel->recv_selectors))
-                    {
-                        enum channel_status st =
-                            unbuffered_sync(e->channel, unbuf_op_send,
-                                            &e->data);
+                    if (st != CHANNEL_FULL) {
                         *sel_idx = i;
-                        cleanup_select(entries, count, &local_sem);
-                        pthread_mutex_unlock(&local_mutex);
-                        sem_destroy(&local_sem);
-                        pthread_mutex_destroy(&local_mutex);
                         return st;
                     }
-
-                    pthread_mutex_unlock(&e->channel->chan_mutex);
                 } else {
                     enum channel_status st = channel_non_blocking_send(e->channel, e->data);
 
                     if (st != CHANNEL_FULL) {
                         *sel_idx = i;
-                        cleanup_select(entries, count, &local_sem);
-                        pthread_mutex_unlock(&local_mutex);
-                        sem_destroy(&local_sem);
-                        pthread_mutex_destroy(&local_mutex);
                         return st;
                     }
                 }
             }
             else { /* RECEIVE path */
                 if (e->channel->is_unbuffered) {
-                    pthread_mutex_lock(&e->channel->chan_mutex);
-
-                    if (e->channel->closed_flag) {
-                        pthread_mutex_unlock(&e->channel->chan_mutex);
-                        cleanup_select(entries, count, &local_sem);
-                        return CLOSED_ERROR;
-                    }
+                    futex_mutex_lock(&e->channel->chan_mutex);
+                    enum channel_status st = unbuffered_sync(e->channel, unbuf_op_receive, &e->data, false, NULL);
 
-                    if ((e->channel->unbuf_stage == 1 &&
-                         e->channel->active_unbuf_op == unbuf_op_send) ||
-                        list_count(e->channel->send_selectors))
-                    {
-                        enum channel_status st =
-                            unbuffered_sync(e->channel, unbuf_op_receive,
-                                            &e->data);
+                    if (st != CHANNEL_EMPTY) {
                         *sel_idx = i;
-                        cleanup_select(entries, count, &local_sem);
-                        pthread_mutex_unlock(&local_mutex);
-                        sem_destroy(&local_sem);
-                        pthread_mutex_destroy(&local_mutex);
                         return st;
                     }
-
-                    pthread_mutex_unlock(&e->channel->chan_mutex);
                 } else {
                     enum channel_status st = channel_non_blocking_receive(e->channel, &e->data);
 
                     if (st != CHANNEL_EMPTY) {
                         *sel_idx = i;
-                        cleanup_select(entries, count, &local_sem);
-                        pthread_mutex_unlock(&local_mutex);
-                        sem_destroy(&local_sem);
-                        pthread_mutex_destroy(&local_mutex);
                         return st;
                     }
                 }
             }
         }
-        sem_wait(&local_sem);
+        // Like the channel ops, a timed out select scans once more before giving up
+        if (timed_out) return TIMEOUT_ERROR;
+        // Anything that parks on an entry's channel after the scan started has set word, so nothing is missed
+        bool any = select_park(entries, count, records, &parked);
+        timed_out = !futex_wait_until(word, 0, deadline);
+        if (any) {
+            uint32_t expected = UNBUF_WAITING;
+            bool won = !atomic_compare_exchange_strong(&parked.state, &expected, UNBUF_WITHDRAWN);
+            select_unpark(entries, count, records);
+            if (won) {
+                *sel_idx = parked.index;
+                return SUCCESS;
+            }
+        }
+    }
+}
+
+// Registers the select on every entry's channel, waits for one entry to complete, and unregisters
+static enum channel_status select_run(select_t* entries, size_t count, size_t* sel_idx, select_policy_t* policy,
+                                      const struct timespec* deadline)
+{
+    list_node_t     stack_nodes[SELECT_STACK_NODES];
+    unbuf_waiter_t  stack_records[SELECT_STACK_NODES];
+    list_node_t*    nodes   = stack_nodes;
+    unbuf_waiter_t* records = stack_records;
+    if (count > SELECT_STACK_NODES) {
+        nodes   = malloc(count * sizeof *nodes);
+        records = malloc(count * sizeof *records);
+        if (!nodes || !records) {
+            free(nodes);
+            free(records);
+            return GENERIC_ERROR;
+        }
+    }
+
+    futex_word_t wake_word;
+    futex_word_init(&wake_word, 0);
+    init_select(entries, count, nodes, &wake_word);
+    enum channel_status status = select_wait(entries, count, sel_idx, policy, &wake_word, records, deadline);
+    cleanup_select(entries, count, nodes);
+    // A partner that completed one of the unbuffered entries may still hold the word
+    futex_retire(&wake_word);
+    if (status == SUCCESS && entries[*sel_idx].channel->stats) {
+        stats_add(&entries[*sel_idx].channel->stats->select_successes, 1);
     }
 
-    cleanup_select(entries, count, &local_sem);
-    pthread_mutex_unlock(&local_mutex);
-    sem_destroy(&local_sem);
-    pthread_mutex_destroy(&local_mutex);
-    return GENERIC_ERROR;
-}
\ No newline at end of file
+    if (nodes != stack_nodes) {
+        free(nodes);
+        free(records);
+    }
+    return status;
+}
+
+// Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
+// This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
+// If multiple options are available, it selects the first option and performs its corresponding action
+// If no channel is available, the call is blocked and waits till it finds a channel which supports its required operation
+// Once an operation has been successfully performed, select should set selected_index to the index of the channel that performed the operation and then return SUCCESS
+// In the event that a channel is closed or encounters any error, the error should be propagated and returned through select
+// Additionally, selected_index is set to the index of the channel that generated the error
+enum channel_status channel_select(select_t* entries, size_t count, size_t* sel_idx)
+{
+    if (count == 0 || !entries || !sel_idx) return GENERIC_ERROR;
+    return select_run(entries, count, sel_idx, NULL, NULL);
+}
+
+// Initializes a select policy with the given mode
+// weights is only read in SELECT_WEIGHTED mode and must hold one weight per entry of every select list the policy is used with
+void select_policy_init(select_policy_t* policy, enum select_mode mode, const unsigned int* weights)
+{
+    policy->mode    = mode;
+    policy->weights = weights;
+    policy->next    = 0;
+    // Seed from the policy's address so policies owned by different threads draw different sequences
+    uint64_t seed = (uint64_t)(uintptr_t)policy * 0x9e3779b97f4a7c15ULL;
+    policy->rng = (seed ^ (seed >> 31)) | 1;
+}
+
+// Works like channel_select, but the scan for a ready entry starts at an entry picked by the policy and wraps around,
+// so no entry is starved by its position in the list
+// SELECT_ROUND_ROBIN starts after the entry selected by the previous call, SELECT_RANDOM at a uniformly random entry,
+// and SELECT_WEIGHTED at entry i with probability weights[i] / (sum of the weights); while every entry is ready,
+// that is also each entry's share of the selects
+// Returns the same statuses as channel_select
+enum channel_status channel_select_policy(select_t* entries, size_t count, size_t* sel_idx, select_policy_t* policy)
+{
+    if (count == 0 || !entries || !sel_idx || !policy) return GENERIC_ERROR;
+    if (policy->mode == SELECT_WEIGHTED && !policy->weights) return GENERIC_ERROR;
+    enum channel_status status = select_run(entries, count, sel_idx, policy, NULL);
+    if (status == SUCCESS) {
+        policy->next = *sel_idx + 1;
+    }
+    return status;
+}
+
+// Works like channel_send, but gives up once deadline passes
+// deadline is an absolute CLOCK_MONOTONIC time, e.g. clock_gettime(CLOCK_MONOTONIC, ...) plus a timeout;
+// the call sleeps on the same futex as channel_send and the kernel wakes it at the deadline
+// Returns TIMEOUT_ERROR if the deadline passed before data was written, otherwise the same statuses as channel_send
+enum channel_status channel_send_timed(channel_t* channel, void* data, const struct timespec* deadline)
+{
+    if (!deadline) return GENERIC_ERROR;
+    if (!channel->is_unbuffered) {
+        return buffered_send(channel, &data, 1, deadline);
+    }
+
+    futex_mutex_lock(&channel->chan_mutex);
+    return unbuffered_sync(channel, unbuf_op_send, &data, true, deadline);
+}
+
+// Works like channel_receive, but gives up once deadline passes (an absolute CLOCK_MONOTONIC time)
+// Returns TIMEOUT_ERROR if the deadline passed before data was read, otherwise the same statuses as channel_receive
+enum channel_status channel_receive_timed(channel_t* channel, void** data, const struct timespec* deadline)
+{
+    if (!deadline) return GENERIC_ERROR;
+    if (!channel->is_unbuffered) {
+        size_t got;
+        return buffered_receive(channel, data, 1, &got, deadline);
+    }
+
+    futex_mutex_lock(&channel->chan_mutex);
+    return unbuffered_sync(channel, unbuf_op_receive, data, true, deadline);
+}
+
+// Works like channel_select, but gives up once deadline passes (an absolute CLOCK_MONOTONIC time)
+// Returns TIMEOUT_ERROR if no entry completed before the deadline (selected_index is left unchanged),
+// otherwise the same statuses as channel_select
+enum channel_status channel_select_timed(select_t* entries, size_t count, size_t* sel_idx, const struct timespec* deadline)
+{
+    if (count == 0 || !entries || !sel_idx || !deadline) return GENERIC_ERROR;
+    return select_run(entries, count, sel_idx, NULL, deadline);
+}
+
+// Starts counting the channel's traffic; call it before any other thread uses the channel
+// Returns SUCCESS if the counters were allocated (or already enabled), and
+// GENERIC_ERROR if they could not be allocated
+enum channel_status channel_stats_enable(channel_t* channel)
+{
+    if (channel->stats) return SUCCESS;
+    channel_counters_t* stats = aligned_alloc(_Alignof(channel_counters_t), sizeof(channel_counters_t));
+    if (!stats) return GENERIC_ERROR;
+    atomic_init(&stats->sends, 0);
+    atomic_init(&stats->blocked_sends, 0);
+    atomic_init(&stats->send_wait_ns, 0);
+    atomic_init(&stats->peak_occupancy, 0);
+    atomic_init(&stats->receives, 0);
+    atomic_init(&stats->blocked_receives, 0);
+    atomic_init(&stats->receive_wait_ns, 0);
+    atomic_init(&stats->select_wakeups, 0);
+    atomic_init(&stats->select_successes, 0);
+    channel->stats = stats;
+    return SUCCESS;
+}
+
+// Copies the channel's counters into stats
+// Returns SUCCESS on success and GENERIC_ERROR if channel_stats_enable was not called
+enum channel_status channel_stats_get(channel_t* channel, channel_stats_t* stats)
+{
+    channel_counters_t* counters = channel->stats;
+    if (!counters) return GENERIC_ERROR;
+    stats->sends            = atomic_load_explicit(&counters->sends, memory_order_relaxed);
+    stats->receives         = atomic_load_explicit(&counters->receives, memory_order_relaxed);
+    stats->blocked_sends    = atomic_load_explicit(&counters->blocked_sends, memory_order_relaxed);
+    stats->blocked_receives = atomic_load_explicit(&counters->blocked_receives, memory_order_relaxed);
+    stats->send_wait_ns     = atomic_load_explicit(&counters->send_wait_ns, memory_order_relaxed);
+    stats->receive_wait_ns  = atomic_load_explicit(&counters->receive_wait_ns, memory_order_relaxed);
+    stats->select_wakeups   = atomic_load_explicit(&counters->select_wakeups, memory_order_relaxed);
+    stats->select_successes = atomic_load_explicit(&counters->select_successes, memory_order_relaxed);
+    stats->peak_occupancy   = atomic_load_explicit(&counters->peak_occupancy, memory_order_relaxed);
+    return SUCCESS;
+}
+
+// Mean of total over count, or 0 without any count
+static double stats_mean(uint64_t total, size_t count)
+{
+    return count ? (double)total / (double)count : 0;
+}
+
+// Writes one line with the channel's counters to out, starting with name
+void channel_stats_dump(channel_t* channel, const char* name, FILE* out)
+{
+    channel_stats_t stats;
+    if (channel_stats_get(channel, &stats) != SUCCESS) {
+        fprintf(out, "%s: stats not enabled\n", name);
+        return;
+    }
+    size_t capacity = channel->is_unbuffered ? 0 : buffer_capacity(channel->buffer);
+    size_t spurious = stats.select_wakeups > stats.select_successes ? stats.select_wakeups - stats.select_successes : 0;
+    fprintf(out, "%s: sends=%zu receives=%zu blocked_sends=%zu blocked_receives=%zu "
+                 "send_wait_us=%.1f receive_wait_us=%.1f mean_send_wait_us=%.1f mean_receive_wait_us=%.1f "
+                 "select_wakeups=%zu select_successes=%zu spurious_select_wakeups=%zu peak_occupancy=%zu/%zu\n",
+            name, stats.sends, stats.receives, stats.blocked_sends, stats.blocked_receives,
+            (double)stats.send_wait_ns / 1e3, (double)stats.receive_wait_ns / 1e3,
+            stats_mean(stats.send_wait_ns, stats.blocked_sends) / 1e3,
+            stats_mean(stats.receive_wait_ns, stats.blocked_receives) / 1e3,
+            stats.select_wakeups, stats.select_successes, spurious, stats.peak_occupancy, capacity);
+}
+
+// Makes the channel keep two eventfds that show whether a send or a receive would complete without blocking;
+// call it before any other thread uses the channel
+// Returns SUCCESS if the eventfds were created (or already enabled), and
+// GENERIC_ERROR if they could not be created
+enum channel_status channel_eventfd_enable(channel_t* channel)
+{
+    if (channel->events) return SUCCESS;
+    channel_events_t* events = malloc(sizeof(channel_events_t));
+    if (!events) return GENERIC_ERROR;
+    events->receive_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    events->send_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (events->receive_fd < 0 || events->send_fd < 0) {
+        if (events->receive_fd >= 0) close(events->receive_fd);
+        if (events->send_fd >= 0) close(events->send_fd);
+        free(events);
+        return GENERIC_ERROR;
+    }
+    futex_mutex_init(&events->lock);
+    events->receive_raised = false;
+    events->send_raised = false;
+    channel->events = events;
+    // Show the readiness the channel already has
+    futex_mutex_lock(&channel->chan_mutex);
+    events_update(channel);
+    futex_mutex_unlock(&channel->chan_mutex);
+    return SUCCESS;
+}
+
+// Returns the eventfd that is readable while a receive on the channel would not block, or -1 without eventfds
+int channel_receive_fd(channel_t* channel)
+{
+    return channel->events ? channel->events->receive_fd : -1;
+}
+
+// Returns the eventfd that is writable while a send on the channel would not block, or -1 without eventfds
+int channel_send_fd(channel_t* channel)
+{
+    return channel->events ? channel->events->send_fd : -1;
+}
@@ -9,7 +9,10 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include "linked_list.h"
+#include "futex.h"
 
 // Defines possible return values from channel functions
 enum channel_status {
@@ -19,9 +22,38 @@ enum channel_status {
     GENERIC_ERROR = -1, // Generic error
     GEN_ERROR = -1,     // Unused: for instructor testing
     CLOSED_ERROR = -2,  // Channel has been closed
-    DESTROY_ERROR = -3  // Error during destroy
+    DESTROY_ERROR = -3, // Error during destroy
+    TIMEOUT_ERROR = -4  // Deadline passed in a timed operation
 };
 
+// A thread parked on an unbuffered channel (defined in channel.c)
+typedef struct unbuf_waiter unbuf_waiter_t;
+
+// FIFO queue of parked threads, linked through the threads' own records
+typedef struct {
+    unbuf_waiter_t* head;
+    unbuf_waiter_t* tail;
+} unbuf_queue_t;
+
+// Traffic counters of a channel that called channel_stats_enable (defined in channel.c)
+typedef struct channel_counters channel_counters_t;
+
+// Eventfds of a channel that called channel_eventfd_enable (defined in channel.c)
+typedef struct channel_events channel_events_t;
+
+// Snapshot of a channel's counters, filled in by channel_stats_get
+typedef struct {
+    size_t sends;            // messages written
+    size_t receives;         // messages read
+    size_t blocked_sends;    // send calls that had to wait for room or a receiver
+    size_t blocked_receives; // receive calls that had to wait for a message or a sender
+    uint64_t send_wait_ns;   // total time those send calls spent waiting
+    uint64_t receive_wait_ns;
+    size_t select_wakeups;   // times a select waiting on the channel was woken by it
+    size_t select_successes; // selects that completed one of their entries on the channel
+    size_t peak_occupancy;   // most messages the buffer held at once (0 for unbuffered channels)
+} channel_stats_t;
+
 // Defines channel object
 typedef struct {
     // DO NOT REMOVE buffer (OR CHANGE ITS NAME) FROM THE STRUCT
@@ -30,36 +62,38 @@ typedef struct {
 
     /* ADD ANY STRUCT ENTRIES YOU NEED HERE */
     /* IMPLEMENT THIS */
-    // Mutexes
-    pthread_mutex_t chan_mutex;        // protects channel state
-    pthread_mutex_t select_list_mutex; // protects select-list modifications
+    // Mutexes (one futex word each)
+    futex_mutex_t chan_mutex;        // protects channel state
+    futex_mutex_t select_list_mutex; // protects select-list modifications
 
-    // Condition variables for buffered operations
-    pthread_cond_t cond_not_full;      // signaled when buffer has space
-    pthread_cond_t cond_not_empty;     // signaled when buffer has data
-
-    // Condition variables for unbuffered rendezvous
-    pthread_cond_t rendezvous_wait_cv;     // signaled to wake waiting stage threads
-    pthread_cond_t rendezvous_complete_cv; // signaled when rendezvous completes
+    // Buffered operations never lock; threads only block here while the buffer is full or empty
+    waitq_t not_full;                 // senders waiting for space
+    waitq_t not_empty;                // receivers waiting for data
 
     // Channel closed flag
-    bool closed_flag;
+    atomic_bool closed_flag;
 
-    // Semaphore lists for select operations
-    list_t* send_selectors;           // semaphores waiting on send operations
-    list_t* recv_selectors;           // semaphores waiting on receive operations
+    // Futex words of the selects blocked on this channel
+    list_t* send_selectors;           // words of selects waiting to send
+    list_t* recv_selectors;           // words of selects waiting to receive
+    atomic_size_t send_select_count;  // length of send_selectors, readable without select_list_mutex
+    atomic_size_t recv_select_count;  // length of recv_selectors, readable without select_list_mutex
 
-    // Unbuffered channel state
+    // Unbuffered channel state, protected by chan_mutex
     bool is_unbuffered;               // true if operating in unbuffered mode
-    int active_unbuf_op;              // UNBUFFERED_SEND / UNBUFFERED_RECEIVE / NO_UNBUFFERED_OPERATION
-    int unbuf_stage;                  // current rendezvous stage (0, 1, 2)
-    void** unbuf_data;                // storage pointer for unbuffered message exchange
+    unbuf_queue_t send_waiters;       // senders parked until a receiver takes their value, oldest first
+    unbuf_queue_t recv_waiters;       // receivers parked until a sender hands them a value, oldest first
 
-    // Counts of threads waiting on rendezvous stages
-    int waiting_senders;              // number of senders waiting at rendezvous
-    int waiting_receivers;            // number of receivers waiting at rendezvous
+    channel_counters_t* stats;        // NULL unless channel_stats_enable was called
+    channel_events_t* events;         // NULL unless channel_eventfd_enable was called
 } channel_t;
 
+// A message slot of a typed channel, held between reserve and commit or between acquire and release
+typedef struct {
+    void* data; // where the message is written (reserve) or read (acquire) in place
+    size_t pos; // position of the slot in the channel's buffer
+} channel_slot_t;
+
 // Defines channel list structure for channel_select function
 enum direction {
     SEND,
@@ -75,9 +109,37 @@ typedef struct {
     void* data;
 } select_t;
 
+// Defines the order in which channel_select_policy scans its entries
+enum select_mode {
+    SELECT_FIRST,       // always from index 0, like channel_select
+    SELECT_ROUND_ROBIN, // from the entry after the one selected by the previous call
+    SELECT_RANDOM,      // from an entry drawn uniformly at random, like Go's select
+    SELECT_WEIGHTED,    // from an entry drawn with probability proportional to its weight
+};
+
+// Per-caller state for channel_select_policy, initialized with select_policy_init and reused across calls
+typedef struct {
+    enum select_mode mode;
+    const unsigned int* weights; // SELECT_WEIGHTED: one weight per entry of the select list
+    size_t next;                 // SELECT_ROUND_ROBIN: entry to scan first on the next call
+    uint64_t rng;                // SELECT_RANDOM and SELECT_WEIGHTED: xorshift64 state
+} select_policy_t;
+
 // Creates a new channel with the provided size and returns it to the caller
 channel_t* channel_create(size_t size);
 
+// Creates a new buffered channel for exactly one sending thread and one receiving thread at a time
+// (a select that sends or receives on the channel counts as that thread)
+// Its buffer skips the atomic read-modify-writes of the shared ring; a size of 0 creates an ordinary unbuffered channel
+channel_t* channel_create_spsc(size_t size);
+
+// Creates a new typed channel of the given (nonzero) size whose messages are values of elem_size bytes
+// The channel allocates a slot for every message up front and messages are copied into them or written in place,
+// so sending and receiving never allocate; typed channels are only used with the value and slot calls below,
+// never with the void* calls or channel_select
+// Returns NULL if size or elem_size is 0
+channel_t* channel_create_typed(size_t size, size_t elem_size);
+
 // Writes data to the given channel
 // This is a blocking call i.e., the function only returns on a successful completion of send
 // In case the channel is full, the function waits till the channel has space to write the new data
@@ -110,6 +172,86 @@ enum channel_status channel_non_blocking_send(channel_t* channel, void* data);
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_non_blocking_receive(channel_t* channel, void** data);
 
+// Writes the n messages in items to the given channel in order
+// This is a blocking call i.e., the function only returns once all n messages have been written
+// On a buffered channel every run of messages that fits costs one buffer operation and one wakeup
+// Returns SUCCESS for successfully writing all messages,
+// CLOSED_ERROR if the channel is closed (messages written before the close stay in the channel), and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_batch(channel_t* channel, void** items, size_t n);
+
+// Reads between 1 and max messages from the given channel into out and stores the count in got
+// This is a blocking call i.e., the function waits till the channel has some data to read,
+// then takes as much as is available without waiting again
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_batch(channel_t* channel, void** out, size_t max, size_t* got);
+
+// Writes as many of the n messages in items as the channel accepts right now, in order, and stores the count in sent
+// This is a non-blocking call i.e., the function simply returns once the channel is full
+// Returns SUCCESS if at least one message was written,
+// CHANNEL_FULL if the channel is full and nothing was written,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_send_batch(channel_t* channel, void** items, size_t n, size_t* sent);
+
+// Reads as many messages (up to max) as the channel holds right now into out and stores the count in got
+// This is a non-blocking call i.e., the function simply returns once the channel is empty
+// Returns SUCCESS if at least one message was read,
+// CHANNEL_EMPTY if the channel is empty and nothing was read,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_receive_batch(channel_t* channel, void** out, size_t max, size_t* got);
+
+// Copies the elem_size-byte message at value into a typed channel
+// This is a blocking call i.e., the function only returns once the message is in the channel
+// Returns SUCCESS for successfully writing the message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_send_value(channel_t* channel, const void* value);
+
+// Copies the oldest message of a typed channel into the elem_size bytes at value
+// This is a blocking call i.e., the function waits till the channel has some data to read
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_receive_value(channel_t* channel, void* value);
+
+// Non-blocking versions of channel_send_value and channel_receive_value
+// They return CHANNEL_FULL or CHANNEL_EMPTY instead of waiting
+enum channel_status channel_non_blocking_send_value(channel_t* channel, const void* value);
+enum channel_status channel_non_blocking_receive_value(channel_t* channel, void* value);
+
+// Reserves the next free slot of a typed channel so the message can be written in place at slot->data
+// Receivers see the message once channel_commit is called; every reserved slot must be committed
+// This is a blocking call i.e., the function waits till the channel has a free slot
+// Returns SUCCESS for successfully reserving a slot,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_reserve(channel_t* channel, channel_slot_t* slot);
+
+// Publishes the message written into a slot reserved with channel_reserve
+// Returns SUCCESS (a slot is published even if the channel was closed in between)
+enum channel_status channel_commit(channel_t* channel, channel_slot_t* slot);
+
+// Acquires the oldest message of a typed channel so it can be read in place at slot->data
+// The slot is only reused after channel_release is called; every acquired slot must be released
+// This is a blocking call i.e., the function waits till the channel has some data to read
+// Returns SUCCESS for successfully acquiring a message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR if the channel is not typed
+enum channel_status channel_acquire(channel_t* channel, channel_slot_t* slot);
+
+// Returns a slot acquired with channel_acquire to the senders
+// Returns SUCCESS
+enum channel_status channel_release(channel_t* channel, channel_slot_t* slot);
+
+// Non-blocking versions of channel_reserve and channel_acquire
+// They return CHANNEL_FULL or CHANNEL_EMPTY instead of waiting
+enum channel_status channel_non_blocking_reserve(channel_t* channel, channel_slot_t* slot);
+enum channel_status channel_non_blocking_acquire(channel_t* channel, channel_slot_t* slot);
+
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
 // Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
 // Returns SUCCESS if close is successful,
@@ -133,4 +275,70 @@ enum channel_status channel_destroy(channel_t* channel);
 // Additionally, selected_index is set to the index of the channel that generated the error
 enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index);
 
+// Initializes a select policy with the given mode
+// weights is only read in SELECT_WEIGHTED mode and must hold one weight per entry of every select list the policy is used with
+void select_policy_init(select_policy_t* policy, enum select_mode mode, const unsigned int* weights);
+
+// Works like channel_select, but the scan for a ready entry starts at an entry picked by the policy and wraps around,
+// so no entry is starved by its position in the list
+// SELECT_ROUND_ROBIN starts after the entry selected by the previous call, SELECT_RANDOM at a uniformly random entry,
+// and SELECT_WEIGHTED at entry i with probability weights[i] / (sum of the weights); while every entry is ready,
+// that is also each entry's share of the selects
+// Returns the same statuses as channel_select
+enum channel_status channel_select_policy(select_t* channel_list, size_t channel_count, size_t* selected_index,
+                                          select_policy_t* policy);
+
+// Works like channel_send, but gives up once deadline passes
+// deadline is an absolute CLOCK_MONOTONIC time, e.g. clock_gettime(CLOCK_MONOTONIC, ...) plus a timeout;
+// the call sleeps on the same futex as channel_send and the kernel wakes it at the deadline
+// Returns TIMEOUT_ERROR if the deadline passed before data was written, otherwise the same statuses as channel_send
+enum channel_status channel_send_timed(channel_t* channel, void* data, const struct timespec* deadline);
+
+// Works like channel_receive, but gives up once deadline passes (an absolute CLOCK_MONOTONIC time)
+// Returns TIMEOUT_ERROR if the deadline passed before data was read, otherwise the same statuses as channel_receive
+enum channel_status channel_receive_timed(channel_t* channel, void** data, const struct timespec* deadline);
+
+// Works like channel_select, but gives up once deadline passes (an absolute CLOCK_MONOTONIC time)
+// Returns TIMEOUT_ERROR if no entry completed before the deadline (selected_index is left unchanged),
+// otherwise the same statuses as channel_select
+enum channel_status channel_select_timed(select_t* channel_list, size_t channel_count, size_t* selected_index,
+                                         const struct timespec* deadline);
+
+// Starts counting the channel's traffic; call it before any other thread uses the channel
+// The counters are relaxed atomics, so they cost a few uncontended increments per operation on this channel
+// and a single branch on channels that never enable them
+// Returns SUCCESS if the counters were allocated (or already enabled), and
+// GENERIC_ERROR if they could not be allocated
+enum channel_status channel_stats_enable(channel_t* channel);
+
+// Copies the channel's counters into stats; the counters keep running, so the fields are not read at the same instant
+// Returns SUCCESS on success and GENERIC_ERROR if channel_stats_enable was not called
+enum channel_status channel_stats_get(channel_t* channel, channel_stats_t* stats);
+
+// Writes one line with the channel's counters to out, starting with name
+// Besides the counters it shows the mean wait of a blocked call and the select wakeups that did not end in a select
+// completing on the channel, which points at contended channels and spurious wakeups
+void channel_stats_dump(channel_t* channel, const char* name, FILE* out);
+
+// Makes the channel keep two eventfds that show whether a send or a receive would complete without blocking,
+// so the channel can be waited on with epoll (or poll) together with sockets, pipes and other file descriptors;
+// call it before any other thread uses the channel
+// The fds are level triggered and only a hint: another thread may take the message or the room first, so use the
+// non-blocking calls once they report ready. Channels that never enable them pay a single branch per operation
+// Returns SUCCESS if the eventfds were created (or already enabled), and
+// GENERIC_ERROR if they could not be created
+enum channel_status channel_eventfd_enable(channel_t* channel);
+
+// Returns an eventfd that is readable (EPOLLIN) while a receive on the channel would not block, i.e. the buffer
+// holds a message, a sender is parked on the unbuffered channel, or the channel is closed;
+// -1 if channel_eventfd_enable was not called
+// Only poll the fd: reading or writing it breaks the readiness it shows. channel_destroy closes it
+int channel_receive_fd(channel_t* channel);
+
+// Returns an eventfd that is writable (EPOLLOUT) while a send on the channel would not block, i.e. the buffer has
+// room, a receiver is parked on the unbuffered channel, or the channel is closed;
+// -1 if channel_eventfd_enable was not called
+// Only poll the fd: reading or writing it breaks the readiness it shows. channel_destroy closes it
+int channel_send_fd(channel_t* channel);
+
 #endif // CHANNEL_H
@@ -0,0 +1,454 @@
+#include "coro.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#if defined(__SANITIZE_THREAD__)
+#include <sanitizer/tsan_interface.h>
+#endif
+
+/*
+ * Every worker thread runs a scheduling loop on its own stack and switches
+ * to one ready coroutine at a time. The coroutine runs until it finishes,
+ * yields or parks, then switches back. Ready coroutines wait in their
+ * worker's run queue. That queue is a list under a small lock rather than
+ * a Chase-Lev deque as in pool.c, because a parked coroutine is made ready
+ * again by whichever thread wakes it, not only by the queue's owner. A
+ * worker whose queue runs dry steals half of another worker's queue, and
+ * workers with nothing to run sleep on the idle wait queue.
+ *
+ * Blocking is futex.c's job. futex_wait called from a coroutine parks it
+ * on the futex word itself instead of sleeping in the kernel, and
+ * futex_wake makes the coroutines parked on the word ready again.
+ * Channels, wait queues and everything built on them therefore block
+ * coroutines without knowing about them.
+ *
+ * On x86-64 a switch pushes the callee-saved registers on the old stack
+ * and saves the stack pointer, then loads the other stack pointer and
+ * pops that stack's registers. Unlike swapcontext it makes no system
+ * call. Other targets fall back to swapcontext, which also saves and
+ * restores the signal mask with a system call on every switch.
+ */
+
+#if defined(CORO_SWITCH_ASM)
+// Pushes the callee-saved registers, stores the stack pointer in *save, then continues on the stack saved in load
+__attribute__((visibility("hidden"))) void coro_switch_stack(void** save, void* load);
+__asm__(".text\n"
+        ".globl coro_switch_stack\n"
+        ".hidden coro_switch_stack\n"
+        ".type coro_switch_stack, @function\n"
+        "coro_switch_stack:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size coro_switch_stack, .-coro_switch_stack\n");
+#endif
+
+// Saves the running context in *save and continues with the one in *load
+static void coro_switch(coro_context_t* save, coro_context_t* load)
+{
+#if defined(CORO_SWITCH_ASM)
+    coro_switch_stack(save, *load);
+#else
+    swapcontext(save, load);
+#endif
+}
+
+// The worker running on this thread, if it belongs to a scheduler
+static _Thread_local coro_worker_t* current_worker;
+
+// Returns current_worker; kept out of line because a coroutine can resume on another thread,
+// so code running in one must not keep the thread-local's address across a switch
+__attribute__((noipa)) static coro_worker_t* this_worker(void)
+{
+    return current_worker;
+}
+
+// Switches from the worker's scheduling loop to coro until it switches back
+static void switch_to_coro(coro_worker_t* self, coro_t* coro)
+{
+    self->current = coro;
+    coro->worker = self;
+#if defined(__SANITIZE_THREAD__)
+    __tsan_switch_to_fiber(coro->fiber, 0);
+#endif
+    coro_switch(&self->context, &coro->context);
+    self->current = NULL;
+}
+
+// Switches from the running coroutine back to its worker's scheduling loop
+// When it returns, the coroutine may be running on another worker
+static void switch_to_worker(enum coro_switch reason, futex_mutex_t* park_lock)
+{
+    coro_worker_t* self = this_worker();
+    coro_t* coro = self->current;
+    self->reason = reason;
+    self->park_lock = park_lock;
+#if defined(__SANITIZE_THREAD__)
+    __tsan_switch_to_fiber(self->fiber, 0);
+#endif
+    coro_switch(&coro->context, &self->context);
+}
+
+// First function on a new coroutine's stack
+static void coro_start(void)
+{
+    coro_t* coro = this_worker()->current;
+    coro->fn(coro->arg);
+    switch_to_worker(CORO_EXITED, NULL);
+    __builtin_unreachable();
+}
+
+#if defined(CORO_SWITCH_ASM)
+// Lays out the top of a new coroutine's stack the way coro_switch_stack leaves a stack it switched away from:
+// six saved registers, then the address its ret jumps to, then a null return address for coro_start,
+// so coro_start begins with the stack aligned as if it had been called
+static bool coro_init_context(coro_t* coro)
+{
+    void** sp = (void**)(((uintptr_t)coro->stack + CORO_STACK_SIZE) & ~(uintptr_t)15);
+    *--sp = NULL;
+    *--sp = (void*)coro_start;
+    for (int i = 0; i < 6; i++) {
+        *--sp = NULL;
+    }
+    coro->context = sp;
+    return true;
+}
+#else
+// Sets up a context that starts coro_start on the coroutine's stack
+// Returns false if getcontext fails
+static bool coro_init_context(coro_t* coro)
+{
+    if (getcontext(&coro->context) != 0) {
+        return false;
+    }
+    coro->context.uc_stack.ss_sp = coro->stack;
+    coro->context.uc_stack.ss_size = CORO_STACK_SIZE;
+    coro->context.uc_link = NULL;
+    makecontext(&coro->context, coro_start, 0);
+    return true;
+}
+#endif
+
+static void coro_free(coro_t* coro)
+{
+#if defined(__SANITIZE_THREAD__)
+    __tsan_destroy_fiber(coro->fiber);
+#endif
+    free(coro->stack);
+    free(coro);
+}
+
+// Appends n coroutines, linked from first to last, to the worker's run queue
+static void queue_push(coro_worker_t* worker, coro_t* first, coro_t* last, size_t n)
+{
+    last->next = NULL;
+    futex_mutex_lock(&worker->lock);
+    if (worker->tail) worker->tail->next = first;
+    else              worker->head = first;
+    worker->tail = last;
+    atomic_fetch_add(&worker->queued, n);
+    futex_mutex_unlock(&worker->lock);
+}
+
+// Takes the oldest coroutine from the worker's run queue, or the older half of it if half is set
+// Returns the first one taken, with the rest linked behind it up to last, and their count in taken,
+// or NULL if the queue is empty
+static coro_t* queue_take(coro_worker_t* worker, bool half, coro_t** last, size_t* taken)
+{
+    if (atomic_load(&worker->queued) == 0) return NULL;
+    futex_mutex_lock(&worker->lock);
+    size_t queued = atomic_load_explicit(&worker->queued, memory_order_relaxed);
+    size_t n = half ? (queued + 1) / 2 : queued;
+    if (!half && n > 1) n = 1;
+    coro_t* first = worker->head;
+    coro_t* end = NULL;
+    for (size_t i = 0; i < n; i++) {
+        end = end ? end->next : first;
+    }
+    if (n > 0) {
+        worker->head = end->next;
+        if (!worker->head) worker->tail = NULL;
+        atomic_fetch_sub(&worker->queued, n);
+    }
+    futex_mutex_unlock(&worker->lock);
+    *last = end;
+    *taken = n;
+    return n > 0 ? first : NULL;
+}
+
+// Advances the worker's xorshift64 generator
+static uint64_t worker_rand(coro_worker_t* worker)
+{
+    uint64_t x = worker->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    worker->rng = x;
+    return x;
+}
+
+// Takes half of the first non-empty run queue of another worker, starting at a random one
+// Returns the coroutine to run; the rest of the stolen half goes to the worker's own queue
+static coro_t* coro_steal(coro_worker_t* self)
+{
+    coro_sched_t* sched = self->sched;
+    size_t n = sched->num_workers;
+    if (n < 2) return NULL;
+    size_t start = (size_t)(worker_rand(self) % n);
+    for (size_t i = 0; i < n; i++) {
+        size_t v = start + i < n ? start + i : start + i - n;
+        coro_worker_t* victim = &sched->workers[v];
+        if (victim == self) continue;
+        coro_t* last;
+        size_t taken;
+        coro_t* first = queue_take(victim, true, &last, &taken);
+        if (first) {
+            if (taken > 1) queue_push(self, first->next, last, taken - 1);
+            return first;
+        }
+    }
+    return NULL;
+}
+
+// Finds the next coroutine for the worker: its own queue first, then the other workers' queues
+// Returns NULL if no coroutine is ready
+static coro_t* coro_find(coro_worker_t* self)
+{
+    coro_t* last;
+    size_t taken;
+    coro_t* coro = queue_take(self, false, &last, &taken);
+    return coro ? coro : coro_steal(self);
+}
+
+// Sleeps until the worker finds a coroutine or the scheduler stops
+// Returns NULL once the scheduler has stopped
+static coro_t* coro_idle(coro_worker_t* self)
+{
+    coro_sched_t* sched = self->sched;
+    coro_t* coro;
+    uint32_t word = waitq_enter(&sched->idle);
+    while (!(coro = coro_find(self)) && !atomic_load(&sched->stopping)) {
+        word = waitq_wait(&sched->idle, word);
+    }
+    waitq_leave(&sched->idle);
+    // A steal may have brought more than this worker runs at once, so let another sleeper look
+    if (coro && atomic_load(&self->queued) > 0) {
+        waitq_wake_one(&sched->idle);
+    }
+    return coro;
+}
+
+// Finishes what the coroutine asked for when it switched back
+static void coro_switched_back(coro_worker_t* self, coro_t* coro)
+{
+    switch (self->reason) {
+    case CORO_YIELDED:
+        queue_push(self, coro, coro, 1);
+        break;
+    case CORO_PARKED:
+        // From here on its waker may queue it on any worker
+        futex_mutex_unlock(self->park_lock);
+        break;
+    case CORO_EXITED:
+        coro_free(coro);
+        if (atomic_fetch_sub(&self->sched->live, 1) == 1) {
+            waitq_wake_all(&self->sched->drained);
+        }
+        break;
+    }
+}
+
+static void* coro_worker_main(void* arg)
+{
+    coro_worker_t* self = arg;
+    current_worker = self;
+#if defined(__SANITIZE_THREAD__)
+    self->fiber = __tsan_get_current_fiber();
+#endif
+    while (true) {
+        coro_t* coro = coro_find(self);
+        if (!coro) coro = coro_idle(self);
+        if (!coro) break;
+        switch_to_coro(self, coro);
+        coro_switched_back(self, coro);
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+// Creates a scheduler that runs coroutines on the given number of worker threads (0 starts one per online CPU)
+// Returns NULL on failure
+coro_sched_t* coro_sched_create(size_t workers)
+{
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (size_t)cpus : 1;
+    }
+    coro_sched_t* sched = malloc(sizeof(coro_sched_t));
+    if (!sched) return NULL;
+    sched->workers = aligned_alloc(_Alignof(coro_worker_t), workers * sizeof(coro_worker_t));
+    if (!sched->workers) {
+        free(sched);
+        return NULL;
+    }
+    waitq_init(&sched->idle);
+    waitq_init(&sched->drained);
+    atomic_init(&sched->live, 0);
+    atomic_init(&sched->next_worker, 0);
+    atomic_init(&sched->closing, false);
+    atomic_init(&sched->stopping, false);
+    sched->shut_down = false;
+
+    for (size_t i = 0; i < workers; i++) {
+        coro_worker_t* worker = &sched->workers[i];
+        futex_mutex_init(&worker->lock);
+        worker->head = NULL;
+        worker->tail = NULL;
+        atomic_init(&worker->queued, 0);
+        worker->current = NULL;
+        worker->park_lock = NULL;
+        worker->fiber = NULL;
+        worker->rng = ((uint64_t)(i + 1) * 0x9e3779b97f4a7c15ULL) | 1;
+        worker->sched = sched;
+    }
+    sched->num_workers = workers;
+    sched->started = 0;
+    for (size_t i = 0; i < workers; i++) {
+        if (pthread_create(&sched->workers[i].thread, NULL, coro_worker_main, &sched->workers[i]) != 0) {
+            // Stop the workers that did start
+            coro_sched_shutdown(sched);
+            coro_sched_destroy(sched);
+            return NULL;
+        }
+        sched->started++;
+    }
+    return sched;
+}
+
+// The live count went back down without a coroutine finishing; coro_sched_shutdown may be waiting for it
+static void coro_unspawn(coro_sched_t* sched)
+{
+    if (atomic_fetch_sub(&sched->live, 1) == 1) {
+        waitq_wake_all(&sched->drained);
+    }
+}
+
+// Starts a coroutine that runs fn(arg) on one of the scheduler's workers
+// Returns SUCCESS if the coroutine was started,
+// CLOSED_ERROR if the scheduler is shutting down and no longer accepts coroutines from outside, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status coro_spawn(coro_sched_t* sched, coro_fn_t fn, void* arg)
+{
+    if (!sched || !fn) return GENERIC_ERROR;
+    coro_worker_t* self = this_worker();
+    bool inside = self && self->sched == sched;
+    // Counted before the check, so coro_sched_shutdown either refuses it or waits for it
+    atomic_fetch_add(&sched->live, 1);
+    if (!inside && atomic_load(&sched->closing)) {
+        coro_unspawn(sched);
+        return CLOSED_ERROR;
+    }
+    coro_t* coro = malloc(sizeof(coro_t));
+    char* stack = malloc(CORO_STACK_SIZE);
+    if (coro) {
+        coro->stack = stack;
+    }
+    if (!coro || !stack || !coro_init_context(coro)) {
+        free(coro);
+        free(stack);
+        coro_unspawn(sched);
+        return GENERIC_ERROR;
+    }
+    coro->fn = fn;
+    coro->arg = arg;
+#if defined(__SANITIZE_THREAD__)
+    coro->fiber = __tsan_create_fiber(0);
+#else
+    coro->fiber = NULL;
+#endif
+    coro_worker_t* worker = inside ? self
+                                   : &sched->workers[atomic_fetch_add(&sched->next_worker, 1) % sched->num_workers];
+    coro->worker = worker;
+    queue_push(worker, coro, coro, 1);
+    waitq_wake_one(&sched->idle);
+    return SUCCESS;
+}
+
+// Lets the other ready coroutines of the worker run before the calling coroutine continues
+// Does nothing outside a coroutine
+void coro_yield(void)
+{
+    if (coro_self()) {
+        switch_to_worker(CORO_YIELDED, NULL);
+    }
+}
+
+// Returns the coroutine running on this thread, or NULL outside a coroutine
+coro_t* coro_self(void)
+{
+    coro_worker_t* self = this_worker();
+    return self ? self->current : NULL;
+}
+
+// Suspends the calling coroutine until coro_ready is called on it; park_lock is unlocked once it is off its stack
+void coro_park(futex_mutex_t* park_lock)
+{
+    switch_to_worker(CORO_PARKED, park_lock);
+}
+
+// Queues a coroutine suspended by coro_park to run again
+void coro_ready(coro_t* coro)
+{
+    // A worker of the same scheduler keeps the coroutine it woke close by;
+    // from anywhere else it goes back to the worker that ran it last
+    coro_worker_t* self = this_worker();
+    coro_worker_t* worker = (self && self->sched == coro->worker->sched) ? self : coro->worker;
+    queue_push(worker, coro, coro, 1);
+    waitq_wake_one(&worker->sched->idle);
+}
+
+// Stops accepting coroutines from outside the scheduler, waits until every coroutine has finished,
+// then joins the workers
+// Must not be called from one of the scheduler's own coroutines
+// Returns SUCCESS on success and CLOSED_ERROR if the scheduler was already shut down
+enum channel_status coro_sched_shutdown(coro_sched_t* sched)
+{
+    if (atomic_exchange(&sched->closing, true)) return CLOSED_ERROR;
+
+    uint32_t word = waitq_enter(&sched->drained);
+    while (atomic_load(&sched->live) > 0) {
+        word = waitq_wait(&sched->drained, word);
+    }
+    waitq_leave(&sched->drained);
+
+    // Idle workers see the flag and exit
+    atomic_store(&sched->stopping, true);
+    waitq_wake_all(&sched->idle);
+    for (size_t i = 0; i < sched->started; i++) {
+        pthread_join(sched->workers[i].thread, NULL);
+    }
+    sched->shut_down = true;
+    return SUCCESS;
+}
+
+// Frees all the memory allocated to the scheduler
+// Returns SUCCESS if destroy is successful and DESTROY_ERROR if coro_sched_shutdown has not been called
+enum channel_status coro_sched_destroy(coro_sched_t* sched)
+{
+    if (!sched->shut_down) return DESTROY_ERROR;
+    free(sched->workers);
+    free(sched);
+    return SUCCESS;
+}
@@ -0,0 +1,123 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "channel.h"
+#include "futex.h"
+
+// x86-64 switches stacks in a few lines of assembly; other targets (or -DCORO_UCONTEXT) use the slower ucontext calls
+#if defined(__x86_64__) && !defined(CORO_UCONTEXT)
+#define CORO_SWITCH_ASM 1
+#else
+#include <ucontext.h>
+#endif
+
+// Bytes of stack each coroutine gets; it has no guard page, so coroutines must not recurse deeply
+#define CORO_STACK_SIZE (32 * 1024)
+
+// A coroutine runs fn(arg) to completion
+typedef void (*coro_fn_t)(void* arg);
+
+// What a switch saves of a coroutine or scheduling loop that is not running
+#if defined(CORO_SWITCH_ASM)
+typedef void* coro_context_t; // stack pointer; the registers are on the stack
+#else
+typedef ucontext_t coro_context_t;
+#endif
+
+struct coro_worker;
+
+// A coroutine and its stack
+typedef struct coro {
+    struct coro* next;          // run queue link, under the queue's lock
+    coro_context_t context;     // saved while the coroutine is not running
+    coro_fn_t fn;
+    void* arg;
+    struct coro_worker* worker; // the worker that ran it last, which gets it back when it is woken from outside
+    void* fiber;                // thread sanitizer state of the stack, NULL without -fsanitize=thread
+    char* stack;
+} coro_t;
+
+struct coro_sched;
+
+// Why a coroutine switched back to its worker
+enum coro_switch {
+    CORO_YIELDED, // queue it again
+    CORO_PARKED,  // leave it to its waker, then unlock park_lock
+    CORO_EXITED,  // free it
+};
+
+// A worker thread and its run queue; other workers steal from the queue when theirs runs dry
+typedef struct coro_worker {
+    _Alignas(64) futex_mutex_t lock;     // protects head and tail
+    coro_t* head;                        // run queue, oldest first
+    coro_t* tail;
+    atomic_size_t queued;                // length of the run queue, readable without the lock
+    _Alignas(64) coro_context_t context; // saved scheduling loop while a coroutine runs
+    coro_t* current;                     // the coroutine running on this worker, NULL in the scheduling loop
+    enum coro_switch reason;             // set by the coroutine that switched back
+    futex_mutex_t* park_lock;            // CORO_PARKED: held by the coroutine until it is off its stack
+    void* fiber;                         // thread sanitizer state of the scheduling loop
+    uint64_t rng;                        // picks the first victim to steal from
+    struct coro_sched* sched;
+    pthread_t thread;
+} coro_worker_t;
+
+// Defines coroutine scheduler object
+typedef struct coro_sched {
+    size_t num_workers;
+    size_t started;            // workers whose thread is running, only used by coro_sched_create and coro_sched_shutdown
+    coro_worker_t* workers;
+    waitq_t idle;              // workers sleeping until a coroutine is ready
+    waitq_t drained;           // coro_sched_shutdown waiting for the last coroutine to finish
+    atomic_size_t live;        // coroutines spawned that have not finished
+    atomic_size_t next_worker; // spreads coroutines spawned from outside over the workers
+    atomic_bool closing;       // coro_sched_shutdown has started; coroutines from outside are refused
+    atomic_bool stopping;      // every coroutine has finished; idle workers exit
+    bool shut_down;
+} coro_sched_t;
+
+// Creates a scheduler that runs coroutines on the given number of worker threads (0 starts one per online CPU)
+// Returns NULL on failure
+coro_sched_t* coro_sched_create(size_t workers);
+
+// Starts a coroutine that runs fn(arg) on one of the scheduler's workers
+// Inside a coroutine, the blocking channel calls (send, receive, select and their batch, value and slot
+// versions, but not the timed ones) park the coroutine instead of its worker thread, so a few workers can
+// run many thousands of coroutines that mostly wait on channels; anything else that blocks, such as a timed
+// call, a semaphore or I/O, blocks the worker thread and every coroutine queued on it
+// A coroutine spawned by another coroutine of the same scheduler starts on that coroutine's worker
+// Returns SUCCESS if the coroutine was started,
+// CLOSED_ERROR if the scheduler is shutting down and no longer accepts coroutines from outside, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status coro_spawn(coro_sched_t* sched, coro_fn_t fn, void* arg);
+
+// Lets the other ready coroutines of the worker run before the calling coroutine continues
+// Does nothing outside a coroutine
+void coro_yield(void);
+
+// Returns the coroutine running on this thread, or NULL outside a coroutine
+coro_t* coro_self(void);
+
+// Suspends the calling coroutine until coro_ready is called on it; park_lock is unlocked once the coroutine
+// is off its stack, so the thread that will call coro_ready can hold it until then (used by futex.c)
+void coro_park(futex_mutex_t* park_lock);
+
+// Queues a coroutine suspended by coro_park to run again
+void coro_ready(coro_t* coro);
+
+// Stops accepting coroutines from outside the scheduler, waits until every coroutine (including the ones they
+// spawn) has finished, then joins the workers
+// Must not be called from one of the scheduler's own coroutines
+// Returns SUCCESS on success and CLOSED_ERROR if the scheduler was already shut down
+enum channel_status coro_sched_shutdown(coro_sched_t* sched);
+
+// Frees all the memory allocated to the scheduler
+// Returns SUCCESS if destroy is successful and DESTROY_ERROR if coro_sched_shutdown has not been called
+enum channel_status coro_sched_destroy(coro_sched_t* sched);
+
+#endif // CORO_H
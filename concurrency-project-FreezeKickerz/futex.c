@@ -0,0 +1,324 @@
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "futex.h"
+#include "coro.h"
+
+/*
+ * A coroutine (see coro.c) must not put its worker thread to sleep, so
+ * futex_wait called from one parks the coroutine on the word instead: it
+ * links a record kept on its own stack into the word's FIFO. A coroutine
+ * counts itself in parked before it checks the value, under park_lock,
+ * and a waker changes the value with a seq_cst store before futex_wake
+ * reads the count, so either the coroutine sees the new value or the
+ * waker sees the coroutine. Wakers that find the count at zero skip the
+ * lock, so programs without coroutines pay one load per wake, and it is on
+ * the word's own cache line.
+ *
+ * futex_hold closes the gap a word on its waiter's stack leaves: the waker
+ * holds park_lock from before its store until it has taken the records
+ * off, and the waiter takes park_lock once before it drops the word.
+ * Parked coroutines taken off the word cannot run until they are readied,
+ * so their records outlive the unlock.
+ */
+
+typedef struct futex_parked {
+    coro_t* coro;
+    struct futex_parked* next; // next record of the same word, oldest first
+} futex_parked_t;
+
+// Parks the calling coroutine until futex_wake on word, unless word no longer holds expected
+static void park_wait(coro_t* self, futex_word_t* word, uint32_t expected)
+{
+    futex_parked_t record = {.coro = self, .next = NULL};
+    futex_mutex_lock(&word->park_lock);
+    atomic_fetch_add(&word->parked, 1);
+    if (atomic_load(&word->value) != expected) {
+        atomic_fetch_sub(&word->parked, 1);
+        futex_mutex_unlock(&word->park_lock);
+        return;
+    }
+    if (word->tail) word->tail->next = &record;
+    else            word->head = &record;
+    word->tail = &record;
+    // The record lives on this stack, so wakers must not get at it before the coroutine is off it
+    coro_park(&word->park_lock);
+}
+
+// Takes up to count records off word, oldest first, with park_lock held
+// Returns the first of them, linked through next
+static futex_parked_t* park_take(futex_word_t* word, int count, int* taken)
+{
+    futex_parked_t* first = word->head;
+    futex_parked_t* last = NULL;
+    int n = 0;
+    while (word->head && n < count) {
+        last = word->head;
+        word->head = last->next;
+        n++;
+    }
+    if (!word->head) word->tail = NULL;
+    if (last) last->next = NULL;
+    atomic_fetch_sub(&word->parked, (unsigned)n);
+    *taken = n;
+    return n ? first : NULL;
+}
+
+// Readies the coroutines park_take returned
+static void park_ready(futex_parked_t* woken)
+{
+    while (woken) {
+        // A readied coroutine may run and drop its record at once
+        futex_parked_t* next = woken->next;
+        coro_ready(woken->coro);
+        woken = next;
+    }
+}
+
+// Sleeps in the kernel while *word still holds expected, even when called from a coroutine
+static void kernel_wait(_Atomic uint32_t* word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+// Wakes up to count threads sleeping in the kernel on word
+// Returns how many it woke
+static int kernel_wake(_Atomic uint32_t* word, int count)
+{
+    long woken = syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+    return woken > 0 ? (int)woken : 0;
+}
+
+// Initializes a word holding value with nothing parked on it
+void futex_word_init(futex_word_t* word, uint32_t value)
+{
+    atomic_init(&word->value, value);
+    atomic_init(&word->parked, 0);
+    futex_mutex_init(&word->park_lock);
+    word->head = NULL;
+    word->tail = NULL;
+}
+
+// Blocks the calling thread (or coroutine) while word still holds expected
+// Returns when woken by futex_wake, when word no longer holds expected, or on a signal,
+// so callers must re-check their condition in a loop
+void futex_wait(futex_word_t* word, uint32_t expected)
+{
+    coro_t* self = coro_self();
+    if (self) {
+        park_wait(self, word, expected);
+        return;
+    }
+    kernel_wait(&word->value, expected);
+}
+
+// Like futex_wait, but gives up at deadline, an absolute CLOCK_MONOTONIC time (NULL waits without a deadline)
+// Returns false if it returned because the deadline passed
+bool futex_wait_until(futex_word_t* word, uint32_t expected, const struct timespec* deadline)
+{
+    // Parked coroutines have no timer, so a coroutine with a deadline blocks its worker thread instead
+    coro_t* self = coro_self();
+    if (self && !deadline) {
+        park_wait(self, word, expected);
+        return true;
+    }
+    // FUTEX_WAIT_BITSET takes an absolute timeout, so retrying after a signal does not extend the wait
+    long ret = syscall(SYS_futex, &word->value, FUTEX_WAIT_BITSET_PRIVATE, expected, deadline, NULL,
+                       FUTEX_BITSET_MATCH_ANY);
+    return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+// Wakes up to count threads (or coroutines) blocked in futex_wait on word
+void futex_wake(futex_word_t* word, int count)
+{
+    int woken = kernel_wake(&word->value, count);
+    if (woken >= count || atomic_load(&word->parked) == 0) return;
+    int taken;
+    futex_mutex_lock(&word->park_lock);
+    futex_parked_t* parked = park_take(word, count - woken, &taken);
+    futex_mutex_unlock(&word->park_lock);
+    park_ready(parked);
+}
+
+// Keeps the waiter from retiring word until futex_wake_held
+void futex_hold(futex_word_t* word)
+{
+    futex_mutex_lock(&word->park_lock);
+}
+
+// Like futex_wake on a word held with futex_hold, and lets its waiter retire it
+void futex_wake_held(futex_word_t* word, int count)
+{
+    int taken;
+    futex_parked_t* parked = park_take(word, count, &taken);
+    futex_mutex_unlock(&word->park_lock);
+    park_ready(parked);
+    // Only the address from here on: a stale wake there is harmless, as futex waiters re-check
+    if (taken < count) {
+        kernel_wake(&word->value, count - taken);
+    }
+}
+
+// Waits until a waker that changed word has let go of it
+void futex_retire(futex_word_t* word)
+{
+    futex_mutex_lock(&word->park_lock);
+    futex_mutex_unlock(&word->park_lock);
+}
+
+/*
+ * Wakers only make a system call when some thread has entered the queue,
+ * and only one wake is outstanding at a time: wake_pending stays set
+ * until a thread in the queue runs again, either returning from
+ * waitq_wait or leaving. Both clear the flag before the caller re-checks
+ * its condition (leaving threads re-check by passing the wake on), so a
+ * waker that skipped while the flag was set is seen by that re-check.
+ * A waker that finds the queue emptied under it clears the flag itself
+ * and starts over.
+ */
+
+// Initializes an empty wait queue
+void waitq_init(waitq_t* queue)
+{
+    futex_word_init(&queue->word, 0);
+    atomic_init(&queue->blocked, 0);
+    atomic_init(&queue->wake_pending, false);
+}
+
+// Announces the caller as a waiter and returns the word to pass to waitq_wait
+uint32_t waitq_enter(waitq_t* queue)
+{
+    atomic_fetch_add(&queue->blocked, 1);
+    return atomic_load(&queue->word.value);
+}
+
+// Sleeps unless the queue was woken since word was read
+// Returns the word to pass to the next waitq_wait
+uint32_t waitq_wait(waitq_t* queue, uint32_t word)
+{
+    futex_wait(&queue->word, word);
+    // Read the word before clearing the flag: a wake that sets the flag after this read
+    // also bumps the word after it, so the next waitq_wait returns at once and clears the flag again
+    word = atomic_load(&queue->word.value);
+    atomic_store(&queue->wake_pending, false);
+    return word;
+}
+
+// Like waitq_wait, but gives up at deadline (absolute CLOCK_MONOTONIC time, NULL for none)
+// Updates word for the next call and returns false if the deadline passed
+bool waitq_wait_until(waitq_t* queue, uint32_t* word, const struct timespec* deadline)
+{
+    bool woken = futex_wait_until(&queue->word, *word, deadline);
+    // Same order as in waitq_wait
+    *word = atomic_load(&queue->word.value);
+    atomic_store(&queue->wake_pending, false);
+    return woken;
+}
+
+// Removes the caller from the waiters
+void waitq_leave(waitq_t* queue)
+{
+    atomic_fetch_sub(&queue->blocked, 1);
+    atomic_store(&queue->wake_pending, false);
+}
+
+// Wakes one waiter unless there are none or an earlier wake has not been taken up yet
+// A woken waiter that finds the condition still true for others should call this again to pass the wake on
+void waitq_wake_one(waitq_t* queue)
+{
+    while (atomic_load(&queue->blocked) > 0 && !atomic_load(&queue->wake_pending)) {
+        if (atomic_exchange(&queue->wake_pending, true)) {
+            return;
+        }
+        atomic_fetch_add(&queue->word.value, 1);
+        futex_wake(&queue->word, 1);
+        if (atomic_load(&queue->blocked) > 0) {
+            return;
+        }
+        atomic_store(&queue->wake_pending, false);
+    }
+}
+
+// Wakes every waiter
+void waitq_wake_all(waitq_t* queue)
+{
+    atomic_fetch_add(&queue->word.value, 1);
+    futex_wake(&queue->word, INT_MAX);
+}
+
+// Initializes an unlocked mutex
+void futex_mutex_init(futex_mutex_t* mutex)
+{
+    atomic_init(&mutex->state, 0);
+}
+
+// Locks the mutex, sleeping while another thread holds it
+void futex_mutex_lock(futex_mutex_t* mutex)
+{
+    uint32_t state = 0;
+    if (atomic_compare_exchange_strong(&mutex->state, &state, 1)) {
+        return;
+    }
+    // Contended: mark the mutex as having sleepers so the holder wakes one of us
+    if (state != 2) {
+        state = atomic_exchange(&mutex->state, 2);
+    }
+    // Critical sections are short and never block, so even a coroutine waits for them in the kernel
+    while (state != 0) {
+        kernel_wait(&mutex->state, 2);
+        state = atomic_exchange(&mutex->state, 2);
+    }
+}
+
+// Unlocks the mutex and wakes one sleeper if there may be any
+void futex_mutex_unlock(futex_mutex_t* mutex)
+{
+    if (atomic_fetch_sub(&mutex->state, 1) != 1) {
+        atomic_store(&mutex->state, 0);
+        kernel_wake(&mutex->state, 1);
+    }
+}
+
+// Initializes a condition variable
+void futex_cond_init(futex_cond_t* cond)
+{
+    futex_word_init(&cond->seq, 0);
+}
+
+// Unlocks mutex, sleeps until the condition is signaled, and locks mutex again
+// May return spuriously, so callers must re-check their condition in a loop
+void futex_cond_wait(futex_cond_t* cond, futex_mutex_t* mutex)
+{
+    // Read under the mutex, so a signal sent after the caller's check changes it
+    uint32_t seq = atomic_load(&cond->seq.value);
+    futex_mutex_unlock(mutex);
+    futex_wait(&cond->seq, seq);
+    futex_mutex_lock(mutex);
+}
+
+// Like futex_cond_wait, but gives up at deadline (absolute CLOCK_MONOTONIC time, NULL for none)
+// Returns false if the deadline passed; mutex is locked again either way
+bool futex_cond_wait_until(futex_cond_t* cond, futex_mutex_t* mutex, const struct timespec* deadline)
+{
+    uint32_t seq = atomic_load(&cond->seq.value);
+    futex_mutex_unlock(mutex);
+    bool woken = futex_wait_until(&cond->seq, seq, deadline);
+    futex_mutex_lock(mutex);
+    return woken;
+}
+
+// Wakes one thread waiting on the condition
+void futex_cond_signal(futex_cond_t* cond)
+{
+    atomic_fetch_add(&cond->seq.value, 1);
+    futex_wake(&cond->seq, 1);
+}
+
+// Wakes every thread waiting on the condition
+void futex_cond_broadcast(futex_cond_t* cond)
+{
+    atomic_fetch_add(&cond->seq.value, 1);
+    futex_wake(&cond->seq, INT_MAX);
+}
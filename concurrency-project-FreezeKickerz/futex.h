@@ -0,0 +1,126 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Mutex in one futex word: 0 unlocked, 1 locked, 2 locked with possible sleepers
+// Waiting for it blocks the thread even in a coroutine, so it only guards short critical sections that never block
+typedef struct {
+    _Atomic uint32_t state;
+} futex_mutex_t;
+
+// Initializes an unlocked mutex
+void futex_mutex_init(futex_mutex_t* mutex);
+
+// Locks the mutex, sleeping while another thread holds it
+void futex_mutex_lock(futex_mutex_t* mutex);
+
+// Unlocks the mutex and wakes one sleeper if there may be any
+void futex_mutex_unlock(futex_mutex_t* mutex);
+
+struct futex_parked;
+
+// A futex word together with the coroutines (see coro.h) parked on it
+// Threads wait on value in the kernel; a coroutine links a record on its own stack into the word's queue,
+// so a waker finds everything it needs next to the word
+typedef struct {
+    _Atomic uint32_t value;
+    atomic_uint parked;        // coroutines counted in under park_lock, readable without it
+    futex_mutex_t park_lock;   // protects head and tail
+    struct futex_parked* head; // oldest parked coroutine's record
+    struct futex_parked* tail;
+} futex_word_t;
+
+// Initializes a word holding value with nothing parked on it
+void futex_word_init(futex_word_t* word, uint32_t value);
+
+// Blocks the calling thread while word still holds expected
+// Called from a coroutine, it parks the coroutine and leaves its worker thread free
+// Returns when woken by futex_wake, when word no longer holds expected, or on a signal,
+// so callers must re-check their condition in a loop
+void futex_wait(futex_word_t* word, uint32_t expected);
+
+// Like futex_wait, but gives up at deadline, an absolute CLOCK_MONOTONIC time (NULL waits without a deadline)
+// A coroutine only parks without a deadline; with one it blocks its worker thread
+// Returns false if it returned because the deadline passed
+bool futex_wait_until(futex_word_t* word, uint32_t expected, const struct timespec* deadline);
+
+// Wakes up to count threads or coroutines blocked in futex_wait on word
+// The word must stay valid until futex_wake returns; see futex_hold for words that may not
+void futex_wake(futex_word_t* word, int count);
+
+// A word on the stack of its only waiter may go away as soon as the waiter sees it change, so its waker
+// calls futex_hold before the store that lets the waiter go and futex_wake_held instead of futex_wake,
+// and the waiter calls futex_retire once it has seen the change and before the word goes out of scope
+
+// Keeps the waiter from retiring word until futex_wake_held
+void futex_hold(futex_word_t* word);
+
+// Like futex_wake on a word held with futex_hold, and lets its waiter retire it
+// Only touches the word's address after that, so the waiter may already be gone
+void futex_wake_held(futex_word_t* word, int count);
+
+// Waits until a waker that changed word has let go of it
+void futex_retire(futex_word_t* word);
+
+// Wait queue for threads blocked until some condition may have become true
+// A waiter calls waitq_enter, re-checks its condition, and then alternates waitq_wait with re-checks;
+// it calls waitq_leave once it is done. The thread that makes the condition true calls waitq_wake_one
+// after a sequentially consistent store, so either the waiter's re-check sees the change or the wake finds it.
+typedef struct {
+    futex_word_t word;         // bumped before every wake
+    atomic_uint blocked;       // threads between waitq_enter and waitq_leave
+    atomic_bool wake_pending;  // a thread was woken and has not run yet
+} waitq_t;
+
+// Initializes an empty wait queue
+void waitq_init(waitq_t* queue);
+
+// Announces the caller as a waiter and returns the word to pass to waitq_wait
+uint32_t waitq_enter(waitq_t* queue);
+
+// Sleeps unless the queue was woken since word was read
+// Returns the word to pass to the next waitq_wait
+uint32_t waitq_wait(waitq_t* queue, uint32_t word);
+
+// Like waitq_wait, but gives up at deadline (absolute CLOCK_MONOTONIC time, NULL for none)
+// Updates word for the next call and returns false if the deadline passed
+bool waitq_wait_until(waitq_t* queue, uint32_t* word, const struct timespec* deadline);
+
+// Removes the caller from the waiters
+// A caller whose condition may still hold for other waiters must then call waitq_wake_one
+void waitq_leave(waitq_t* queue);
+
+// Wakes one waiter unless there are none or an earlier wake has not been taken up yet
+// A woken waiter that finds the condition still true for others should call this again to pass the wake on
+void waitq_wake_one(waitq_t* queue);
+
+// Wakes every waiter
+void waitq_wake_all(waitq_t* queue);
+
+// Condition variable in one futex word, bumped by every signal and broadcast
+typedef struct {
+    futex_word_t seq;
+} futex_cond_t;
+
+// Initializes a condition variable
+void futex_cond_init(futex_cond_t* cond);
+
+// Unlocks mutex, sleeps until the condition is signaled, and locks mutex again
+// May return spuriously, so callers must re-check their condition in a loop
+void futex_cond_wait(futex_cond_t* cond, futex_mutex_t* mutex);
+
+// Like futex_cond_wait, but gives up at deadline (absolute CLOCK_MONOTONIC time, NULL for none)
+// Returns false if the deadline passed; mutex is locked again either way
+bool futex_cond_wait_until(futex_cond_t* cond, futex_mutex_t* mutex, const struct timespec* deadline);
+
+// Wakes one thread waiting on the condition
+void futex_cond_signal(futex_cond_t* cond);
+
+// Wakes every thread waiting on the condition
+void futex_cond_broadcast(futex_cond_t* cond);
+
+#endif // FUTEX_H
@@ -73,6 +73,8 @@ add_test_cases("test_select_with_select_size1", iters_slow)
 add_test_cases("test_select_with_same_channel_size1")
 add_test_cases("test_select_with_send_receive_on_same_channel_size1")
 add_test_cases("test_select_with_duplicate_channel_size1", iters_slow)
+add_test_cases("test_select_with_select_unbuffered", iters_slow)
+add_test_cases("test_select_with_send_receive_on_same_channel_unbuffered", iters_slow)
 add_test_case_channel("test_stress", iters_one, timeout_channel * 5)
 add_test_case_sanitize("test_stress", iters_one, timeout_sanitize * 5)
 add_test_case_valgrind("test_stress", iters_one, timeout_valgrind * 5)
@@ -80,6 +82,34 @@ add_test_cases("test_select_response_time", iters_one, timeout_response_time)
 add_test_cases("test_cpu_utilization_select", iters_one, timeout_cpu_utilization)
 add_test_cases("test_cpu_utilization_overall", iters_one, timeout_cpu_utilization)
 add_test_cases("test_for_too_many_wakeups", iters_one, timeout_too_many_wakeups)
+add_test_cases("test_batch_send_receive", iters_slow)
+add_test_cases("test_non_blocking_batch")
+add_test_cases("test_select_policy")
+add_test_cases("test_unbuffered_close_with_receive", iters_one)
+add_test_cases("test_typed_channel", iters_slow)
+add_test_cases("test_timed_operations", iters_one)
+add_test_cases("test_unbuffered_handoff_order", iters_one)
+add_test_cases("test_thread_pool", iters_slow)
+add_test_cases("test_floyd_warshall", iters_one)
+add_test_cases("test_topology_loader", iters_slow)
+add_test_cases("test_futex_mutex", iters_one)
+add_test_cases("test_futex_lost_wakeup", iters_one)
+add_test_cases("test_futex_cond_signal", iters_one)
+add_test_cases("test_list_link")
+add_test_cases("test_select_wake_one", iters_one)
+add_test_case_channel("test_stress_delta", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_delta", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_delta", iters_one, timeout_valgrind * 5)
+add_test_case_channel("test_stress_capacity", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_capacity", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_capacity", iters_one, timeout_valgrind * 5)
+add_test_cases("test_channel_stats", iters_one)
+add_test_cases("test_buffer_ring")
+add_test_cases("test_broadcast", iters_slow)
+add_test_cases("test_channel_eventfd")
+add_test_case_channel("test_coro", iters_slow, timeout_channel * 2)
+add_test_case_sanitize("test_coro", iters_one)
+add_test_case_valgrind("test_coro", iters_one)
 
 # Score distribution
 point_breakdown_checkpoint = [
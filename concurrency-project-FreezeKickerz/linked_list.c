@@ -120,6 +120,25 @@ list_node_t* list_insert(list_t* list, void* data)
     {
         return NULL;
     }
+    list_link(list, node, data);
+    return node;
+}
+
+// Removes a node from the list and frees the node resources
+void list_remove(list_t* list, list_node_t* node)
+{
+    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    if (!list || !node)
+    {
+        return;
+    }
+    list_unlink(list, node);
+    free(node);
+}
+
+// Links a caller-owned node with the given data at the tail of the list without allocating
+void list_link(list_t* list, list_node_t* node, void* data)
+{
     node->data = data;
     node->next = NULL;
     node->prev = list->tail;
@@ -134,18 +153,11 @@ list_node_t* list_insert(list_t* list, void* data)
     }
     list->tail = node;
     list->count++;
-    return node;
 }
 
-// Removes a node from the list and frees the node resources
-void list_remove(list_t* list, list_node_t* node)
+// Unlinks a node from the list without freeing it
+void list_unlink(list_t* list, list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    if (!list || !node)
-    {
-        return;
-    }
-
     if (node == list->head)
     {
         list->head = node->next;
@@ -162,7 +174,5 @@ void list_remove(list_t* list, list_node_t* node)
     {
         node->next->prev = node->prev;
     }
-
     list->count--;
-    free(node);
 }
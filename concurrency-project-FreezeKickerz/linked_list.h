@@ -53,4 +53,10 @@ list_node_t* list_insert(list_t* list, void* data);
 // Removes a node from the list and frees the node resources
 void list_remove(list_t* list, list_node_t* node);
 
+// Links a caller-owned node with the given data at the tail of the list without allocating
+void list_link(list_t* list, list_node_t* node, void* data);
+
+// Unlinks a node from the list without freeing it
+void list_unlink(list_t* list, list_node_t* node);
+
 #endif // LINKED_LIST_H
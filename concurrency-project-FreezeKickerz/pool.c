@@ -0,0 +1,301 @@
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Every worker owns a fixed-size Chase-Lev deque. Tasks submitted by a
+ * running task go to the bottom of its worker's deque and are popped from
+ * there again, so nested work stays on one core; an idle worker steals
+ * from the top of another worker's deque. Tasks submitted from outside go
+ * through a typed channel that every worker polls. Workers with nothing
+ * to do sleep on the idle wait queue: pushes and submissions publish the
+ * task with a seq_cst store before waking it (see futex.h).
+ */
+
+// The worker running on this thread, if it belongs to a pool
+static _Thread_local pool_worker_t* current_worker;
+
+// Pushes a task at the bottom of the worker's own deque
+// Returns false if the deque is full
+static bool deque_push(pool_worker_t* worker, const pool_task_t* task)
+{
+    int64_t b = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&worker->top, memory_order_acquire);
+    if (b - t >= POOL_DEQUE_SIZE) return false;
+    pool_slot_t* slot = &worker->slots[b & (POOL_DEQUE_SIZE - 1)];
+    atomic_store_explicit(&slot->fn, task->fn, memory_order_relaxed);
+    atomic_store_explicit(&slot->arg, task->arg, memory_order_relaxed);
+    atomic_store_explicit(&slot->future, task->future, memory_order_relaxed);
+    atomic_store(&worker->bottom, b + 1);
+    return true;
+}
+
+static void slot_read(pool_slot_t* slot, pool_task_t* task)
+{
+    task->fn     = atomic_load_explicit(&slot->fn, memory_order_relaxed);
+    task->arg    = atomic_load_explicit(&slot->arg, memory_order_relaxed);
+    task->future = atomic_load_explicit(&slot->future, memory_order_relaxed);
+}
+
+// Pops the newest task from the bottom of the worker's own deque
+// Returns false if the deque is empty
+static bool deque_pop(pool_worker_t* worker, pool_task_t* task)
+{
+    // seq_cst store then load: either a thief sees the lower bottom or this sees its top
+    int64_t b = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    atomic_store(&worker->bottom, b);
+    int64_t t = atomic_load(&worker->top);
+    if (t > b) {
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+    slot_read(&worker->slots[b & (POOL_DEQUE_SIZE - 1)], task);
+    if (t < b) return true;
+
+    // The last task: thieves may be taking it too, whoever moves top first wins
+    bool won = atomic_compare_exchange_strong(&worker->top, &t, t + 1);
+    atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+    return won;
+}
+
+// Steals the oldest task from the top of another worker's deque
+// Returns 1 if a task was stolen, 0 if the deque was empty and -1 if another thread took the task first
+static int deque_steal(pool_worker_t* victim, pool_task_t* task)
+{
+    int64_t t = atomic_load(&victim->top);
+    int64_t b = atomic_load(&victim->bottom);
+    if (t >= b) return 0;
+    // The owner cannot reuse this slot before top moves past it, as the deque would be full
+    slot_read(&victim->slots[t & (POOL_DEQUE_SIZE - 1)], task);
+    return atomic_compare_exchange_strong(&victim->top, &t, t + 1) ? 1 : -1;
+}
+
+// Advances the worker's xorshift64 generator
+static uint64_t worker_rand(pool_worker_t* worker)
+{
+    uint64_t x = worker->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    worker->rng = x;
+    return x;
+}
+
+// Tries every other worker's deque once, starting at a random one
+static bool pool_steal(pool_worker_t* self, pool_task_t* task)
+{
+    pool_t* pool = self->pool;
+    size_t n = pool->num_workers;
+    if (n < 2) return false;
+    size_t start = (size_t)(worker_rand(self) % n);
+    for (size_t i = 0; i < n; i++) {
+        size_t v = start + i < n ? start + i : start + i - n;
+        pool_worker_t* victim = &pool->workers[v];
+        if (victim == self) continue;
+        int stolen;
+        while ((stolen = deque_steal(victim, task)) < 0) {
+            // Lost a race for the victim's oldest task; the next one may be free
+        }
+        if (stolen) return true;
+    }
+    return false;
+}
+
+// Finds the next task for the worker: its own deque first, then the pool's queue, then the other deques
+// Returns SUCCESS with the task, CHANNEL_EMPTY if there is none, and CLOSED_ERROR once the pool has shut down
+static enum channel_status pool_find_task(pool_worker_t* self, pool_task_t* task)
+{
+    if (deque_pop(self, task)) return SUCCESS;
+    enum channel_status status = channel_non_blocking_receive_value(self->pool->queue, task);
+    if (status != CHANNEL_EMPTY) return status;
+    return pool_steal(self, task) ? SUCCESS : CHANNEL_EMPTY;
+}
+
+// Runs the task and delivers its result
+static void pool_run(pool_worker_t* self, const pool_task_t* task)
+{
+    void* result = task->fn(task->arg);
+    if (task->future) {
+        channel_send(task->future, result);
+    }
+    // Only this worker writes its count, so no read-modify-write is needed
+    atomic_store(&self->completed, atomic_load_explicit(&self->completed, memory_order_relaxed) + 1);
+}
+
+// Sleeps until the worker finds a task or the pool shuts down
+// Returns the status of the last pool_find_task
+static enum channel_status pool_idle(pool_worker_t* self, pool_task_t* task)
+{
+    pool_t* pool = self->pool;
+    enum channel_status status;
+    uint32_t word = waitq_enter(&pool->idle);
+    while ((status = pool_find_task(self, task)) == CHANNEL_EMPTY) {
+        // A worker running dry during a shutdown may have finished the last task
+        if (atomic_load(&pool->closing)) {
+            waitq_wake_all(&pool->drained);
+        }
+        word = waitq_wait(&pool->idle, word);
+    }
+    waitq_leave(&pool->idle);
+    // There may be more where this task came from, so let another sleeper look
+    if (status == SUCCESS) {
+        waitq_wake_one(&pool->idle);
+    }
+    return status;
+}
+
+static void* pool_worker_main(void* arg)
+{
+    pool_worker_t* self = arg;
+    current_worker = self;
+    pool_task_t task;
+    while (true) {
+        enum channel_status status = pool_find_task(self, &task);
+        if (status == CHANNEL_EMPTY) {
+            status = pool_idle(self, &task);
+        }
+        if (status != SUCCESS) break;
+        pool_run(self, &task);
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+// Returns true once every task scheduled so far has finished
+static bool pool_drained(pool_t* pool)
+{
+    // Both sums only grow and a task is counted as scheduled before it can finish,
+    // so reading the finished tasks first can only make the pool look busier than it is
+    size_t completed = 0;
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        completed += atomic_load(&pool->workers[i].completed);
+    }
+    size_t scheduled = atomic_load(&pool->submitted);
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        scheduled += atomic_load(&pool->workers[i].spawned);
+    }
+    return completed == scheduled;
+}
+
+// Creates a pool with the given number of worker threads (0 starts one per online CPU)
+// Returns NULL on failure
+pool_t* pool_create(size_t workers)
+{
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (size_t)cpus : 1;
+    }
+    pool_t* pool = malloc(sizeof(pool_t));
+    if (!pool) return NULL;
+    pool->workers = aligned_alloc(_Alignof(pool_worker_t), workers * sizeof(pool_worker_t));
+    pool->queue = channel_create_typed(POOL_QUEUE_SIZE, sizeof(pool_task_t));
+    if (!pool->workers || !pool->queue) {
+        if (pool->queue) {
+            channel_close(pool->queue);
+            channel_destroy(pool->queue);
+        }
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    waitq_init(&pool->idle);
+    waitq_init(&pool->drained);
+    atomic_init(&pool->submitted, 0);
+    atomic_init(&pool->closing, false);
+    pool->shut_down = false;
+
+    for (size_t i = 0; i < workers; i++) {
+        pool_worker_t* worker = &pool->workers[i];
+        atomic_init(&worker->top, 0);
+        atomic_init(&worker->bottom, 0);
+        atomic_init(&worker->spawned, 0);
+        atomic_init(&worker->completed, 0);
+        worker->rng = ((uint64_t)(i + 1) * 0x9e3779b97f4a7c15ULL) | 1;
+        worker->pool = pool;
+    }
+    // Workers that have not started yet just have nothing to steal
+    pool->num_workers = workers;
+    pool->started = 0;
+    for (size_t i = 0; i < workers; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, pool_worker_main, &pool->workers[i]) != 0) {
+            // Stop the workers that did start
+            pool_shutdown(pool);
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+    return pool;
+}
+
+// Schedules fn(arg) on the pool
+// If future is not NULL, the task's return value is sent on it once the task finishes
+// Returns SUCCESS if the task was scheduled,
+// CLOSED_ERROR if the pool is shutting down and no longer accepts tasks from outside, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status pool_submit(pool_t* pool, pool_fn_t fn, void* arg, channel_t* future)
+{
+    if (!pool || !fn) return GENERIC_ERROR;
+    pool_task_t task = {fn, arg, future};
+
+    pool_worker_t* self = current_worker;
+    if (self && self->pool == pool) {
+        // Counted before it is published, so it cannot finish before it was scheduled
+        atomic_store(&self->spawned, atomic_load_explicit(&self->spawned, memory_order_relaxed) + 1);
+        if (!deque_push(self, &task) && channel_non_blocking_send_value(pool->queue, &task) != SUCCESS) {
+            // Nowhere to put it: run it here instead of blocking a worker on its own pool
+            pool_run(self, &task);
+            return SUCCESS;
+        }
+        waitq_wake_one(&pool->idle);
+        return SUCCESS;
+    }
+
+    atomic_fetch_add(&pool->submitted, 1);
+    enum channel_status status = atomic_load(&pool->closing) ? CLOSED_ERROR : channel_send_value(pool->queue, &task);
+    if (status != SUCCESS) {
+        // pool_shutdown may be waiting for the count to drop back
+        atomic_fetch_sub(&pool->submitted, 1);
+        waitq_wake_all(&pool->drained);
+        return status;
+    }
+    waitq_wake_one(&pool->idle);
+    return SUCCESS;
+}
+
+// Stops accepting tasks from outside the pool, waits until every scheduled task has finished,
+// then closes the pool's queue with channel_close and joins the workers
+// Must not be called from one of the pool's own tasks
+// Returns SUCCESS on success and CLOSED_ERROR if the pool was already shut down
+enum channel_status pool_shutdown(pool_t* pool)
+{
+    if (atomic_exchange(&pool->closing, true)) return CLOSED_ERROR;
+
+    uint32_t word = waitq_enter(&pool->drained);
+    while (!pool_drained(pool)) {
+        word = waitq_wait(&pool->drained, word);
+    }
+    waitq_leave(&pool->drained);
+
+    // Idle workers see the closed queue and exit
+    channel_close(pool->queue);
+    waitq_wake_all(&pool->idle);
+    for (size_t i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pool->shut_down = true;
+    return SUCCESS;
+}
+
+// Frees all the memory allocated to the pool
+// Returns SUCCESS if destroy is successful and DESTROY_ERROR if pool_shutdown has not been called
+enum channel_status pool_destroy(pool_t* pool)
+{
+    if (!pool->shut_down) return DESTROY_ERROR;
+    channel_destroy(pool->queue);
+    free(pool->workers);
+    free(pool);
+    return SUCCESS;
+}
@@ -0,0 +1,85 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "channel.h"
+#include "futex.h"
+
+// Number of tasks a worker's deque holds (a power of two); a full deque overflows into the pool's queue
+#define POOL_DEQUE_SIZE 4096
+
+// Capacity of the queue that takes tasks submitted from outside the pool
+#define POOL_QUEUE_SIZE 1024
+
+// A task runs fn(arg); its return value is sent on future unless future is NULL
+typedef void* (*pool_fn_t)(void* arg);
+
+typedef struct {
+    pool_fn_t fn;
+    void* arg;
+    channel_t* future;
+} pool_task_t;
+
+// One deque slot; thieves may read a slot while its owner reuses it, so every field is atomic
+typedef struct {
+    _Atomic(pool_fn_t) fn;
+    _Atomic(void*) arg;
+    _Atomic(channel_t*) future;
+} pool_slot_t;
+
+struct pool;
+
+// A worker thread and its Chase-Lev deque: the owner pushes and pops at bottom, thieves steal from top
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;   // next task to steal
+    _Alignas(64) _Atomic int64_t bottom; // next free slot, only written by the owner
+    atomic_size_t spawned;              // tasks submitted by this worker's tasks, only written by the owner
+    atomic_size_t completed;            // tasks this worker ran, only written by the owner
+    uint64_t rng;                       // picks the first victim to steal from
+    struct pool* pool;
+    pthread_t thread;
+    pool_slot_t slots[POOL_DEQUE_SIZE];
+} pool_worker_t;
+
+// Defines pool object
+typedef struct pool {
+    size_t num_workers;
+    size_t started;            // workers whose thread is running, only used by pool_create and pool_shutdown
+    pool_worker_t* workers;
+    channel_t* queue;          // typed channel of pool_task_t for tasks submitted from outside the pool
+    waitq_t idle;              // workers sleeping until there is work
+    waitq_t drained;           // pool_shutdown waiting for the last task to finish
+    atomic_size_t submitted;   // tasks accepted from outside the pool
+    atomic_bool closing;       // pool_shutdown has started; tasks from outside are refused
+    bool shut_down;
+} pool_t;
+
+// Creates a pool with the given number of worker threads (0 starts one per online CPU)
+// Returns NULL on failure
+pool_t* pool_create(size_t workers);
+
+// Schedules fn(arg) on the pool
+// If future is not NULL, the task's return value is sent on it once the task finishes, so it can be received
+// (or selected on) like any other message; the channel needs room for the result or a waiting receiver,
+// or the worker blocks until there is one
+// A task submitted by another task of the same pool goes to its worker's own deque, where idle workers steal it
+// Submitting from outside the pool blocks while the pool's queue is full
+// Returns SUCCESS if the task was scheduled,
+// CLOSED_ERROR if the pool is shutting down and no longer accepts tasks from outside, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status pool_submit(pool_t* pool, pool_fn_t fn, void* arg, channel_t* future);
+
+// Stops accepting tasks from outside the pool, waits until every scheduled task (including the tasks they submit)
+// has finished, then closes the pool's queue with channel_close and joins the workers
+// Returns SUCCESS on success and CLOSED_ERROR if the pool was already shut down
+enum channel_status pool_shutdown(pool_t* pool);
+
+// Frees all the memory allocated to the pool
+// Returns SUCCESS if destroy is successful and DESTROY_ERROR if pool_shutdown has not been called
+enum channel_status pool_destroy(pool_t* pool);
+
+#endif // POOL_H
@@ -3,10 +3,21 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #include "channel.h"
+#include "pool.h"
 #include "stress.h"
 
-typedef unsigned int distance_t;
 typedef struct {
     size_t src;
     size_t epoch;
@@ -20,6 +31,39 @@ static size_t num_channel;
 static channel_t** channels;
 static channel_t* done_channel;
 static channel_t* completed_channel;
+static enum select_mode router_mode;
+static size_t num_states;
+// What the routers sent during the current run
+static atomic_size_t sent_messages;
+static atomic_size_t sent_bytes;
+
+/*
+ * Convergence is detected with a credit counter instead of polling. It
+ * counts the updates that have been scheduled but not applied yet, plus
+ * one for every router holding changes it has not scheduled: a router
+ * adds the credit for any work an update causes before it gives back the
+ * update's own. The counter can therefore only reach zero once no router
+ * has anything left to send or apply, and nothing can start again after
+ * that; whoever gives back the last credit records the time and signals
+ * converged_channel.
+ */
+static atomic_size_t outstanding_work;
+static channel_t* converged_channel;
+static struct timespec converged_at;
+
+static void work_add(size_t credits)
+{
+    atomic_fetch_add(&outstanding_work, credits);
+}
+
+static void work_done(size_t credits)
+{
+    if (atomic_fetch_sub(&outstanding_work, credits) == credits) {
+        clock_gettime(CLOCK_MONOTONIC, &converged_at);
+        enum channel_status status = channel_send(converged_channel, NULL);
+        assert(status == SUCCESS);
+    }
+}
 
 distance_t get_link_distance(size_t src, size_t dst) {
     return topology[src * num_channel + dst];
@@ -37,20 +81,259 @@ void set_solution_distance(size_t src, size_t dst, distance_t distance) {
     solution[src * num_channel + dst] = distance;
 }
 
-void floyd_warshall()
+void floyd_warshall_reference(distance_t* dist, size_t n)
 {
-    memcpy(solution, topology, sizeof(distance_t) * num_channel * num_channel);
-    for (size_t intermediate = 0; intermediate < num_channel; intermediate++) {
-        for (size_t src = 0; src < num_channel; src++) {
-            for (size_t dst = 0; dst < num_channel; dst++) {
-                if (get_solution_distance(src, intermediate) + get_solution_distance(intermediate, dst) < get_solution_distance(src, dst)) {
-                    set_solution_distance(src, dst, get_solution_distance(src, intermediate) + get_solution_distance(intermediate, dst));
+    for (size_t intermediate = 0; intermediate < n; intermediate++) {
+        for (size_t src = 0; src < n; src++) {
+            for (size_t dst = 0; dst < n; dst++) {
+                if (dist[src * n + intermediate] + dist[intermediate * n + dst] < dist[src * n + dst]) {
+                    dist[src * n + dst] = dist[src * n + intermediate] + dist[intermediate * n + dst];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * The blocked solver copies the matrix into FW_BLOCK x FW_BLOCK tiles,
+ * each contiguous and padded with inf_distance. Round k first closes the
+ * diagonal tile (k, k), then the tiles of row k and column k against it,
+ * and finally every other tile (i, j) against (i, k) and (k, j). Each
+ * step only relaxes through intermediates that are already final, so the
+ * result is the exact shortest distances, as the textbook order gives.
+ * Tiles of the last two steps are independent of each other and run on a
+ * thread pool, one task per tile row; the padding is unreachable, as
+ * going through it costs more than inf_distance. Distances are unsigned
+ * and at most inf_distance, so a sum never wraps and the kernels can use
+ * an unsigned minimum.
+ */
+
+#define FW_TILE (FW_BLOCK * FW_BLOCK)
+#define FW_LANES 8 // distances per AVX2 register
+
+// Relaxes tile c through tiles a and b: c[i][j] = min(c[i][j], a[i][k] + b[k][j])
+// Goes in textbook order (k outermost), so c may be the same tile as a or b
+typedef void (*fw_kernel_t)(distance_t* c, const distance_t* a, const distance_t* b);
+
+static void fw_tile_in_place(distance_t* c, const distance_t* a, const distance_t* b)
+{
+    for (size_t k = 0; k < FW_BLOCK; k++) {
+        for (size_t i = 0; i < FW_BLOCK; i++) {
+            distance_t a_ik = a[i * FW_BLOCK + k];
+            for (size_t j = 0; j < FW_BLOCK; j++) {
+                distance_t sum = a_ik + b[k * FW_BLOCK + j];
+                if (sum < c[i * FW_BLOCK + j]) {
+                    c[i * FW_BLOCK + j] = sum;
                 }
             }
         }
     }
 }
 
+// Same for a c distinct from a and b, which lets every row of c stay in registers while it goes through b
+static void fw_tile_min_plus(distance_t* c, const distance_t* a, const distance_t* b)
+{
+    for (size_t i = 0; i < FW_BLOCK; i++) {
+        distance_t row[FW_BLOCK];
+        memcpy(row, c + i * FW_BLOCK, sizeof(row));
+        for (size_t k = 0; k < FW_BLOCK; k++) {
+            distance_t a_ik = a[i * FW_BLOCK + k];
+            for (size_t j = 0; j < FW_BLOCK; j++) {
+                distance_t sum = a_ik + b[k * FW_BLOCK + j];
+                row[j] = sum < row[j] ? sum : row[j];
+            }
+        }
+        memcpy(c + i * FW_BLOCK, row, sizeof(row));
+    }
+}
+
+#if defined(__x86_64__)
+// The AVX2 versions of both kernels relax eight distances of a row per instruction
+__attribute__((target("avx2")))
+static void fw_tile_in_place_avx2(distance_t* c, const distance_t* a, const distance_t* b)
+{
+    for (size_t k = 0; k < FW_BLOCK; k++) {
+        const __m256i* b_row = (const __m256i*)(b + k * FW_BLOCK);
+        for (size_t i = 0; i < FW_BLOCK; i++) {
+            __m256i* c_row = (__m256i*)(c + i * FW_BLOCK);
+            __m256i a_ik = _mm256_set1_epi32((int)a[i * FW_BLOCK + k]);
+            for (size_t j = 0; j < FW_BLOCK / FW_LANES; j++) {
+                c_row[j] = _mm256_min_epu32(c_row[j], _mm256_add_epi32(a_ik, b_row[j]));
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void fw_tile_min_plus_avx2(distance_t* c, const distance_t* a, const distance_t* b)
+{
+    for (size_t i = 0; i < FW_BLOCK; i++) {
+        __m256i* c_row = (__m256i*)(c + i * FW_BLOCK);
+        __m256i row[FW_BLOCK / FW_LANES];
+        #pragma GCC unroll 8
+        for (size_t j = 0; j < FW_BLOCK / FW_LANES; j++) {
+            row[j] = c_row[j];
+        }
+        for (size_t k = 0; k < FW_BLOCK; k++) {
+            const __m256i* b_row = (const __m256i*)(b + k * FW_BLOCK);
+            __m256i a_ik = _mm256_set1_epi32((int)a[i * FW_BLOCK + k]);
+            #pragma GCC unroll 8
+            for (size_t j = 0; j < FW_BLOCK / FW_LANES; j++) {
+                row[j] = _mm256_min_epu32(row[j], _mm256_add_epi32(a_ik, b_row[j]));
+            }
+        }
+        #pragma GCC unroll 8
+        for (size_t j = 0; j < FW_BLOCK / FW_LANES; j++) {
+            c_row[j] = row[j];
+        }
+    }
+}
+#endif
+
+typedef struct {
+    distance_t* tiles;      // 64-byte aligned, so every tile row is too
+    size_t blocks;          // tiles per row and column
+    size_t round;
+    fw_kernel_t in_place;
+    fw_kernel_t min_plus;
+} fw_matrix_t;
+
+typedef struct {
+    fw_matrix_t* matrix;
+    size_t index;
+} fw_task_t;
+
+static distance_t* fw_tile(const fw_matrix_t* matrix, size_t row, size_t col)
+{
+    return matrix->tiles + (row * matrix->blocks + col) * FW_TILE;
+}
+
+// Relaxes tiles (index, round) and (round, index) through the finished diagonal tile
+static void* fw_cross_task(void* arg)
+{
+    fw_task_t* task = arg;
+    fw_matrix_t* matrix = task->matrix;
+    size_t k = matrix->round;
+    distance_t* diagonal = fw_tile(matrix, k, k);
+    distance_t* row = fw_tile(matrix, k, task->index);
+    distance_t* col = fw_tile(matrix, task->index, k);
+    matrix->in_place(row, diagonal, row);
+    matrix->in_place(col, col, diagonal);
+    return NULL;
+}
+
+// Relaxes every tile of tile row index outside row and column round
+static void* fw_rest_task(void* arg)
+{
+    fw_task_t* task = arg;
+    fw_matrix_t* matrix = task->matrix;
+    size_t k = matrix->round;
+    const distance_t* col = fw_tile(matrix, task->index, k);
+    for (size_t j = 0; j < matrix->blocks; j++) {
+        if (j == k) continue;
+        matrix->min_plus(fw_tile(matrix, task->index, j), col, fw_tile(matrix, k, j));
+    }
+    return NULL;
+}
+
+// Runs fn on every tile row but round, on the pool if there is one, and waits for all of them
+static void fw_run_phase(pool_t* pool, channel_t* done, fw_task_t* tasks, pool_fn_t fn)
+{
+    fw_matrix_t* matrix = tasks[0].matrix;
+    for (size_t i = 0; i < matrix->blocks; i++) {
+        if (i == matrix->round) continue;
+        if (pool) {
+            enum channel_status status = pool_submit(pool, fn, &tasks[i], done);
+            assert(status == SUCCESS);
+        } else {
+            fn(&tasks[i]);
+        }
+    }
+    if (pool) {
+        for (size_t i = 1; i < matrix->blocks; i++) {
+            void* data;
+            enum channel_status status = channel_receive(done, &data);
+            assert(status == SUCCESS);
+        }
+    }
+}
+
+void floyd_warshall_blocked(distance_t* dist, size_t n, size_t threads)
+{
+    if (n == 0) return;
+    fw_matrix_t matrix;
+    matrix.blocks = (n + FW_BLOCK - 1) / FW_BLOCK;
+    matrix.tiles = aligned_alloc(64, sizeof(distance_t) * matrix.blocks * matrix.blocks * FW_TILE);
+    assert(matrix.tiles != NULL);
+#if defined(__x86_64__)
+    bool avx2 = __builtin_cpu_supports("avx2");
+    matrix.in_place = avx2 ? fw_tile_in_place_avx2 : fw_tile_in_place;
+    matrix.min_plus = avx2 ? fw_tile_min_plus_avx2 : fw_tile_min_plus;
+#else
+    matrix.in_place = fw_tile_in_place;          // Portable kernels elsewhere
+    matrix.min_plus = fw_tile_min_plus;
+#endif
+    size_t padded = matrix.blocks * FW_BLOCK;
+    for (size_t src = 0; src < padded; src++) {
+        for (size_t dst = 0; dst < padded; dst++) {
+            distance_t* tile = fw_tile(&matrix, src / FW_BLOCK, dst / FW_BLOCK);
+            tile[(src % FW_BLOCK) * FW_BLOCK + dst % FW_BLOCK] = (src < n && dst < n) ? dist[src * n + dst] : inf_distance;
+        }
+    }
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    pool_t* pool = NULL;
+    channel_t* done = NULL;
+    if (threads > 1 && matrix.blocks > 1) {
+        pool = pool_create(threads);
+        assert(pool != NULL);
+        // Room for the result of every task of a phase, so workers never wait on it
+        done = channel_create(matrix.blocks - 1);
+        assert(done != NULL);
+    }
+    fw_task_t* tasks = malloc(sizeof(fw_task_t) * matrix.blocks);
+    assert(tasks != NULL);
+    for (size_t i = 0; i < matrix.blocks; i++) {
+        tasks[i].matrix = &matrix;
+        tasks[i].index = i;
+    }
+
+    for (matrix.round = 0; matrix.round < matrix.blocks; matrix.round++) {
+        distance_t* diagonal = fw_tile(&matrix, matrix.round, matrix.round);
+        matrix.in_place(diagonal, diagonal, diagonal);
+        fw_run_phase(pool, done, tasks, fw_cross_task);
+        fw_run_phase(pool, done, tasks, fw_rest_task);
+    }
+
+    if (pool) {
+        enum channel_status status = pool_shutdown(pool);
+        assert(status == SUCCESS);
+        status = pool_destroy(pool);
+        assert(status == SUCCESS);
+        status = channel_close(done);
+        assert(status == SUCCESS);
+        status = channel_destroy(done);
+        assert(status == SUCCESS);
+    }
+    free(tasks);
+    for (size_t src = 0; src < n; src++) {
+        for (size_t dst = 0; dst < n; dst++) {
+            const distance_t* tile = fw_tile(&matrix, src / FW_BLOCK, dst / FW_BLOCK);
+            dist[src * n + dst] = tile[(src % FW_BLOCK) * FW_BLOCK + dst % FW_BLOCK];
+        }
+    }
+    free(matrix.tiles);
+}
+
+void floyd_warshall()
+{
+    memcpy(solution, topology, sizeof(distance_t) * num_channel * num_channel);
+    floyd_warshall_blocked(solution, num_channel, 0);
+}
+
 void print_graph()
 {
     printf("GRAPH\n");
@@ -83,34 +366,153 @@ void print_solution()
     }
 }
 
-bool create_topology(const char* filename)
+/*
+ * Topology files are mapped into memory and parsed by a small scanner
+ * instead of one fscanf per distance. A dense file holds the node count
+ * and then every distance of the matrix, with a negative distance for no
+ * link. A sparse file starts with the word "edges" and the node count,
+ * followed by one "src dst distance" triple per link; links go both ways,
+ * nodes without one are unreachable and each node is 0 from itself.
+ */
+
+typedef struct {
+    const char* pos;
+    const char* end;
+} scanner_t;
+
+static void scan_space(scanner_t* scanner)
 {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Could not open topology file: %s\n", filename);
+    while (scanner->pos < scanner->end && isspace((unsigned char)*scanner->pos)) {
+        scanner->pos++;
+    }
+}
+
+// Returns true if only white space is left
+static bool scan_done(scanner_t* scanner)
+{
+    scan_space(scanner);
+    return scanner->pos == scanner->end;
+}
+
+// Consumes the word if it is the next token
+static bool scan_word(scanner_t* scanner, const char* word)
+{
+    scan_space(scanner);
+    size_t len = strlen(word);
+    if ((size_t)(scanner->end - scanner->pos) < len || memcmp(scanner->pos, word, len) != 0) return false;
+    const char* next = scanner->pos + len;
+    if (next < scanner->end && !isspace((unsigned char)*next)) return false;
+    scanner->pos = next;
+    return true;
+}
+
+// Reads the next token as a decimal integer with an optional minus sign, saturating at LONG_MAX
+// Returns false if there is no next token or it is not a number
+static bool scan_long(scanner_t* scanner, long* value)
+{
+    scan_space(scanner);
+    const char* pos = scanner->pos;
+    bool negative = pos < scanner->end && *pos == '-';
+    if (negative) pos++;
+    if (pos == scanner->end || !isdigit((unsigned char)*pos)) return false;
+    long result = 0;
+    while (pos < scanner->end && isdigit((unsigned char)*pos)) {
+        long digit = *pos++ - '0';
+        result = result <= (LONG_MAX - digit) / 10 ? result * 10 + digit : LONG_MAX;
+    }
+    if (pos < scanner->end && !isspace((unsigned char)*pos)) return false;
+    scanner->pos = pos;
+    *value = negative ? -result : result;
+    return true;
+}
+
+// Negative and too large distances stand for no link
+static distance_t link_distance(long value)
+{
+    return (value < 0 || value > (long)inf_distance) ? inf_distance : (distance_t)value;
+}
+
+static bool parse_topology(scanner_t* scanner, distance_t** matrix, size_t* n)
+{
+    bool sparse = scan_word(scanner, "edges");
+    long count;
+    if (!scan_long(scanner, &count) || count <= 0 || (size_t)count > SIZE_MAX / sizeof(distance_t) / (size_t)count) {
         return false;
     }
-    int num_scanned = fscanf(file, "%zu", &num_channel);
-    assert(num_scanned == 1);
-    assert(num_channel > 0);
-    topology = malloc(sizeof(distance_t) * num_channel * num_channel);
-    assert(topology != NULL);
-    solution = malloc(sizeof(distance_t) * num_channel * num_channel);
-    assert(solution != NULL);
-    // populate topology
-    for (size_t src = 0; src < num_channel; src++) {
-        for (size_t dst = 0; dst < num_channel; dst++) {
-            distance_t distance;
-            num_scanned = fscanf(file, "%d", (int*)&distance);
-            assert(num_scanned == 1);
-            // negative values get converted to inf_distance
-            if (distance > inf_distance) {
-                distance = inf_distance;
+    size_t nodes = (size_t)count;
+    distance_t* distances = malloc(sizeof(distance_t) * nodes * nodes);
+    if (distances == NULL) return false;
+
+    if (sparse) {
+        for (size_t i = 0; i < nodes * nodes; i++) {
+            distances[i] = inf_distance;
+        }
+        for (size_t i = 0; i < nodes; i++) {
+            distances[i * nodes + i] = 0;
+        }
+        while (!scan_done(scanner)) {
+            long src, dst, value;
+            if (!scan_long(scanner, &src) || !scan_long(scanner, &dst) || !scan_long(scanner, &value) ||
+                src < 0 || dst < 0 || (size_t)src >= nodes || (size_t)dst >= nodes) {
+                free(distances);
+                return false;
+            }
+            distance_t distance = link_distance(value);
+            // A link listed twice keeps its shortest distance
+            if (distance < distances[(size_t)src * nodes + (size_t)dst]) {
+                distances[(size_t)src * nodes + (size_t)dst] = distance;
+                distances[(size_t)dst * nodes + (size_t)src] = distance;
             }
-            set_link_distance(src, dst, distance);
         }
+    } else {
+        for (size_t i = 0; i < nodes * nodes; i++) {
+            long value;
+            if (!scan_long(scanner, &value)) {
+                free(distances);
+                return false;
+            }
+            distances[i] = link_distance(value);
+        }
+    }
+    *matrix = distances;
+    *n = nodes;
+    return true;
+}
+
+bool load_topology(const char* filename, distance_t** matrix, size_t* n)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open topology file: %s\n", filename);
+        return false;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Could not read topology file: %s\n", filename);
+        return false;
+    }
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    scanner_t scanner = {data, (const char*)data + st.st_size};
+    bool parsed = parse_topology(&scanner, matrix, n);
+    munmap(data, (size_t)st.st_size);
+    if (!parsed) {
+        printf("Malformed topology file: %s\n", filename);
     }
-    fclose(file);
+    return parsed;
+}
+
+bool create_topology(const char* filename)
+{
+    if (!load_topology(filename, &topology, &num_channel)) {
+        return false;
+    }
+    solution = malloc(sizeof(distance_t) * num_channel * num_channel);
+    assert(solution != NULL);
     // calculate solution using Floyd-Warshall algorithm
     floyd_warshall();
     return true;
@@ -122,40 +524,17 @@ void destroy_topology()
     free(solution);
 }
 
-void* router(void* arg)
+// Builds the router's select list: done_channel, its own channel, then a send to every neighbor carrying data
+// Also sets up the weights for the weighted mode, which favours the router's own inbox over its outgoing sends
+static select_t* router_select_list(size_t index, void* data, size_t* total_select_count, unsigned int** weights)
 {
-    bool changed = false;
-    size_t index = (size_t)arg;
-    size_t selected_index;
-    distance_vector_t* prev_prev_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
-    assert(prev_prev_state != NULL);
-    distance_vector_t* prev_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
-    assert(prev_state != NULL);
-    distance_vector_t* curr_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
-    assert(curr_state != NULL);
-    distance_vector_t* next_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
-    assert(next_state != NULL);
-    prev_prev_state->src = index;
-    prev_state->src = index;
-    curr_state->src = index;
-    next_state->src = index;
-    prev_prev_state->epoch = 0;
-    prev_state->epoch = 1;
-    curr_state->epoch = 2;
-    next_state->epoch = 3;
-    for (size_t i = 0; i < num_channel; i++) {
-        prev_prev_state->dist[i] = get_link_distance(index, i);
-        prev_state->dist[i] = get_link_distance(index, i);
-        curr_state->dist[i] = get_link_distance(index, i);
-        next_state->dist[i] = get_link_distance(index, i);
-    }
-    size_t total_select_count = 2;
+    size_t total = 2;
     for (size_t i = 0; i < num_channel; i++) {
         if ((i != index) && get_link_distance(index, i) != inf_distance) {
-            total_select_count++;
+            total++;
         }
     }
-    select_t* select_list = malloc(sizeof(select_t) * total_select_count);
+    select_t* select_list = malloc(sizeof(select_t) * total);
     assert(select_list != NULL);
     size_t select_count = 0;
     select_list[select_count].channel = done_channel;
@@ -170,12 +549,60 @@ void* router(void* arg)
         if ((i != index) && get_link_distance(index, i) != inf_distance) {
             select_list[select_count].channel = channels[i];
             select_list[select_count].dir = SEND;
-            select_list[select_count].data = curr_state;
+            select_list[select_count].data = data;
             select_count++;
         }
     }
+    *weights = malloc(sizeof(unsigned int) * total);
+    assert(*weights != NULL);
+    for (size_t i = 0; i < total; i++) {
+        (*weights)[i] = 1;
+    }
+    (*weights)[1] = total > 3 ? (unsigned int)(total - 2) : 1;
+    *total_select_count = total;
+    return select_list;
+}
+
+// Adds what the router sent to the run's totals
+static void router_add_stats(size_t messages, size_t bytes)
+{
+    atomic_fetch_add_explicit(&sent_messages, messages, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sent_bytes, bytes, memory_order_relaxed);
+}
+
+void* router(void* arg)
+{
+    bool changed = false;
+    size_t index = (size_t)arg;
+    size_t selected_index;
+    size_t messages = 0;
+    // Ring of num_states vectors: next_state takes the updates, curr_state is being broadcast and the older ones
+    // may still be queued in or read from a neighbor's channel
+    distance_vector_t** states = malloc(sizeof(distance_vector_t*) * num_states);
+    assert(states != NULL);
+    for (size_t s = 0; s < num_states; s++) {
+        states[s] = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
+        assert(states[s] != NULL);
+        states[s]->src = index;
+        states[s]->epoch = s;
+        for (size_t i = 0; i < num_channel; i++) {
+            states[s]->dist[i] = get_link_distance(index, i);
+        }
+    }
+    size_t next_index = num_states - 1;
+    distance_vector_t* curr_state = states[next_index - 1];
+    distance_vector_t* next_state = states[next_index];
+    size_t total_select_count;
+    unsigned int* weights;
+    select_t* select_list = router_select_list(index, curr_state, &total_select_count, &weights);
+    size_t select_count = total_select_count;
+    select_policy_t policy;
+    select_policy_init(&policy, router_mode, weights);
+    // Trade the credit every router starts with for the first broadcast
+    work_add(total_select_count - 2);
+    work_done(1);
     while (true) {
-        enum channel_status status = channel_select(select_list, select_count, &selected_index);
+        enum channel_status status = channel_select_policy(select_list, select_count, &selected_index, &policy);
         if (status == SUCCESS) {
             assert(selected_index != 0);
             if (selected_index == 1) {
@@ -184,6 +611,7 @@ void* router(void* arg)
                     distance_vector_t* neighbor_state = select_list[selected_index].data;
                     distance_t neighbor_dist = get_link_distance(index, neighbor_state->src);
                     assert(neighbor_dist != inf_distance);
+                    bool was_changed = changed;
                     for (size_t i = 0; i < num_channel; i++) {
                         distance_t new_dist = neighbor_dist + neighbor_state->dist[i];
                         if (new_dist < next_state->dist[i]) {
@@ -191,6 +619,10 @@ void* router(void* arg)
                             changed = true;
                         }
                     }
+                    if (changed && !was_changed) {
+                        work_add(1);
+                    }
+                    work_done(1);
                 } else {
                     // special message sent to test convergence
                     bool converged = (select_count == 2) && !changed;
@@ -199,6 +631,7 @@ void* router(void* arg)
                 }
             } else {
                 select_count--;
+                messages++;
                 // swap last element and selected element
                 channel_t* temp = select_list[select_count].channel;
                 select_list[select_count].channel = select_list[selected_index].channel;
@@ -208,12 +641,10 @@ void* router(void* arg)
             if (select_count == 2) {
                 // check if we want to reset
                 if (changed) {
-                    // cycle triple buffer
-                    distance_vector_t* temp_state = curr_state;
+                    // cycle the ring, reusing the oldest vector
                     curr_state = next_state;
-                    next_state = prev_prev_state;
-                    prev_prev_state = prev_state;
-                    prev_state = temp_state;
+                    next_index = (next_index + 1) % num_states;
+                    next_state = states[next_index];
                     next_state->epoch = curr_state->epoch + 1;
                     for (size_t i = 0; i < num_channel; i++) {
                         next_state->dist[i] = curr_state->dist[i];
@@ -223,6 +654,8 @@ void* router(void* arg)
                     for (size_t i = 2; i < select_count; i++) {
                         select_list[i].data = curr_state;
                     }
+                    work_add(total_select_count - 2);
+                    work_done(1);
                     changed = false;
                 }
             }
@@ -233,11 +666,153 @@ void* router(void* arg)
             break;
         }
     }
+    router_add_stats(messages, messages * (sizeof(distance_vector_t) + sizeof(distance_t) * num_channel));
+    free(weights);
+    free(select_list);
+    for (size_t s = 0; s < num_states; s++) {
+        free(states[s]);
+    }
+    free(states);
+    return NULL;
+}
+
+/*
+ * In delta mode a router keeps a single vector and a dirty set of the
+ * destinations whose distance dropped since its last update. Once every
+ * neighbor has taken the previous update, the dirty entries are copied
+ * into one distance_delta_t that all neighbors share; the last one to
+ * apply it frees it. A delta only ever lowers distances, and every
+ * neighbor applies every delta of a router in order, so it ends up with
+ * the same minimum a full vector would give.
+ */
+
+typedef struct {
+    uint32_t dst;
+    distance_t dist;
+} distance_entry_t;
+
+typedef struct {
+    size_t src;
+    atomic_size_t refs;  // neighbors that have not applied it yet
+    size_t count;
+    distance_entry_t entries[];
+} distance_delta_t;
+
+void* router_delta(void* arg)
+{
+    size_t index = (size_t)arg;
+    size_t selected_index;
+    size_t messages = 0;
+    size_t bytes = 0;
+    // The convergence check reads the vector, so it still carries the epoch of the last update
+    distance_vector_t* state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
+    assert(state != NULL);
+    bool* is_dirty = malloc(sizeof(bool) * num_channel);
+    assert(is_dirty != NULL);
+    size_t* dirty = malloc(sizeof(size_t) * num_channel);
+    assert(dirty != NULL);
+    size_t dirty_count = 0;
+    state->src = index;
+    state->epoch = 0;
+    // The first update carries every link
+    for (size_t i = 0; i < num_channel; i++) {
+        state->dist[i] = get_link_distance(index, i);
+        is_dirty[i] = state->dist[i] != inf_distance;
+        if (is_dirty[i]) {
+            dirty[dirty_count++] = i;
+        }
+    }
+    size_t total_select_count;
+    unsigned int* weights;
+    select_t* select_list = router_select_list(index, NULL, &total_select_count, &weights);
+    size_t select_count = 2;
+    size_t neighbors = total_select_count - 2;
+    select_policy_t policy;
+    select_policy_init(&policy, router_mode, weights);
+    // The credit every router starts with stands for its first update
+    if (dirty_count == 0) {
+        work_done(1);
+    }
+    while (true) {
+        // Send what changed once the last update has reached every neighbor
+        if (select_count == 2 && dirty_count > 0) {
+            if (neighbors > 0) {
+                distance_delta_t* delta = malloc(sizeof(distance_delta_t) + sizeof(distance_entry_t) * dirty_count);
+                assert(delta != NULL);
+                delta->src = index;
+                atomic_init(&delta->refs, neighbors);
+                delta->count = dirty_count;
+                for (size_t i = 0; i < dirty_count; i++) {
+                    delta->entries[i].dst = (uint32_t)dirty[i];
+                    delta->entries[i].dist = state->dist[dirty[i]];
+                }
+                for (size_t i = 2; i < total_select_count; i++) {
+                    select_list[i].data = delta;
+                }
+                select_count = total_select_count;
+                messages += neighbors;
+                bytes += neighbors * (sizeof(distance_delta_t) + sizeof(distance_entry_t) * dirty_count);
+            }
+            for (size_t i = 0; i < dirty_count; i++) {
+                is_dirty[dirty[i]] = false;
+            }
+            dirty_count = 0;
+            state->epoch++;
+            work_add(neighbors);
+            work_done(1);
+        }
+        enum channel_status status = channel_select_policy(select_list, select_count, &selected_index, &policy);
+        if (status != SUCCESS) {
+            assert(status == CLOSED_ERROR);
+            assert(selected_index == 0);
+            assert(dirty_count == 0 && select_count == 2);
+            break;
+        }
+        assert(selected_index != 0);
+        if (selected_index == 1) {
+            distance_delta_t* delta = select_list[selected_index].data;
+            if (delta) {
+                distance_t neighbor_dist = get_link_distance(index, delta->src);
+                assert(neighbor_dist != inf_distance);
+                bool was_clean = dirty_count == 0;
+                for (size_t i = 0; i < delta->count; i++) {
+                    size_t dst = delta->entries[i].dst;
+                    distance_t new_dist = neighbor_dist + delta->entries[i].dist;
+                    if (new_dist < state->dist[dst]) {
+                        state->dist[dst] = new_dist;
+                        if (!is_dirty[dst]) {
+                            is_dirty[dst] = true;
+                            dirty[dirty_count++] = dst;
+                        }
+                    }
+                }
+                if (atomic_fetch_sub(&delta->refs, 1) == 1) {
+                    free(delta);
+                }
+                if (was_clean && dirty_count > 0) {
+                    work_add(1);
+                }
+                work_done(1);
+            } else {
+                // special message sent to test convergence
+                bool converged = (select_count == 2) && dirty_count == 0;
+                status = channel_send(completed_channel, converged ? state : NULL);
+                assert(status == SUCCESS);
+            }
+        } else {
+            select_count--;
+            // swap last element and selected element
+            channel_t* temp = select_list[select_count].channel;
+            select_list[select_count].channel = select_list[selected_index].channel;
+            select_list[selected_index].channel = temp;
+        }
+    }
+    router_add_stats(messages, bytes);
+    free(weights);
     free(select_list);
-    free(prev_prev_state);
-    free(prev_state);
-    free(curr_state);
-    free(next_state);
+    free(dirty);
+    free(is_dirty);
+    free(state);
     return NULL;
 }
 
@@ -301,12 +876,32 @@ bool check_done()
 
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename)
 {
-    assert(main_buffer_size <= 1); // only support up to a buffer size of 1
-    assert(secondary_buffer_size <= 1); // only support up to a buffer size of 1
+    run_stress_policy(main_buffer_size, secondary_buffer_size, filename, SELECT_FIRST);
+}
+
+void run_stress_policy(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, enum select_mode mode)
+{
+    stress_stats_t stats;
+    run_stress_vectors(main_buffer_size, secondary_buffer_size, filename, mode, VECTOR_FULL, &stats);
+}
+
+static double elapsed_sec(const struct timespec* start, const struct timespec* end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void run_stress_vectors(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename,
+                        enum select_mode mode, enum vector_mode vectors, stress_stats_t* stats)
+{
     int pthread_status;
     enum channel_status status;
     bool initialized = create_topology(filename);
     assert(initialized);
+    router_mode = mode;
+    // A full-vector router only starts a broadcast once every send of the previous one has completed, so a
+    // neighbor's channel holds vectors from at most its last main_buffer_size broadcasts, and the neighbor reads
+    // at most one more; with the one being broadcast and the one taking updates, none of them is overwritten
+    num_states = main_buffer_size + 3;
     channels = malloc(sizeof(channel_t*) * num_channel);
     assert(channels != NULL);
     for (size_t i = 0; i < num_channel; i++) {
@@ -317,26 +912,39 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     assert(done_channel != NULL);
     completed_channel = channel_create(secondary_buffer_size);
     assert(completed_channel != NULL);
+    atomic_store(&sent_messages, 0);
+    atomic_store(&sent_bytes, 0);
+    // One credit per router until it has scheduled its first update
+    atomic_store(&outstanding_work, num_channel);
+    converged_channel = channel_create(1);
+    assert(converged_channel != NULL);
 
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
     assert(pid != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
+        pthread_status = pthread_create(&pid[i], NULL, vectors == VECTOR_DELTA ? router_delta : router, (void*)i);
         assert(pthread_status == 0);
     }
 
-    // wait for convergence
-    while (!check_done()) {
-        usleep(1000);
-    }
+    // wait for the last credit, then check the routes once
+    void* data;
+    status = channel_receive(converged_channel, &data);
+    assert(status == SUCCESS);
+    stats->seconds = elapsed_sec(&start, &converged_at);
+    bool converged = check_done();
+    assert(converged);
 
     // stop threads
     status = channel_close(done_channel);
     assert(status == SUCCESS);
-    // join threads
+    // join threads, which add what they sent as they exit
     for (size_t i = 0; i < num_channel; i++) {
         pthread_join(pid[i], NULL);
     }
+    stats->messages = atomic_load(&sent_messages);
+    stats->bytes = atomic_load(&sent_bytes);
     // cleanup
     status = channel_destroy(done_channel);
     assert(status == SUCCESS);
@@ -344,6 +952,10 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     assert(status == SUCCESS);
     status = channel_destroy(completed_channel);
     assert(status == SUCCESS);
+    status = channel_close(converged_channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(converged_channel);
+    assert(status == SUCCESS);
     for (size_t i = 0; i < num_channel; i++) {
         status = channel_close(channels[i]);
         assert(status == SUCCESS);
@@ -353,4 +965,4 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     free(pid);
     free(channels);
     destroy_topology();
-}
+}
\ No newline at end of file
@@ -1,6 +1,50 @@
 #ifndef STRESS_H
 #define STRESS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include "channel.h"
+
+typedef unsigned int distance_t;
+
+// Side of the square tiles floyd_warshall_blocked works on
+#define FW_BLOCK 64
+
+// Reads a topology file into a newly allocated n x n row-major matrix of link distances, 0x7fffffff for no link
+// The file is either dense (the node count, then every distance of the matrix, negative for no link) or sparse
+// ("edges", the node count, then one "src dst distance" line per link, which goes both ways)
+// Returns false, after printing why, if the file cannot be read or is malformed
+bool load_topology(const char* filename, distance_t** matrix, size_t* n);
+
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename);
 
+// Runs the same distance-vector stress test with every router selecting under the given policy mode
+void run_stress_policy(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, enum select_mode mode);
+
+// Textbook Floyd-Warshall on the n x n row-major matrix dist, in place
+// Every distance must be at most 0x7fffffff, which stands for no link, so no sum can overflow
+void floyd_warshall_reference(distance_t* dist, size_t n);
+
+// Cache-blocked Floyd-Warshall on the same matrix, producing exactly the same distances as floyd_warshall_reference
+// Runs the tiles of each round on a thread pool with the given number of workers (0 uses one per online CPU);
+// with a single worker, or a matrix of a single tile, it runs on the calling thread
+void floyd_warshall_blocked(distance_t* dist, size_t n, size_t threads);
+
+// How routers share their distance vectors
+enum vector_mode {
+    VECTOR_FULL,   // every update carries the router's whole vector
+    VECTOR_DELTA,  // every update carries only the entries that changed since the router's last one
+};
+
+// What one stress run measured
+typedef struct {
+    size_t messages;  // updates sent from router to router
+    size_t bytes;     // distance data those updates carried
+    double seconds;   // from starting the routers until the last update was applied
+} stress_stats_t;
+
+// Runs the distance-vector stress test with the given select policy, sharing vectors as given, and fills in stats
+void run_stress_vectors(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename,
+                        enum select_mode mode, enum vector_mode vectors, stress_stats_t* stats);
+
 #endif // STRESS_H
@@ -6,11 +6,14 @@
 #include <stdatomic.h>
 #include "channel.h"
 #include "stress_send_recv.h"
+#include "coro.h"
 
 static size_t num_channel;
 static channel_t** channels;
 static atomic_bool done;
 static channel_t* main_channel;
+static atomic_size_t hops;
+static atomic_size_t started; // members that took their start message
 
 void* worker_thread(void* arg)
 {
@@ -22,6 +25,7 @@ void* worker_thread(void* arg)
     channel_t* my_channel = channels[index];
     channel_t* next_channel = channels[next_index];
     bool start = true;
+    size_t my_hops = 0;
     enum channel_status status;
     while (true) {
         void* data = NULL;
@@ -31,6 +35,7 @@ void* worker_thread(void* arg)
             if (data == NULL) {
                 // indicates start period is over
                 start = false;
+                atomic_fetch_add(&started, 1);
                 continue;
             }
         } else {
@@ -49,17 +54,29 @@ void* worker_thread(void* arg)
             // Pass along message to next thread in ring
             status = channel_send(next_channel, data);
             assert(status == SUCCESS);
+            my_hops++;
         }
     }
+    atomic_fetch_add(&hops, my_hops);
     return NULL;
 }
 
-void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec)
+// A ring member run as a coroutine
+static void worker_coro(void* arg)
+{
+    worker_thread(arg);
+}
+
+// Runs the ring members as threads, or as coroutines on sched if it is not NULL
+static size_t run_ring(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec, bool spsc,
+                       coro_sched_t* sched)
 {
     enum channel_status status;
     // setup
     num_channel = num_threads;
     atomic_store(&done, false);
+    atomic_store(&hops, 0);
+    atomic_store(&started, 0);
     size_t num_msgs = (size_t)(((double)(num_channel * (buffer_size + 1))) * load);
     bool* msg_check = calloc(num_msgs + 1, sizeof(bool));
     assert(msg_check != NULL);
@@ -67,17 +84,26 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
     channels = malloc(sizeof(channel_t*) * num_channel);
     assert(channels != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        channels[i] = channel_create(buffer_size);
+        // Ring channels have one sender (the previous worker) and one receiver at a time
+        channels[i] = spsc ? channel_create_spsc(buffer_size) : channel_create(buffer_size);
         assert(channels[i] != NULL);
     }
     main_channel = channel_create(buffer_size);
     assert(main_channel != NULL);
 
-    pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
-    assert(pid != NULL);
-    for (size_t i = 0; i < num_channel; i++) {
-        int pthread_status = pthread_create(&pid[i], NULL, worker_thread, (void*)i);
-        assert(pthread_status == 0);
+    pthread_t* pid = NULL;
+    if (sched) {
+        for (size_t i = 0; i < num_channel; i++) {
+            status = coro_spawn(sched, worker_coro, (void*)i);
+            assert(status == SUCCESS);
+        }
+    } else {
+        pid = malloc(sizeof(pthread_t) * num_channel);
+        assert(pid != NULL);
+        for (size_t i = 0; i < num_channel; i++) {
+            int pthread_status = pthread_create(&pid[i], NULL, worker_thread, (void*)i);
+            assert(pthread_status == 0);
+        }
     }
 
     // start test
@@ -92,6 +118,11 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
         assert(status == SUCCESS);
     }
 
+    // the last start message may still be in main_channel; the stop phase must not pull it
+    while (atomic_load(&started) < num_channel) {
+        usleep(1000);
+    }
+
     // wait for duration
     usleep(duration_usec);
 
@@ -114,9 +145,15 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
         status = channel_send(channels[i], NULL);
         assert(status == SUCCESS);
     }
-    for (size_t i = 0; i < num_channel; i++) {
-        // join threads
-        pthread_join(pid[i], NULL);
+    if (sched) {
+        // wait for the coroutines
+        status = coro_sched_shutdown(sched);
+        assert(status == SUCCESS);
+    } else {
+        for (size_t i = 0; i < num_channel; i++) {
+            // join threads
+            pthread_join(pid[i], NULL);
+        }
     }
 
     // cleanup
@@ -133,4 +170,26 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
     free(msg_check);
     free(pid);
     free(channels);
+    return atomic_load(&hops);
+}
+
+size_t run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec)
+{
+    return run_ring(buffer_size, num_threads, load, duration_usec, false, NULL);
+}
+
+size_t run_stress_send_recv_spsc(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec)
+{
+    return run_ring(buffer_size, num_threads, load, duration_usec, true, NULL);
+}
+
+size_t run_stress_send_recv_coro(size_t buffer_size, size_t num_members, size_t workers, double load,
+                                 useconds_t duration_usec)
+{
+    coro_sched_t* sched = coro_sched_create(workers);
+    assert(sched != NULL);
+    size_t ring_hops = run_ring(buffer_size, num_members, load, duration_usec, false, sched);
+    enum channel_status status = coro_sched_destroy(sched);
+    assert(status == SUCCESS);
+    return ring_hops;
 }
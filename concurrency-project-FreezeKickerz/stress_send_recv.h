@@ -1,6 +1,19 @@
 #ifndef STRESS_SEND_RECV_H
 #define STRESS_SEND_RECV_H
 
-void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec);
+#include <stddef.h>
+#include <unistd.h>
+
+// Passes messages around a ring of num_threads workers for duration_usec and checks none were lost or duplicated
+// Returns the number of hops (sends from one worker to the next) made during the run
+size_t run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec);
+
+// Same as run_stress_send_recv, with the ring channels created by channel_create_spsc
+size_t run_stress_send_recv_spsc(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec);
+
+// Same as run_stress_send_recv, with the ring members run as num_members coroutines on a scheduler of the given
+// number of worker threads (0 for one per CPU) instead of one thread each
+size_t run_stress_send_recv_coro(size_t buffer_size, size_t num_members, size_t workers, double load,
+                                 useconds_t duration_usec);
 
 #endif // STRESS_SEND_RECV_H
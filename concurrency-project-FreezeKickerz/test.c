@@ -8,8 +8,13 @@
 #include <sys/resource.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/epoll.h>
 #include "stress.h"
 #include "stress_send_recv.h"
+#include "pool.h"
+#include "broadcast.h"
+#include "coro.h"
+#include "futex.h"
 
 #define mu_str_(text) #text
 #define mu_str(text) mu_str_(text)
@@ -1146,6 +1151,35 @@ char* test_stress() {
     run_stress(1, 1, "random_topology.txt");
     run_stress(1, 1, "random_topology_1.txt");
     run_stress(1, 1, "big_graph.txt");
+    run_stress(1, 1, "big_graph_edges.txt");
+    return NULL;
+}
+
+char* test_stress_delta() {
+    print_test_details(__func__, "Stress Testing with routers that only send changed distances");
+    const char* files[] = {"topology.txt", "connected_topology.txt", "random_topology.txt", "random_topology_1.txt",
+                           "big_graph.txt", "big_graph_edges.txt"};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        stress_stats_t stats;
+        run_stress_vectors(1, 1, files[i], SELECT_FIRST, VECTOR_DELTA, &stats);
+        mu_assert("test_stress_delta: Routers sent nothing", stats.messages > 0 && stats.bytes > 0);
+    }
+    return NULL;
+}
+
+char* test_stress_capacity() {
+    print_test_details(__func__, "Stress Testing with unbuffered and larger router channels");
+    const size_t capacities[] = {0, 2, 16, 1024};
+    const char* files[] = {"random_topology_1.txt", "big_graph.txt"};
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+            stress_stats_t stats;
+            run_stress_vectors(capacities[c], capacities[c], files[i], SELECT_FIRST, VECTOR_FULL, &stats);
+            mu_assert("test_stress_capacity: Routers sent nothing", stats.messages > 0);
+            run_stress_vectors(capacities[c], capacities[c], files[i], SELECT_FIRST, VECTOR_DELTA, &stats);
+            mu_assert("test_stress_capacity: Routers sent nothing", stats.messages > 0);
+        }
+    }
     return NULL;
 }
 
@@ -1437,6 +1471,11 @@ char* test_select_with_select_size1() {
     return test_select_with_select(1);
 }
 
+char* test_select_with_select_unbuffered() {
+    print_test_details(__func__, "Testing select with select on an unbuffered channel");
+    return test_select_with_select(0);
+}
+
 char* test_select_with_same_channel (size_t capacity) {
 
     /* Testing with 3 selects receive on same two channels. Only two should be able to process send */
@@ -1569,6 +1608,11 @@ char* test_select_with_send_receive_on_same_channel_size1() {
     return test_select_with_send_receive_on_same_channel(1);
 }
 
+char* test_select_with_send_receive_on_same_channel_unbuffered() {
+    print_test_details(__func__, "Testing select with send/recv on same unbuffered channel");
+    return test_select_with_send_receive_on_same_channel(0);
+}
+
 char* test_select_with_duplicate_channel(size_t capacity) {
 
     // test duplicate receive
@@ -1633,6 +1677,101 @@ char* test_select_with_duplicate_channel_size1() {
     return test_select_with_duplicate_channel(1);
 }
 
+typedef struct {
+    channel_t* channel;
+    size_t count;
+    enum channel_status out;
+} batch_args;
+
+void* helper_send_batch(batch_args* myargs) {
+    // Sends 1..count in uneven batches
+    void* items[13];
+    size_t next = 1;
+    while (next <= myargs->count) {
+        size_t n = 0;
+        while (n < 13 && next <= myargs->count) {
+            items[n++] = (void*)next++;
+        }
+        myargs->out = channel_send_batch(myargs->channel, items, n);
+        if (myargs->out != SUCCESS) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+char* test_batch_send_receive_capacity(size_t capacity) {
+    size_t COUNT = 1000;
+    channel_t* channel = channel_create(capacity);
+
+    pthread_t pid;
+    batch_args args = {channel, COUNT, GENERIC_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_send_batch, &args);
+
+    size_t expected = 1;
+    while (expected <= COUNT) {
+        void* out[7];
+        size_t got = 0;
+        enum channel_status status = channel_receive_batch(channel, out, 7, &got);
+        mu_assert("test_batch_send_receive: Incorrect status", status == SUCCESS);
+        mu_assert("test_batch_send_receive: Incorrect count", got >= 1 && got <= 7);
+        for (size_t i = 0; i < got; i++) {
+            mu_assert("test_batch_send_receive: Messages out of order", (size_t)out[i] == expected);
+            expected++;
+        }
+    }
+
+    pthread_join(pid, NULL);
+    mu_assert("test_batch_send_receive: Incorrect send status", args.out == SUCCESS);
+
+    channel_close(channel);
+    void* items[2] = {NULL, NULL};
+    size_t got = 0;
+    mu_assert("test_batch_send_receive: Send on closed channel", channel_send_batch(channel, items, 2) == CLOSED_ERROR);
+    mu_assert("test_batch_send_receive: Receive on closed channel", channel_receive_batch(channel, items, 2, &got) == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_batch_send_receive() {
+    print_test_details(__func__, "Testing blocking batch send and receive");
+    char* result = test_batch_send_receive_capacity(1);
+    if (result) return result;
+    result = test_batch_send_receive_capacity(16);
+    if (result) return result;
+    return test_batch_send_receive_capacity(0);
+}
+
+char* test_non_blocking_batch() {
+    print_test_details(__func__, "Testing non-blocking batch send and receive");
+
+    channel_t* channel = channel_create(5);
+    void* items[8] = {"M1", "M2", "M3", "M4", "M5", "M6", "M7", "M8"};
+    void* out[10];
+    size_t count = 0;
+
+    mu_assert("test_non_blocking_batch: Incorrect send status", channel_non_blocking_send_batch(channel, items, 8, &count) == SUCCESS);
+    mu_assert("test_non_blocking_batch: Sent more than fits", count == 5);
+    mu_assert("test_non_blocking_batch: Incorrect full status", channel_non_blocking_send_batch(channel, items + 5, 3, &count) == CHANNEL_FULL);
+    mu_assert("test_non_blocking_batch: Sent into a full channel", count == 0);
+
+    mu_assert("test_non_blocking_batch: Incorrect receive status", channel_non_blocking_receive_batch(channel, out, 3, &count) == SUCCESS);
+    mu_assert("test_non_blocking_batch: Incorrect receive count", count == 3);
+    mu_assert("test_non_blocking_batch: Incorrect receive status", channel_non_blocking_receive_batch(channel, out + 3, 7, &count) == SUCCESS);
+    mu_assert("test_non_blocking_batch: Incorrect receive count", count == 2);
+    for (size_t i = 0; i < 5; i++) {
+        mu_assert("test_non_blocking_batch: Messages out of order", string_equal(out[i], items[i]));
+    }
+    mu_assert("test_non_blocking_batch: Incorrect empty status", channel_non_blocking_receive_batch(channel, out, 10, &count) == CHANNEL_EMPTY);
+    mu_assert("test_non_blocking_batch: Received from an empty channel", count == 0);
+
+    channel_close(channel);
+    mu_assert("test_non_blocking_batch: Send on closed channel", channel_non_blocking_send_batch(channel, items, 1, &count) == CLOSED_ERROR);
+    mu_assert("test_non_blocking_batch: Receive on closed channel", channel_non_blocking_receive_batch(channel, out, 1, &count) == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
 
 typedef char* (*test_fn_t)();
 typedef struct {
@@ -1640,6 +1779,1219 @@ typedef struct {
     test_fn_t test;
 } test_t;
 
+// Fills channels[0..n) (capacity 1 each) with one message per channel that is empty
+static void refill_policy_channels(channel_t** channels, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        channel_non_blocking_send(channels[i], "M");
+    }
+}
+
+char* test_select_policy() {
+    print_test_details(__func__, "Testing round-robin, random and weighted select policies");
+
+    enum { N = 4, ROUNDS = 400 };
+    channel_t* channels[N];
+    select_t list[N];
+    for (size_t i = 0; i < N; i++) {
+        channels[i] = channel_create(1);
+        list[i].channel = channels[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+    }
+    select_policy_t policy;
+    size_t index = 0;
+    size_t counts[N];
+
+    // Round robin visits every ready channel in turn
+    select_policy_init(&policy, SELECT_ROUND_ROBIN, NULL);
+    for (size_t round = 0; round < 2 * N; round++) {
+        refill_policy_channels(channels, N);
+        mu_assert("test_select_policy: Incorrect select status", channel_select_policy(list, N, &index, &policy) == SUCCESS);
+        mu_assert("test_select_policy: Round robin selected out of turn", index == round % N);
+    }
+
+    // Random selects every channel while all are ready
+    select_policy_init(&policy, SELECT_RANDOM, NULL);
+    memset(counts, 0, sizeof(counts));
+    for (size_t round = 0; round < ROUNDS; round++) {
+        refill_policy_channels(channels, N);
+        mu_assert("test_select_policy: Incorrect select status", channel_select_policy(list, N, &index, &policy) == SUCCESS);
+        counts[index]++;
+    }
+    for (size_t i = 0; i < N; i++) {
+        mu_assert("test_select_policy: Random starved a channel", counts[i] > ROUNDS / N / 4);
+    }
+
+    // Weighted never starts at a zero weight and favours the heavy entry
+    unsigned int weights[N] = {0, 1, 0, 3};
+    select_policy_init(&policy, SELECT_WEIGHTED, weights);
+    memset(counts, 0, sizeof(counts));
+    for (size_t round = 0; round < ROUNDS; round++) {
+        refill_policy_channels(channels, N);
+        mu_assert("test_select_policy: Incorrect select status", channel_select_policy(list, N, &index, &policy) == SUCCESS);
+        counts[index]++;
+    }
+    mu_assert("test_select_policy: Weighted selected a zero weight", counts[0] == 0 && counts[2] == 0);
+    mu_assert("test_select_policy: Weighted ignored the weights", counts[3] > 2 * counts[1] && counts[1] > 0);
+
+    // A zero weight entry is still selected once it is the only one ready
+    for (size_t i = 0; i < N; i++) {
+        void* data;
+        channel_non_blocking_receive(channels[i], &data);
+    }
+    channel_non_blocking_send(channels[2], "M");
+    mu_assert("test_select_policy: Incorrect select status", channel_select_policy(list, N, &index, &policy) == SUCCESS);
+    mu_assert("test_select_policy: Weighted missed the only ready channel", index == 2);
+
+    for (size_t i = 0; i < N; i++) {
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+    return NULL;
+}
+
+char* test_unbuffered_close_with_receive() {
+    print_test_details(__func__, "Testing close of an unbuffered channel with blocked receivers");
+
+    // Every receiver is parked on the channel;
+    // with no sender every one of them must fail once the channel is closed
+    channel_t* channel = channel_create(0);
+    size_t RECEIVE_THREAD = 5;
+    receive_args data_rec[RECEIVE_THREAD];
+    pthread_t rec_pid[RECEIVE_THREAD];
+    for (size_t i = 0; i < RECEIVE_THREAD; i++) {
+        init_object_for_receive_api(&data_rec[i], channel, NULL);
+        pthread_create(&rec_pid[i], NULL, (void *)helper_receive, &data_rec[i]);
+    }
+    usleep(10000);
+
+    mu_assert("test_unbuffered_close_with_receive: Testing channel close failed", channel_close(channel) == SUCCESS);
+    for (size_t i = 0; i < RECEIVE_THREAD; i++) {
+        pthread_join(rec_pid[i], NULL);
+        mu_assert("test_unbuffered_close_with_receive: Receive succeeded without a sender", data_rec[i].out == CLOSED_ERROR);
+    }
+    channel_destroy(channel);
+    return NULL;
+}
+
+typedef struct {
+    size_t id;
+    double value;
+    char name[20];
+} typed_message_t;
+
+#define TYPED_MESSAGES 10000
+
+void* helper_send_typed(channel_t* channel) {
+    for (size_t i = 0; i < TYPED_MESSAGES; i++) {
+        typed_message_t message = {i, (double)i / 2, "message"};
+        if (i % 2 == 0) {
+            if (channel_send_value(channel, &message) != SUCCESS) break;
+        } else {
+            // Write every other message in place
+            channel_slot_t slot;
+            if (channel_reserve(channel, &slot) != SUCCESS) break;
+            memcpy(slot.data, &message, sizeof(message));
+            channel_commit(channel, &slot);
+        }
+    }
+    return NULL;
+}
+
+char* test_typed_channel() {
+    print_test_details(__func__, "Testing typed channels with copied and in-place messages");
+
+    mu_assert("test_typed_channel: Created a typed channel of size 0", channel_create_typed(0, sizeof(typed_message_t)) == NULL);
+    channel_t* channel = channel_create_typed(4, sizeof(typed_message_t));
+    mu_assert("test_typed_channel: Could not create channel", channel != NULL);
+
+    // Typed channels only take the value and slot calls
+    void* data = NULL;
+    mu_assert("test_typed_channel: Sent a pointer on a typed channel", channel_non_blocking_send(channel, "M") == GENERIC_ERROR);
+    mu_assert("test_typed_channel: Received a pointer from a typed channel", channel_non_blocking_receive(channel, &data) == GENERIC_ERROR);
+    channel_t* untyped = channel_create(4);
+    typed_message_t message;
+    mu_assert("test_typed_channel: Sent a value on an untyped channel", channel_non_blocking_send_value(untyped, &message) == GENERIC_ERROR);
+    channel_close(untyped);
+    channel_destroy(untyped);
+
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_send_typed, channel);
+    for (size_t i = 0; i < TYPED_MESSAGES; i++) {
+        if (i % 3 == 0) {
+            // Read every third message in place
+            channel_slot_t slot;
+            mu_assert("test_typed_channel: Incorrect acquire status", channel_acquire(channel, &slot) == SUCCESS);
+            memcpy(&message, slot.data, sizeof(message));
+            channel_release(channel, &slot);
+        } else {
+            mu_assert("test_typed_channel: Incorrect receive status", channel_receive_value(channel, &message) == SUCCESS);
+        }
+        mu_assert("test_typed_channel: Messages out of order", message.id == i);
+        mu_assert("test_typed_channel: Message corrupted", message.value == (double)i / 2 && string_equal(message.name, "message"));
+    }
+    pthread_join(pid, NULL);
+
+    // A full channel refuses reservations until a slot is released
+    channel_slot_t slots[4];
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_typed_channel: Incorrect reserve status", channel_non_blocking_reserve(channel, &slots[i]) == SUCCESS);
+    }
+    mu_assert("test_typed_channel: Reserved a slot of a full channel", channel_non_blocking_reserve(channel, &slots[0]) == CHANNEL_FULL);
+    mu_assert("test_typed_channel: Acquired an uncommitted slot", channel_non_blocking_acquire(channel, &slots[0]) == CHANNEL_EMPTY);
+    for (size_t i = 0; i < 4; i++) {
+        channel_commit(channel, &slots[i]);
+    }
+    mu_assert("test_typed_channel: Incorrect receive status", channel_non_blocking_receive_value(channel, &message) == SUCCESS);
+    mu_assert("test_typed_channel: Incorrect send status", channel_non_blocking_send_value(channel, &message) == SUCCESS);
+
+    channel_close(channel);
+    mu_assert("test_typed_channel: Send on closed channel", channel_send_value(channel, &message) == CLOSED_ERROR);
+    mu_assert("test_typed_channel: Receive on closed channel", channel_receive_value(channel, &message) == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
+#define TIMED_WAIT 0.02
+
+// Sets deadline to sec seconds from now
+void deadline_after(double sec, struct timespec* deadline) {
+    convertTimeToTimespec(getTime() + convertSecondsToTime(sec), deadline);
+}
+
+char* test_timed_operations() {
+    print_test_details(__func__, "Testing timed send, receive and select");
+
+    struct timespec deadline;
+    void* data = NULL;
+    uint64_t start;
+
+    // Buffered: both directions time out no earlier than the deadline
+    channel_t* channel = channel_create(1);
+    start = getTime();
+    deadline_after(TIMED_WAIT, &deadline);
+    mu_assert("test_timed_operations: Receive on empty channel did not time out", channel_receive_timed(channel, &data, &deadline) == TIMEOUT_ERROR);
+    mu_assert("test_timed_operations: Receive timed out before the deadline", getTime() >= convertTimespecToTime(&deadline));
+    mu_assert("test_timed_operations: Receive timed out too late", convertTimeToSeconds(getTime() - start) < 1);
+
+    mu_assert("test_timed_operations: Incorrect send status", channel_send(channel, "Message1") == SUCCESS);
+    deadline_after(TIMED_WAIT, &deadline);
+    mu_assert("test_timed_operations: Send on full channel did not time out", channel_send_timed(channel, "Message2", &deadline) == TIMEOUT_ERROR);
+    mu_assert("test_timed_operations: Send timed out before the deadline", getTime() >= convertTimespecToTime(&deadline));
+
+    // A ready channel completes even with a deadline that already passed
+    deadline_after(0, &deadline);
+    mu_assert("test_timed_operations: Receive on ready channel failed", channel_receive_timed(channel, &data, &deadline) == SUCCESS);
+    mu_assert("test_timed_operations: Received the wrong message", string_equal(data, "Message1"));
+
+    // A sender arriving before the deadline completes the wait
+    send_args send_data;
+    pthread_t send_pid;
+    init_object_for_send_api(&send_data, channel, "Message3", NULL);
+    pthread_create(&send_pid, NULL, (void *)helper_send, &send_data);
+    deadline_after(5, &deadline);
+    mu_assert("test_timed_operations: Timed receive missed a sender", channel_receive_timed(channel, &data, &deadline) == SUCCESS);
+    mu_assert("test_timed_operations: Received the wrong message", string_equal(data, "Message3"));
+    pthread_join(send_pid, NULL);
+
+    channel_close(channel);
+    mu_assert("test_timed_operations: Receive on closed channel", channel_receive_timed(channel, &data, &deadline) == CLOSED_ERROR);
+    channel_destroy(channel);
+
+    // Unbuffered: a timed out party withdraws, and the channel keeps working afterwards
+    channel = channel_create(0);
+    deadline_after(TIMED_WAIT, &deadline);
+    mu_assert("test_timed_operations: Unbuffered send did not time out", channel_send_timed(channel, "Message1", &deadline) == TIMEOUT_ERROR);
+    mu_assert("test_timed_operations: Unbuffered send timed out before the deadline", getTime() >= convertTimespecToTime(&deadline));
+    deadline_after(TIMED_WAIT, &deadline);
+    mu_assert("test_timed_operations: Unbuffered receive did not time out", channel_receive_timed(channel, &data, &deadline) == TIMEOUT_ERROR);
+
+    init_object_for_send_api(&send_data, channel, "Message2", NULL);
+    pthread_create(&send_pid, NULL, (void *)helper_send, &send_data);
+    deadline_after(5, &deadline);
+    mu_assert("test_timed_operations: Unbuffered timed receive missed a sender", channel_receive_timed(channel, &data, &deadline) == SUCCESS);
+    mu_assert("test_timed_operations: Received the wrong message", string_equal(data, "Message2"));
+    pthread_join(send_pid, NULL);
+    mu_assert("test_timed_operations: Sender failed", send_data.out == SUCCESS);
+
+    // Select: times out over channels that never become ready and leaves the index alone
+    channel_t* buffered = channel_create(1);
+    select_t list[2] = {{.channel = channel, .dir = RECV}, {.channel = buffered, .dir = RECV}};
+    size_t index = 2;
+    deadline_after(TIMED_WAIT, &deadline);
+    mu_assert("test_timed_operations: Select did not time out", channel_select_timed(list, 2, &index, &deadline) == TIMEOUT_ERROR);
+    mu_assert("test_timed_operations: Select timed out before the deadline", getTime() >= convertTimespecToTime(&deadline));
+    mu_assert("test_timed_operations: Select changed the index on timeout", index == 2);
+
+    init_object_for_send_api(&send_data, buffered, "Message3", NULL);
+    pthread_create(&send_pid, NULL, (void *)helper_send, &send_data);
+    deadline_after(5, &deadline);
+    mu_assert("test_timed_operations: Timed select missed a sender", channel_select_timed(list, 2, &index, &deadline) == SUCCESS);
+    mu_assert("test_timed_operations: Select picked the wrong channel", index == 1 && string_equal(list[1].data, "Message3"));
+    pthread_join(send_pid, NULL);
+
+    channel_close(channel);
+    channel_close(buffered);
+    channel_destroy(channel);
+    channel_destroy(buffered);
+    return NULL;
+}
+
+char* test_unbuffered_handoff_order() {
+    print_test_details(__func__, "Testing that unbuffered sends go to the longest waiting receiver");
+
+    channel_t* channel = channel_create(0);
+    size_t RECEIVE_THREAD = 5;
+    char* messages[] = {"Message1", "Message2", "Message3", "Message4", "Message5"};
+    receive_args data_rec[RECEIVE_THREAD];
+    pthread_t rec_pid[RECEIVE_THREAD];
+    for (size_t i = 0; i < RECEIVE_THREAD; i++) {
+        init_object_for_receive_api(&data_rec[i], channel, NULL);
+        pthread_create(&rec_pid[i], NULL, (void *)helper_receive, &data_rec[i]);
+        // Let each receiver park before the next one arrives
+        usleep(10000);
+    }
+
+    for (size_t i = 0; i < RECEIVE_THREAD; i++) {
+        mu_assert("test_unbuffered_handoff_order: Incorrect send status", channel_send(channel, messages[i]) == SUCCESS);
+        // Each send wakes exactly the receiver it handed its message to
+        pthread_join(rec_pid[i], NULL);
+        mu_assert("test_unbuffered_handoff_order: Incorrect receive status", data_rec[i].out == SUCCESS);
+        mu_assert("test_unbuffered_handoff_order: Receivers served out of order", string_equal(data_rec[i].data, messages[i]));
+    }
+    mu_assert("test_unbuffered_handoff_order: Non-blocking send without a receiver", channel_non_blocking_send(channel, messages[0]) == CHANNEL_FULL);
+
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_channel_stats() {
+    print_test_details(__func__, "Testing the per-channel counters and their dump");
+
+    channel_t* channel = channel_create(4);
+    channel_stats_t stats;
+    mu_assert("test_channel_stats: Stats before enabling them", channel_stats_get(channel, &stats) == GENERIC_ERROR);
+    mu_assert("test_channel_stats: Enabling stats failed", channel_stats_enable(channel) == SUCCESS);
+
+    void* data;
+    char* messages[] = {"Message1", "Message2", "Message3"};
+    size_t sent;
+    mu_assert("test_channel_stats: Batch send failed", channel_non_blocking_send_batch(channel, (void**)messages, 3, &sent) == SUCCESS && sent == 3);
+    mu_assert("test_channel_stats: Receive failed", channel_receive(channel, &data) == SUCCESS);
+    mu_assert("test_channel_stats: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+    mu_assert("test_channel_stats: Getting stats failed", channel_stats_get(channel, &stats) == SUCCESS);
+    mu_assert("test_channel_stats: Wrong send count", stats.sends == 3);
+    mu_assert("test_channel_stats: Wrong receive count", stats.receives == 2);
+    mu_assert("test_channel_stats: Wrong peak occupancy", stats.peak_occupancy == 3);
+    mu_assert("test_channel_stats: Counted a blocked call", stats.blocked_sends == 0 && stats.blocked_receives == 0);
+    mu_assert("test_channel_stats: Receive failed", channel_receive(channel, &data) == SUCCESS);
+
+    // A receiver that has to wait for its message
+    receive_args data_rec;
+    pthread_t rec_pid;
+    init_object_for_receive_api(&data_rec, channel, NULL);
+    pthread_create(&rec_pid, NULL, (void *)helper_receive, &data_rec);
+    usleep(10000);
+    mu_assert("test_channel_stats: Send failed", channel_send(channel, messages[0]) == SUCCESS);
+    pthread_join(rec_pid, NULL);
+    mu_assert("test_channel_stats: Receive failed", data_rec.out == SUCCESS);
+    channel_stats_get(channel, &stats);
+    mu_assert("test_channel_stats: Blocked receive not counted", stats.blocked_receives == 1);
+    mu_assert("test_channel_stats: Wait time not counted", stats.receive_wait_ns > 0);
+
+    // A select that has to wait is woken through the channel and completes on it
+    select_t list[1] = {{.channel = channel, .dir = RECV}};
+    select_args args;
+    pthread_t select_pid;
+    init_object_for_select_api(&args, list, 1, NULL);
+    pthread_create(&select_pid, NULL, (void *)helper_select, &args);
+    usleep(10000);
+    mu_assert("test_channel_stats: Send failed", channel_send(channel, messages[1]) == SUCCESS);
+    pthread_join(select_pid, NULL);
+    mu_assert("test_channel_stats: Select failed", args.out == SUCCESS);
+    channel_stats_get(channel, &stats);
+    mu_assert("test_channel_stats: Select wakeup not counted", stats.select_wakeups >= 1);
+    mu_assert("test_channel_stats: Select not counted", stats.select_successes == 1);
+    mu_assert("test_channel_stats: Wrong totals", stats.sends == 5 && stats.receives == 5);
+
+    char* dump = NULL;
+    size_t dump_size = 0;
+    FILE* out = open_memstream(&dump, &dump_size);
+    channel_stats_dump(channel, "buffered", out);
+    fclose(out);
+    mu_assert("test_channel_stats: Wrong dump", strstr(dump, "buffered: sends=5 receives=5") == dump);
+    mu_assert("test_channel_stats: Dump misses the occupancy", strstr(dump, "peak_occupancy=3/4") != NULL);
+    free(dump);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    // Every unbuffered handoff is one send and one receive
+    channel = channel_create(0);
+    channel_stats_enable(channel);
+    init_object_for_receive_api(&data_rec, channel, NULL);
+    pthread_create(&rec_pid, NULL, (void *)helper_receive, &data_rec);
+    usleep(10000);
+    mu_assert("test_channel_stats: Unbuffered send failed", channel_send(channel, messages[2]) == SUCCESS);
+    pthread_join(rec_pid, NULL);
+    channel_stats_get(channel, &stats);
+    mu_assert("test_channel_stats: Wrong unbuffered counts", stats.sends == 1 && stats.receives == 1);
+    mu_assert("test_channel_stats: Parked receiver not counted", stats.blocked_receives == 1 && stats.blocked_sends == 0);
+    mu_assert("test_channel_stats: Unbuffered channel has an occupancy", stats.peak_occupancy == 0);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_buffer_ring() {
+    print_test_details(__func__, "Testing that buffers of any capacity hold exactly that many values");
+
+    const size_t capacities[] = {1, 3, 5, 16, 100};
+    // Two copies of 256 values, so a bulk add can start anywhere in the first
+    void* items[512];
+    void* out[256];
+    for (size_t i = 0; i < 512; i++) {
+        items[i] = (void*)(uintptr_t)(i % 256 + 1);
+    }
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        size_t capacity = capacities[c];
+        for (int spsc = 0; spsc < 2; spsc++) {
+            buffer_t* buffer = spsc ? buffer_create_spsc(capacity) : buffer_create(capacity);
+            mu_assert("test_buffer_ring: Head and tail share a cache line", (uintptr_t)&buffer->tail - (uintptr_t)&buffer->head >= 64);
+            mu_assert("test_buffer_ring: Buffer is not cache aligned", (uintptr_t)buffer % 64 == 0);
+            mu_assert("test_buffer_ring: Wrong capacity", buffer_capacity(buffer) == capacity);
+            // Go around the ring several times, filling it completely on every lap
+            size_t next_in = 0;
+            size_t next_out = 0;
+            for (size_t lap = 0; lap < 10; lap++) {
+                size_t added = 0;
+                while (buffer_add(buffer, items[next_in % 256]) == BUFFER_SUCCESS) {
+                    next_in++;
+                    added++;
+                }
+                mu_assert("test_buffer_ring: Buffer holds more or less than its capacity", buffer_current_size(buffer) == capacity);
+                mu_assert("test_buffer_ring: Added values to a full buffer", buffer_add_n(buffer, items, 4) == 0);
+                size_t removed = buffer_remove_n(buffer, out, (lap % 3) + 1);
+                for (size_t i = 0; i < removed; i++) {
+                    mu_assert("test_buffer_ring: Values out of order", out[i] == items[next_out++ % 256]);
+                }
+                // A bulk add only fills the room that was freed
+                size_t refilled = buffer_add_n(buffer, items + next_in % 256, 64);
+                mu_assert("test_buffer_ring: Bulk add overfilled the buffer", refilled == removed);
+                next_in += refilled;
+                while (buffer_remove(buffer, out) == BUFFER_SUCCESS) {
+                    mu_assert("test_buffer_ring: Values out of order", out[0] == items[next_out++ % 256]);
+                }
+                mu_assert("test_buffer_ring: Lost values", next_out == next_in && added > 0);
+                // Start the next lap at a different slot
+                for (size_t i = 0; i <= lap % capacity; i++) {
+                    mu_assert("test_buffer_ring: Add failed", buffer_add(buffer, items[next_in++ % 256]) == BUFFER_SUCCESS);
+                    mu_assert("test_buffer_ring: Remove failed", buffer_remove(buffer, out) == BUFFER_SUCCESS);
+                    next_out++;
+                }
+            }
+            buffer_free(buffer);
+        }
+
+        buffer_t* typed = buffer_create_typed(capacity, sizeof(uint64_t));
+        size_t reserved = 0;
+        size_t pos;
+        uint64_t* value;
+        while ((value = buffer_reserve(typed, &pos)) != NULL) {
+            *value = reserved++;
+            buffer_commit(typed, pos);
+        }
+        mu_assert("test_buffer_ring: Typed buffer holds more or less than its capacity", reserved == capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            value = buffer_acquire(typed, &pos);
+            mu_assert("test_buffer_ring: Typed values out of order", value && *value == i);
+            buffer_release(typed, pos);
+        }
+        buffer_free(typed);
+    }
+    return NULL;
+}
+
+#define BROADCAST_MESSAGES 1000
+
+typedef struct {
+    broadcast_sub_t* sub;
+    size_t received;   // messages read in publish order before the broadcast closed
+    bool in_order;
+} broadcast_reader_t;
+
+void* broadcast_read_all(void* arg) {
+    broadcast_reader_t* reader = arg;
+    void* data;
+    reader->received = 0;
+    reader->in_order = true;
+    while (broadcast_receive(reader->sub, &data) == SUCCESS) {
+        if ((uintptr_t)data != ++reader->received) reader->in_order = false;
+        if (reader->received == BROADCAST_MESSAGES) break;
+    }
+    return NULL;
+}
+
+void* broadcast_wait_closed(void* arg) {
+    broadcast_reader_t* reader = arg;
+    void* data;
+    reader->in_order = broadcast_receive(reader->sub, &data) == CLOSED_ERROR;
+    return NULL;
+}
+
+char* test_broadcast() {
+    print_test_details(__func__, "Testing the broadcast channel");
+
+    mu_assert("test_broadcast: Created a broadcast without a ring", broadcast_create(0, BROADCAST_BLOCK) == NULL);
+
+    // Backpressure: the ring fills up once the slowest subscriber is a whole ring behind
+    broadcast_t* broadcast = broadcast_create(4, BROADCAST_BLOCK);
+    broadcast_sub_t* subs[3];
+    for (size_t i = 0; i < 3; i++) {
+        subs[i] = broadcast_subscribe(broadcast);
+        mu_assert("test_broadcast: Subscribe failed", subs[i] != NULL);
+    }
+    void* data;
+    mu_assert("test_broadcast: Received from an empty broadcast", broadcast_non_blocking_receive(subs[0], &data) == CHANNEL_EMPTY);
+    for (uintptr_t i = 1; i <= 4; i++) {
+        mu_assert("test_broadcast: Publish failed", broadcast_non_blocking_publish(broadcast, (void*)i) == SUCCESS);
+    }
+    mu_assert("test_broadcast: Published past the slowest subscriber", broadcast_non_blocking_publish(broadcast, (void*)5) == CHANNEL_FULL);
+    for (size_t i = 0; i < 2; i++) {
+        for (uintptr_t j = 1; j <= 4; j++) {
+            mu_assert("test_broadcast: Receive failed", broadcast_non_blocking_receive(subs[i], &data) == SUCCESS);
+            mu_assert("test_broadcast: Messages out of order", data == (void*)j);
+        }
+    }
+    mu_assert("test_broadcast: Published past the slowest subscriber", broadcast_non_blocking_publish(broadcast, (void*)5) == CHANNEL_FULL);
+    mu_assert("test_broadcast: Receive failed", broadcast_non_blocking_receive(subs[2], &data) == SUCCESS && data == (void*)1);
+    mu_assert("test_broadcast: Publish failed", broadcast_non_blocking_publish(broadcast, (void*)5) == SUCCESS);
+
+    // A late subscriber starts at the next message; one that leaves no longer holds publishers back
+    broadcast_sub_t* late = broadcast_subscribe(broadcast);
+    mu_assert("test_broadcast: Late subscriber sees old messages", broadcast_non_blocking_receive(late, &data) == CHANNEL_EMPTY);
+    mu_assert("test_broadcast: Unsubscribe failed", broadcast_unsubscribe(subs[2]) == SUCCESS);
+    for (uintptr_t i = 6; i <= 8; i++) {
+        mu_assert("test_broadcast: Publish failed", broadcast_non_blocking_publish(broadcast, (void*)i) == SUCCESS);
+    }
+    for (uintptr_t i = 6; i <= 8; i++) {
+        mu_assert("test_broadcast: Receive failed", broadcast_non_blocking_receive(late, &data) == SUCCESS);
+        mu_assert("test_broadcast: Late subscriber out of order", data == (void*)i);
+    }
+    mu_assert("test_broadcast: Destroyed an open broadcast", broadcast_destroy(broadcast) == DESTROY_ERROR);
+    mu_assert("test_broadcast: Close failed", broadcast_close(broadcast) == SUCCESS);
+    mu_assert("test_broadcast: Closed twice", broadcast_close(broadcast) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Published on a closed broadcast", broadcast_publish(broadcast, (void*)9) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Received on a closed broadcast", broadcast_receive(subs[0], &data) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Subscribed to a closed broadcast", broadcast_subscribe(broadcast) == NULL);
+    mu_assert("test_broadcast: Destroy failed", broadcast_destroy(broadcast) == SUCCESS);
+
+    // Blocking publishes and receives: every subscriber thread sees every message in order
+    broadcast = broadcast_create(8, BROADCAST_BLOCK);
+    broadcast_reader_t readers[3];
+    pthread_t pids[3];
+    for (size_t i = 0; i < 3; i++) {
+        readers[i].sub = broadcast_subscribe(broadcast);
+        pthread_create(&pids[i], NULL, broadcast_read_all, &readers[i]);
+    }
+    for (uintptr_t i = 1; i <= BROADCAST_MESSAGES; i++) {
+        mu_assert("test_broadcast: Blocking publish failed", broadcast_publish(broadcast, (void*)i) == SUCCESS);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("test_broadcast: Subscriber missed messages", readers[i].received == BROADCAST_MESSAGES);
+        mu_assert("test_broadcast: Subscriber got messages out of order", readers[i].in_order);
+    }
+
+    // Close wakes a subscriber waiting for a message
+    pthread_create(&pids[0], NULL, broadcast_wait_closed, &readers[0]);
+    usleep(10000);
+    broadcast_close(broadcast);
+    pthread_join(pids[0], NULL);
+    mu_assert("test_broadcast: Close did not wake the subscriber", readers[0].in_order);
+    broadcast_destroy(broadcast);
+
+    // Dropping: a lapped subscriber skips to the oldest message left and counts what it lost
+    broadcast = broadcast_create(4, BROADCAST_DROP);
+    broadcast_sub_t* slow = broadcast_subscribe(broadcast);
+    for (uintptr_t i = 1; i <= 10; i++) {
+        mu_assert("test_broadcast: Dropping publish failed", broadcast_non_blocking_publish(broadcast, (void*)i) == SUCCESS);
+    }
+    for (uintptr_t i = 8; i <= 10; i++) {
+        mu_assert("test_broadcast: Receive failed", broadcast_non_blocking_receive(slow, &data) == SUCCESS);
+        mu_assert("test_broadcast: Lapped subscriber did not skip ahead", data == (void*)i);
+    }
+    mu_assert("test_broadcast: Wrong dropped count", broadcast_dropped(slow) == 7);
+    mu_assert("test_broadcast: Received past the last message", broadcast_non_blocking_receive(slow, &data) == CHANNEL_EMPTY);
+    broadcast_close(broadcast);
+    broadcast_destroy(broadcast);
+    return NULL;
+}
+
+// Registers fd with the epoll set for the given events
+static void epoll_watch(int epfd, int fd, uint32_t events) {
+    struct epoll_event event = {.events = events, .data.fd = fd};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+// Returns the events epoll reports for fd, waiting up to timeout_ms for any fd of the set to be ready
+static uint32_t epoll_ready(int epfd, int fd, int timeout_ms) {
+    struct epoll_event events[4];
+    int n = epoll_wait(epfd, events, 4, timeout_ms);
+    uint32_t ready = 0;
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == fd) ready |= events[i].events;
+    }
+    return ready;
+}
+
+char* test_channel_eventfd() {
+    print_test_details(__func__, "Testing channel eventfds in an epoll set with a pipe");
+
+    channel_t* channel = channel_create(2);
+    mu_assert("test_channel_eventfd: Fd before enabling eventfds", channel_receive_fd(channel) == -1 && channel_send_fd(channel) == -1);
+    mu_assert("test_channel_eventfd: Enabling eventfds failed", channel_eventfd_enable(channel) == SUCCESS);
+    int receive_fd = channel_receive_fd(channel);
+    int send_fd = channel_send_fd(channel);
+    mu_assert("test_channel_eventfd: Missing fds", receive_fd >= 0 && send_fd >= 0);
+    mu_assert("test_channel_eventfd: Enabling twice failed", channel_eventfd_enable(channel) == SUCCESS && channel_receive_fd(channel) == receive_fd);
+
+    // One set waits for a message on the channel or data on the pipe, the other for room on the channel
+    int pipe_fds[2];
+    mu_assert("test_channel_eventfd: Could not create a pipe", pipe(pipe_fds) == 0);
+    int readers = epoll_create1(0);
+    int writers = epoll_create1(0);
+    epoll_watch(readers, pipe_fds[0], EPOLLIN);
+    epoll_watch(readers, receive_fd, EPOLLIN);
+    epoll_watch(writers, send_fd, EPOLLOUT);
+    mu_assert("test_channel_eventfd: Empty channel is readable", epoll_ready(readers, receive_fd, 0) == 0);
+    mu_assert("test_channel_eventfd: Empty channel is not writable", epoll_ready(writers, send_fd, 0) == EPOLLOUT);
+
+    char byte = 'x';
+    mu_assert("test_channel_eventfd: Pipe write failed", write(pipe_fds[1], &byte, 1) == 1);
+    mu_assert("test_channel_eventfd: Pipe not readable", epoll_ready(readers, pipe_fds[0], 1000) == EPOLLIN);
+    mu_assert("test_channel_eventfd: Pipe data made the channel readable", epoll_ready(readers, receive_fd, 0) == 0);
+    mu_assert("test_channel_eventfd: Pipe read failed", read(pipe_fds[0], &byte, 1) == 1);
+
+    // A send from another thread wakes the epoll_wait
+    send_args data_send;
+    pthread_t pid;
+    init_object_for_send_api(&data_send, channel, "Message1", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &data_send);
+    mu_assert("test_channel_eventfd: Send did not make the channel readable", epoll_ready(readers, receive_fd, 1000) == EPOLLIN);
+    pthread_join(pid, NULL);
+    void* data;
+    mu_assert("test_channel_eventfd: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS && string_equal(data, "Message1"));
+    mu_assert("test_channel_eventfd: Drained channel is readable", epoll_ready(readers, receive_fd, 0) == 0);
+
+    // A full channel is not writable until a receive makes room
+    mu_assert("test_channel_eventfd: Send failed", channel_non_blocking_send(channel, "Message2") == SUCCESS);
+    mu_assert("test_channel_eventfd: Channel with room is not writable", epoll_ready(writers, send_fd, 0) == EPOLLOUT);
+    mu_assert("test_channel_eventfd: Send failed", channel_non_blocking_send(channel, "Message3") == SUCCESS);
+    mu_assert("test_channel_eventfd: Full channel is writable", epoll_ready(writers, send_fd, 0) == 0);
+    mu_assert("test_channel_eventfd: Receive failed", channel_receive(channel, &data) == SUCCESS);
+    mu_assert("test_channel_eventfd: Receive did not make the channel writable", epoll_ready(writers, send_fd, 0) == EPOLLOUT);
+    mu_assert("test_channel_eventfd: Channel with a message is not readable", epoll_ready(readers, receive_fd, 0) == EPOLLIN);
+    mu_assert("test_channel_eventfd: Receive failed", channel_receive(channel, &data) == SUCCESS);
+
+    // Closing makes both sides ready, so the epoll loop calls the channel and sees CLOSED_ERROR
+    channel_close(channel);
+    mu_assert("test_channel_eventfd: Closed channel is not readable", epoll_ready(readers, receive_fd, 0) == EPOLLIN);
+    mu_assert("test_channel_eventfd: Closed channel is not writable", epoll_ready(writers, send_fd, 0) == EPOLLOUT);
+    mu_assert("test_channel_eventfd: Receive on a closed channel", channel_non_blocking_receive(channel, &data) == CLOSED_ERROR);
+    channel_destroy(channel);
+    close(readers);
+    close(writers);
+
+    // Unbuffered: a parked sender makes the channel readable, a parked receiver makes it writable
+    channel = channel_create(0);
+    channel_eventfd_enable(channel);
+    receive_fd = channel_receive_fd(channel);
+    send_fd = channel_send_fd(channel);
+    readers = epoll_create1(0);
+    writers = epoll_create1(0);
+    epoll_watch(readers, pipe_fds[0], EPOLLIN);
+    epoll_watch(readers, receive_fd, EPOLLIN);
+    epoll_watch(writers, send_fd, EPOLLOUT);
+    mu_assert("test_channel_eventfd: Unbuffered channel is readable", epoll_ready(readers, receive_fd, 0) == 0);
+    mu_assert("test_channel_eventfd: Unbuffered channel is writable", epoll_ready(writers, send_fd, 0) == 0);
+    init_object_for_send_api(&data_send, channel, "Message4", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &data_send);
+    mu_assert("test_channel_eventfd: Parked sender did not make the channel readable", epoll_ready(readers, receive_fd, 1000) == EPOLLIN);
+    mu_assert("test_channel_eventfd: Receive from the parked sender failed", channel_non_blocking_receive(channel, &data) == SUCCESS && string_equal(data, "Message4"));
+    pthread_join(pid, NULL);
+    mu_assert("test_channel_eventfd: Unbuffered channel still readable", epoll_ready(readers, receive_fd, 0) == 0);
+    receive_args data_rec;
+    init_object_for_receive_api(&data_rec, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &data_rec);
+    mu_assert("test_channel_eventfd: Parked receiver did not make the channel writable", epoll_ready(writers, send_fd, 1000) == EPOLLOUT);
+    mu_assert("test_channel_eventfd: Send to the parked receiver failed", channel_non_blocking_send(channel, "Message5") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_channel_eventfd: Parked receiver got the wrong message", data_rec.out == SUCCESS && string_equal(data_rec.data, "Message5"));
+    mu_assert("test_channel_eventfd: Unbuffered channel still writable", epoll_ready(writers, send_fd, 0) == 0);
+    channel_close(channel);
+    channel_destroy(channel);
+    close(readers);
+    close(writers);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return NULL;
+}
+
+#define CORO_RING 200
+#define CORO_ROUNDS 20
+#define CORO_CHILDREN 100
+
+channel_t* coro_ring[CORO_RING + 1];
+coro_sched_t* coro_test_sched;
+atomic_size_t coro_finished;
+
+// Ring member i: adds one to every token on its way from coro_ring[i] to coro_ring[i + 1]
+void coro_ring_member(void* arg) {
+    size_t index = (size_t)arg;
+    for (size_t round = 0; round < CORO_ROUNDS; round++) {
+        void* data;
+        if (channel_receive(coro_ring[index], &data) != SUCCESS || coro_self() == NULL) return;
+        coro_yield();
+        if (channel_send(coro_ring[index + 1], (void*)((uintptr_t)data + 1)) != SUCCESS) return;
+    }
+    atomic_fetch_add(&coro_finished, 1);
+}
+
+typedef struct {
+    select_t list[2];
+    size_t selected[2];
+    enum channel_status status;
+} coro_selector_t;
+
+void coro_select_twice(void* arg) {
+    coro_selector_t* selector = arg;
+    selector->status = SUCCESS;
+    for (size_t i = 0; i < 2 && selector->status == SUCCESS; i++) {
+        selector->status = channel_select(selector->list, 2, &selector->selected[i]);
+    }
+}
+
+void coro_send_one(void* arg) {
+    select_t* entry = arg;
+    channel_send(entry->channel, entry->data);
+}
+
+void coro_child(void* arg) {
+    (void)arg;
+    coro_yield();
+    atomic_fetch_add(&coro_finished, 1);
+}
+
+void coro_parent(void* arg) {
+    (void)arg;
+    for (size_t i = 0; i < CORO_CHILDREN; i++) {
+        coro_spawn(coro_test_sched, coro_child, NULL);
+    }
+}
+
+char* test_coro() {
+    print_test_details(__func__, "Testing coroutines parking on channel waits");
+
+    mu_assert("test_coro: Coroutine outside the scheduler", coro_self() == NULL);
+    for (size_t size = 0; size <= 1; size++) {
+        // A ring of coroutines that the main thread feeds and drains
+        coro_sched_t* sched = coro_sched_create(3);
+        mu_assert("test_coro: Scheduler creation failed", sched != NULL);
+        atomic_store(&coro_finished, 0);
+        for (size_t i = 0; i <= CORO_RING; i++) {
+            coro_ring[i] = channel_create(size);
+        }
+        for (size_t i = 0; i < CORO_RING; i++) {
+            mu_assert("test_coro: Spawn failed", coro_spawn(sched, coro_ring_member, (void*)i) == SUCCESS);
+        }
+        for (uintptr_t round = 0; round < CORO_ROUNDS; round++) {
+            void* data;
+            mu_assert("test_coro: Send into the ring failed", channel_send(coro_ring[0], (void*)round) == SUCCESS);
+            mu_assert("test_coro: Receive from the ring failed", channel_receive(coro_ring[CORO_RING], &data) == SUCCESS);
+            mu_assert("test_coro: Token skipped a ring member", (uintptr_t)data == round + CORO_RING);
+        }
+        mu_assert("test_coro: Destroyed a running scheduler", coro_sched_destroy(sched) == DESTROY_ERROR);
+        mu_assert("test_coro: Shutdown failed", coro_sched_shutdown(sched) == SUCCESS);
+        mu_assert("test_coro: Ring members did not finish", atomic_load(&coro_finished) == CORO_RING);
+        mu_assert("test_coro: Shut down twice", coro_sched_shutdown(sched) == CLOSED_ERROR);
+        mu_assert("test_coro: Spawned after shutdown", coro_spawn(sched, coro_child, NULL) == CLOSED_ERROR);
+        mu_assert("test_coro: Destroy failed", coro_sched_destroy(sched) == SUCCESS);
+        for (size_t i = 0; i <= CORO_RING; i++) {
+            channel_close(coro_ring[i]);
+            channel_destroy(coro_ring[i]);
+        }
+    }
+
+    // Select parks like a plain receive and wakes for either channel
+    coro_test_sched = coro_sched_create(2);
+    coro_selector_t selector;
+    select_t senders[2];
+    for (size_t i = 0; i < 2; i++) {
+        selector.list[i].channel = channel_create(0);
+        selector.list[i].dir = RECV;
+        senders[i].channel = selector.list[i].channel;
+        senders[i].data = i == 0 ? "Message1" : "Message2";
+    }
+    coro_spawn(coro_test_sched, coro_select_twice, &selector);
+    coro_spawn(coro_test_sched, coro_send_one, &senders[0]);
+    coro_spawn(coro_test_sched, coro_send_one, &senders[1]);
+
+    // Coroutines spawned by a coroutine finish before shutdown returns
+    atomic_store(&coro_finished, 0);
+    coro_spawn(coro_test_sched, coro_parent, NULL);
+    mu_assert("test_coro: Shutdown failed", coro_sched_shutdown(coro_test_sched) == SUCCESS);
+    mu_assert("test_coro: Select failed", selector.status == SUCCESS);
+    mu_assert("test_coro: Select returned one channel twice", selector.selected[0] + selector.selected[1] == 1);
+    mu_assert("test_coro: Nested coroutines did not finish", atomic_load(&coro_finished) == CORO_CHILDREN);
+    coro_sched_destroy(coro_test_sched);
+    for (size_t i = 0; i < 2; i++) {
+        channel_close(selector.list[i].channel);
+        channel_destroy(selector.list[i].channel);
+    }
+
+    // The ring stress test with a coroutine per member
+    mu_assert("test_coro: No hops in the unbuffered ring", run_stress_send_recv_coro(0, 200, 2, 0.5, 100000) > 0);
+    mu_assert("test_coro: No hops in the buffered ring", run_stress_send_recv_coro(1, 500, 0, 0.5, 100000) > 0);
+    return NULL;
+}
+
+#define POOL_TASKS 10000
+#define POOL_TREE_DEPTH 12
+
+void* pool_increment(void* arg) {
+    return (void*)((uintptr_t)arg + 1);
+}
+
+typedef struct {
+    pool_t* pool;
+    atomic_size_t leaves;
+} pool_tree_t;
+
+// One node of the task tree
+typedef struct {
+    pool_tree_t* tree;
+    size_t depth;
+} pool_node_t;
+
+void* pool_split(void* arg) {
+    pool_node_t* node = arg;
+    if (node->depth == 0) {
+        atomic_fetch_add(&node->tree->leaves, 1);
+    } else {
+        // Both children are submitted from inside the pool and land on this worker's deque
+        for (size_t i = 0; i < 2; i++) {
+            pool_node_t* child = malloc(sizeof(pool_node_t));
+            child->tree = node->tree;
+            child->depth = node->depth - 1;
+            pool_submit(node->tree->pool, pool_split, child, NULL);
+        }
+    }
+    free(node);
+    return NULL;
+}
+
+char* test_thread_pool() {
+    print_test_details(__func__, "Testing the work-stealing thread pool");
+
+    pool_t* pool = pool_create(4);
+    mu_assert("test_thread_pool: Could not create pool", pool != NULL);
+    mu_assert("test_thread_pool: Destroyed a running pool", pool_destroy(pool) == DESTROY_ERROR);
+
+    // Futures: every result comes back through the channel
+    channel_t* results = channel_create(POOL_TASKS);
+    for (size_t i = 0; i < POOL_TASKS; i++) {
+        mu_assert("test_thread_pool: Incorrect submit status", pool_submit(pool, pool_increment, (void*)i, results) == SUCCESS);
+    }
+    size_t sum = 0;
+    for (size_t i = 0; i < POOL_TASKS; i++) {
+        void* data;
+        mu_assert("test_thread_pool: Incorrect receive status", channel_receive(results, &data) == SUCCESS);
+        sum += (uintptr_t)data;
+    }
+    mu_assert("test_thread_pool: Wrong sum of results", sum == (size_t)POOL_TASKS * (POOL_TASKS + 1) / 2);
+
+    // Tasks that submit tasks: shutdown waits for the whole tree
+    pool_tree_t tree = {.pool = pool};
+    atomic_init(&tree.leaves, 0);
+    pool_node_t* root = malloc(sizeof(pool_node_t));
+    root->tree = &tree;
+    root->depth = POOL_TREE_DEPTH;
+    mu_assert("test_thread_pool: Incorrect submit status", pool_submit(pool, pool_split, root, NULL) == SUCCESS);
+
+    mu_assert("test_thread_pool: Incorrect shutdown status", pool_shutdown(pool) == SUCCESS);
+    mu_assert("test_thread_pool: Shutdown before every task ran", atomic_load(&tree.leaves) == (size_t)1 << POOL_TREE_DEPTH);
+    mu_assert("test_thread_pool: Shut down twice", pool_shutdown(pool) == CLOSED_ERROR);
+    mu_assert("test_thread_pool: Submitted to a shut down pool", pool_submit(pool, pool_increment, NULL, results) == CLOSED_ERROR);
+
+    mu_assert("test_thread_pool: Incorrect destroy status", pool_destroy(pool) == SUCCESS);
+    channel_close(results);
+    channel_destroy(results);
+    return NULL;
+}
+
+#define FW_THREADS 4
+
+char* test_floyd_warshall() {
+    print_test_details(__func__, "Testing the blocked Floyd-Warshall solver against the reference");
+
+    // Sizes around the tile size, so padded and partial tiles are covered
+    const size_t sizes[] = {1, 5, FW_BLOCK - 1, FW_BLOCK, FW_BLOCK + 1, 3 * FW_BLOCK + 7};
+    unsigned int seed = 473;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        distance_t* graph = malloc(sizeof(distance_t) * n * n);
+        distance_t* expected = malloc(sizeof(distance_t) * n * n);
+        distance_t* actual = malloc(sizeof(distance_t) * n * n);
+        for (size_t i = 0; i < n * n; i++) {
+            // Mostly missing links, a few long ones so sums go past inf
+            int r = rand_r(&seed);
+            graph[i] = (r % 4 != 0) ? 0x7fffffff : (r % 16 == 0) ? 0x7fffff00 + (distance_t)(r % 255) : (distance_t)(r % 1000);
+        }
+        for (size_t i = 0; i < n; i++) {
+            graph[i * n + i] = 0;
+        }
+        memcpy(expected, graph, sizeof(distance_t) * n * n);
+        floyd_warshall_reference(expected, n);
+        for (size_t threads = 1; threads <= FW_THREADS; threads += FW_THREADS - 1) {
+            memcpy(actual, graph, sizeof(distance_t) * n * n);
+            floyd_warshall_blocked(actual, n, threads);
+            mu_assert("test_floyd_warshall: Blocked solution differs from the reference", memcmp(actual, expected, sizeof(distance_t) * n * n) == 0);
+        }
+        free(graph);
+        free(expected);
+        free(actual);
+    }
+    return NULL;
+}
+
+// Writes the text to a new temporary file and returns its name in path
+static void write_temp_topology(char* path, const char* text) {
+    strcpy(path, "/tmp/topologyXXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    ssize_t written = write(fd, text, strlen(text));
+    assert(written == (ssize_t)strlen(text));
+    close(fd);
+}
+
+char* test_topology_loader() {
+    print_test_details(__func__, "Testing the dense and edge-list topology loaders");
+
+    // The sparse copy of big_graph.txt lists every link once
+    distance_t* dense;
+    distance_t* sparse;
+    size_t dense_n, sparse_n;
+    mu_assert("test_topology_loader: Could not load the dense topology", load_topology("big_graph.txt", &dense, &dense_n));
+    mu_assert("test_topology_loader: Could not load the sparse topology", load_topology("big_graph_edges.txt", &sparse, &sparse_n));
+    mu_assert("test_topology_loader: Node counts differ", dense_n == 100 && sparse_n == dense_n);
+    mu_assert("test_topology_loader: Link distances differ", memcmp(dense, sparse, sizeof(distance_t) * dense_n * dense_n) == 0);
+    free(dense);
+    free(sparse);
+
+    char path[32];
+    distance_t* matrix;
+    size_t n;
+    write_temp_topology(path, "edges 3\n0 1 5\n1 2 -1\n0 1 4\n");
+    mu_assert("test_topology_loader: Could not load edges", load_topology(path, &matrix, &n));
+    unlink(path);
+    distance_t expected[] = {0, 4, 0x7fffffff, 4, 0, 0x7fffffff, 0x7fffffff, 0x7fffffff, 0};
+    mu_assert("test_topology_loader: Wrong distances from edges", n == 3 && memcmp(matrix, expected, sizeof(expected)) == 0);
+    free(matrix);
+
+    const char* malformed[] = {"", "2\n0 1\n1", "2\n0 1 x 0", "0", "edges 2\n0 2 1", "edges 2\n0 1"};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        write_temp_topology(path, malformed[i]);
+        mu_assert("test_topology_loader: Loaded a malformed topology", !load_topology(path, &matrix, &n));
+        unlink(path);
+    }
+    mu_assert("test_topology_loader: Loaded a missing file", !load_topology("no_such_topology.txt", &matrix, &n));
+    return NULL;
+}
+
+#define FUTEX_THREADS 8
+#define FUTEX_LOCKS 200000
+#define FUTEX_ROUNDS 20000
+#define FUTEX_WAITERS 4
+
+typedef struct {
+    futex_mutex_t mutex;
+    futex_cond_t cond;
+    size_t counter;    // protected by mutex
+    size_t waiting;    // waiters inside their wait loop, protected by mutex
+    size_t wakeups;    // returns from futex_cond_wait, protected by mutex
+    bool done;         // protected by mutex
+} futex_shared_t;
+
+void* futex_lock_worker(void* arg) {
+    futex_shared_t* shared = arg;
+    for (size_t i = 0; i < FUTEX_LOCKS; i++) {
+        futex_mutex_lock(&shared->mutex);
+        shared->counter++;
+        futex_mutex_unlock(&shared->mutex);
+    }
+    return NULL;
+}
+
+char* test_futex_mutex() {
+    print_test_details(__func__, "Testing the futex mutex under contention");
+
+    futex_shared_t shared = {.counter = 0};
+    futex_mutex_init(&shared.mutex);
+    pthread_t pid[FUTEX_THREADS];
+    for (size_t i = 0; i < FUTEX_THREADS; i++) {
+        pthread_create(&pid[i], NULL, futex_lock_worker, &shared);
+    }
+    for (size_t i = 0; i < FUTEX_THREADS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    mu_assert("test_futex_mutex: Lost an update under the mutex", shared.counter == (size_t)FUTEX_THREADS * FUTEX_LOCKS);
+    mu_assert("test_futex_mutex: Mutex left locked", atomic_load(&shared.mutex.state) == 0);
+    return NULL;
+}
+
+// Two threads hand a turn back and forth; a lost wakeup leaves both asleep and the test times out
+typedef struct {
+    waitq_t queues[2];     // queues[i]: thread i waiting for its turn
+    atomic_size_t turn;
+} futex_ping_pong_t;
+
+void* futex_ping_pong_worker(void* arg, size_t self) {
+    futex_ping_pong_t* game = arg;
+    for (size_t round = 0; round < FUTEX_ROUNDS; round++) {
+        if (atomic_load(&game->turn) != self) {
+            uint32_t word = waitq_enter(&game->queues[self]);
+            while (atomic_load(&game->turn) != self) {
+                word = waitq_wait(&game->queues[self], word);
+            }
+            waitq_leave(&game->queues[self]);
+        }
+        atomic_store(&game->turn, 1 - self);
+        waitq_wake_one(&game->queues[1 - self]);
+    }
+    return NULL;
+}
+
+void* futex_ping_worker(void* arg) {
+    return futex_ping_pong_worker(arg, 0);
+}
+
+void* futex_pong_worker(void* arg) {
+    return futex_ping_pong_worker(arg, 1);
+}
+
+void* futex_cond_ping_pong_worker(futex_shared_t* shared, size_t self) {
+    for (size_t round = 0; round < FUTEX_ROUNDS; round++) {
+        futex_mutex_lock(&shared->mutex);
+        while (shared->counter % 2 != self) {
+            futex_cond_wait(&shared->cond, &shared->mutex);
+        }
+        shared->counter++;
+        futex_cond_signal(&shared->cond);
+        futex_mutex_unlock(&shared->mutex);
+    }
+    return NULL;
+}
+
+void* futex_cond_ping_worker(void* arg) {
+    return futex_cond_ping_pong_worker(arg, 0);
+}
+
+void* futex_cond_pong_worker(void* arg) {
+    return futex_cond_ping_pong_worker(arg, 1);
+}
+
+char* test_futex_lost_wakeup() {
+    print_test_details(__func__, "Testing wait queues and condition variables for lost wakeups");
+
+    futex_ping_pong_t game;
+    waitq_init(&game.queues[0]);
+    waitq_init(&game.queues[1]);
+    atomic_init(&game.turn, 0);
+    pthread_t ping, pong;
+    pthread_create(&ping, NULL, futex_ping_worker, &game);
+    pthread_create(&pong, NULL, futex_pong_worker, &game);
+    pthread_join(ping, NULL);
+    pthread_join(pong, NULL);
+    mu_assert("test_futex_lost_wakeup: Wait queue ended on the wrong turn", atomic_load(&game.turn) == 0);
+    mu_assert("test_futex_lost_wakeup: Waiter left behind in a wait queue",
+              atomic_load(&game.queues[0].blocked) == 0 && atomic_load(&game.queues[1].blocked) == 0);
+
+    futex_shared_t shared = {.counter = 0};
+    futex_mutex_init(&shared.mutex);
+    futex_cond_init(&shared.cond);
+    pthread_create(&ping, NULL, futex_cond_ping_worker, &shared);
+    pthread_create(&pong, NULL, futex_cond_pong_worker, &shared);
+    pthread_join(ping, NULL);
+    pthread_join(pong, NULL);
+    mu_assert("test_futex_lost_wakeup: Condition variable skipped a turn", shared.counter == 2 * FUTEX_ROUNDS);
+    return NULL;
+}
+
+void* futex_cond_waiter(void* arg) {
+    futex_shared_t* shared = arg;
+    futex_mutex_lock(&shared->mutex);
+    shared->waiting++;
+    while (!shared->done) {
+        futex_cond_wait(&shared->cond, &shared->mutex);
+        shared->wakeups++;
+    }
+    futex_mutex_unlock(&shared->mutex);
+    return NULL;
+}
+
+char* test_futex_cond_signal() {
+    print_test_details(__func__, "Testing that a condition signal wakes exactly one waiter");
+
+    futex_shared_t shared = {.waiting = 0, .wakeups = 0, .done = false};
+    futex_mutex_init(&shared.mutex);
+    futex_cond_init(&shared.cond);
+    pthread_t pid[FUTEX_WAITERS];
+    for (size_t i = 0; i < FUTEX_WAITERS; i++) {
+        pthread_create(&pid[i], NULL, futex_cond_waiter, &shared);
+    }
+    size_t waiting = 0;
+    while (waiting < FUTEX_WAITERS) {
+        usleep(1000);
+        futex_mutex_lock(&shared.mutex);
+        waiting = shared.waiting;
+        futex_mutex_unlock(&shared.mutex);
+    }
+    usleep(20000); // Let every waiter get to sleep in the kernel
+
+    futex_mutex_lock(&shared.mutex);
+    futex_cond_signal(&shared.cond);
+    futex_mutex_unlock(&shared.mutex);
+    usleep(50000);
+    futex_mutex_lock(&shared.mutex);
+    size_t wakeups = shared.wakeups;
+    shared.done = true;
+    futex_cond_broadcast(&shared.cond);
+    futex_mutex_unlock(&shared.mutex);
+    mu_assert("test_futex_cond_signal: Signal did not wake exactly one waiter", wakeups == 1);
+
+    for (size_t i = 0; i < FUTEX_WAITERS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    mu_assert("test_futex_cond_signal: Broadcast did not wake every waiter", shared.wakeups == 1 + FUTEX_WAITERS);
+    return NULL;
+}
+
+char* test_list_link() {
+    print_test_details(__func__, "Testing caller-owned list nodes");
+
+    list_t* list = list_create();
+    list_node_t nodes[3];
+    char* values[] = {"a", "b", "c"};
+    for (size_t i = 0; i < 3; i++) {
+        list_link(list, &nodes[i], values[i]);
+    }
+    mu_assert("test_list_link: Wrong count after linking", list_count(list) == 3);
+    mu_assert("test_list_link: Wrong head", list_head(list) == &nodes[0] && list_data(list_head(list)) == values[0]);
+    mu_assert("test_list_link: Wrong tail", list_tail(list) == &nodes[2]);
+    mu_assert("test_list_link: Wrong order", list_next(&nodes[0]) == &nodes[1] && list_next(&nodes[1]) == &nodes[2] && list_next(&nodes[2]) == NULL);
+    mu_assert("test_list_link: Wrong back links", list_prev(&nodes[2]) == &nodes[1] && list_prev(&nodes[1]) == &nodes[0] && list_prev(&nodes[0]) == NULL);
+    mu_assert("test_list_link: Linked node not found", list_find(list, values[1]) == &nodes[1]);
+
+    // Middle, then head: the remaining nodes close up around the gap
+    list_unlink(list, &nodes[1]);
+    mu_assert("test_list_link: Wrong count after unlinking", list_count(list) == 2);
+    mu_assert("test_list_link: Middle unlink broke the links", list_next(&nodes[0]) == &nodes[2] && list_prev(&nodes[2]) == &nodes[0]);
+    mu_assert("test_list_link: Unlinked node still found", list_find(list, values[1]) == NULL);
+    list_unlink(list, &nodes[0]);
+    mu_assert("test_list_link: Head unlink broke the list", list_head(list) == &nodes[2] && list_tail(list) == &nodes[2] && list_prev(&nodes[2]) == NULL);
+
+    // An unlinked node can be linked again, as a select does when it moves to the back
+    list_link(list, &nodes[0], values[0]);
+    list_unlink(list, &nodes[2]);
+    list_link(list, &nodes[2], values[2]);
+    mu_assert("test_list_link: Relinking gave the wrong order", list_head(list) == &nodes[0] && list_next(&nodes[0]) == &nodes[2] && list_tail(list) == &nodes[2]);
+
+    // Allocated and caller-owned nodes mix; only the allocated ones are freed
+    list_node_t* inserted = list_insert(list, values[1]);
+    mu_assert("test_list_link: Insert after link went astray", list_tail(list) == inserted && list_prev(inserted) == &nodes[2]);
+    list_unlink(list, &nodes[0]);
+    list_unlink(list, &nodes[2]);
+    mu_assert("test_list_link: Unlinking left the wrong node", list_count(list) == 1 && list_head(list) == inserted && list_tail(list) == inserted);
+    list_destroy(list);
+    return NULL;
+}
+
+#define SELECT_WAKE_THREADS 8
+#define SELECT_WAKE_ITEMS 2000
+
+typedef struct {
+    channel_t* channel;
+    atomic_size_t* received;
+    size_t count;          // items this thread's selects took
+} select_wake_args;
+
+void* select_wake_worker(void* arg) {
+    select_wake_args* args = arg;
+    select_t list[1] = {{.channel = args->channel, .dir = RECV, .data = NULL}};
+    size_t index;
+    while (channel_select(list, 1, &index) == SUCCESS) {
+        args->count++;
+        atomic_fetch_add(args->received, 1);
+    }
+    return NULL;
+}
+
+// Waits up to a second for count to reach target
+static bool wait_for_count(atomic_size_t* count, size_t target) {
+    for (size_t i = 0; i < 1000 && atomic_load(count) < target; i++) {
+        usleep(1000);
+    }
+    return atomic_load(count) >= target;
+}
+
+char* test_select_wake_one() {
+    print_test_details(__func__, "Testing that each item wakes one of many selects on a channel");
+
+    channel_t* channel = channel_create(1);
+    mu_assert("test_select_wake_one: Enabling stats failed", channel_stats_enable(channel) == SUCCESS);
+    atomic_size_t received;
+    atomic_init(&received, 0);
+    select_wake_args args[SELECT_WAKE_THREADS];
+    pthread_t pid[SELECT_WAKE_THREADS];
+    for (size_t i = 0; i < SELECT_WAKE_THREADS; i++) {
+        args[i] = (select_wake_args){.channel = channel, .received = &received, .count = 0};
+        pthread_create(&pid[i], NULL, select_wake_worker, &args[i]);
+    }
+
+    // One item at a time while every select sleeps: each wakes a single select,
+    // and the rotation hands consecutive items to different selects
+    channel_stats_t stats;
+    for (size_t i = 0; i < SELECT_WAKE_THREADS; i++) {
+        for (size_t j = 0; j < 1000 && atomic_load(&channel->recv_select_count) < SELECT_WAKE_THREADS; j++) {
+            usleep(1000);
+        }
+        mu_assert("test_select_wake_one: Selects did not register", atomic_load(&channel->recv_select_count) == SELECT_WAKE_THREADS);
+        usleep(10000);
+        mu_assert("test_select_wake_one: Incorrect send status", channel_send(channel, "M") == SUCCESS);
+        mu_assert("test_select_wake_one: Item was not received", wait_for_count(&received, i + 1));
+        channel_stats_get(channel, &stats);
+        mu_assert("test_select_wake_one: An item woke more than one select", stats.select_wakeups == i + 1);
+    }
+    for (size_t i = 0; i < SELECT_WAKE_THREADS; i++) {
+        mu_assert("test_select_wake_one: Consecutive items went to the same select", args[i].count == 1);
+    }
+
+    // A burst of items: none may be lost while selects pass wakes on
+    for (size_t i = 0; i < SELECT_WAKE_ITEMS; i++) {
+        mu_assert("test_select_wake_one: Incorrect send status", channel_send(channel, "M") == SUCCESS);
+    }
+    mu_assert("test_select_wake_one: Lost an item", wait_for_count(&received, SELECT_WAKE_THREADS + SELECT_WAKE_ITEMS));
+
+    mu_assert("test_select_wake_one: Testing channel close failed", channel_close(channel) == SUCCESS);
+    for (size_t i = 0; i < SELECT_WAKE_THREADS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    mu_assert("test_select_wake_one: Received more items than sent", atomic_load(&received) == SELECT_WAKE_THREADS + SELECT_WAKE_ITEMS);
+    channel_destroy(channel);
+    return NULL;
+}
+
 test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_free", test_free},
                   {"test_send_correctness", test_send_correctness},
@@ -1659,14 +3011,38 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_select_and_non_blocking_send_size1", test_select_and_non_blocking_send_size1},
                   {"test_select_and_non_blocking_receive_size1", test_select_and_non_blocking_receive_size1},
                   {"test_select_with_select_size1", test_select_with_select_size1},
+                  {"test_select_with_select_unbuffered", test_select_with_select_unbuffered},
                   {"test_select_with_same_channel_size1", test_select_with_same_channel_size1},
                   {"test_select_with_send_receive_on_same_channel_size1", test_select_with_send_receive_on_same_channel_size1},
+                  {"test_select_with_send_receive_on_same_channel_unbuffered", test_select_with_send_receive_on_same_channel_unbuffered},
                   {"test_select_with_duplicate_channel_size1", test_select_with_duplicate_channel_size1},
                   {"test_stress", test_stress},
                   {"test_select_response_time", test_select_response_time},
                   {"test_cpu_utilization_select", test_cpu_utilization_select},
                   {"test_cpu_utilization_overall", test_cpu_utilization_overall},
                   {"test_for_too_many_wakeups", test_for_too_many_wakeups},
+                  {"test_batch_send_receive", test_batch_send_receive},
+                  {"test_non_blocking_batch", test_non_blocking_batch},
+                  {"test_select_policy", test_select_policy},
+                  {"test_unbuffered_close_with_receive", test_unbuffered_close_with_receive},
+                  {"test_typed_channel", test_typed_channel},
+                  {"test_timed_operations", test_timed_operations},
+                  {"test_unbuffered_handoff_order", test_unbuffered_handoff_order},
+                  {"test_thread_pool", test_thread_pool},
+                  {"test_floyd_warshall", test_floyd_warshall},
+                  {"test_topology_loader", test_topology_loader},
+                  {"test_futex_mutex", test_futex_mutex},
+                  {"test_futex_lost_wakeup", test_futex_lost_wakeup},
+                  {"test_futex_cond_signal", test_futex_cond_signal},
+                  {"test_list_link", test_list_link},
+                  {"test_select_wake_one", test_select_wake_one},
+                  {"test_stress_delta", test_stress_delta},
+                  {"test_stress_capacity", test_stress_capacity},
+                  {"test_channel_stats", test_channel_stats},
+                  {"test_buffer_ring", test_buffer_ring},
+                  {"test_broadcast", test_broadcast},
+                  {"test_channel_eventfd", test_channel_eventfd},
+                  {"test_coro", test_coro},
 };
 
 size_t num_tests = sizeof(tests)/sizeof(tests[0]);